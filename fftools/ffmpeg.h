@@ -74,6 +74,12 @@ enum EncTimeBase {
 
 #define MAX_STREAMS 1024    /* arbitrary sanity check value */
 
+enum FilterStatsFormat {
+    FILTER_STATS_NONE = 0,
+    FILTER_STATS_TABLE,
+    FILTER_STATS_JSON,
+};
+
 enum HWAccelID {
     HWACCEL_NONE = 0,
     HWACCEL_AUTO,
@@ -679,7 +685,9 @@ extern AVIOContext *progress_avio;
 extern float max_error_rate;
 
 extern char *filter_nbthreads;
+extern char *filter_graph_opts;
 extern int filter_complex_nbthreads;
+extern enum FilterStatsFormat filter_stats;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
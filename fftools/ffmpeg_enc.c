@@ -20,6 +20,7 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "thread_queue.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
@@ -67,8 +68,51 @@ struct Encoder {
     uint64_t dup_warning;
 
     int opened;
+
+    pthread_t       thread;
+    /**
+     * Queue for sending frames from the main thread to the encoder thread.
+     */
+    ThreadQueue    *queue_in;
+    /**
+     * Queue for sending encoded packets from the encoder thread to the main
+     * thread, on stream 0.
+     *
+     * An empty packet is sent on stream 1 to signal that a single frame has
+     * been fully processed.
+     */
+    ThreadQueue    *queue_out;
+    // frame for sending to the encoder thread
+    AVFrame        *thread_frame;
+    // number of frames sent to the encoder thread and not fully processed yet
+    int             frames_pending;
 };
 
+// data that is local to the encoder thread and not visible outside of it
+typedef struct EncThreadContext {
+    AVFrame         *frame;
+    AVPacket        *pkt;
+} EncThreadContext;
+
+static int enc_thread_stop(Encoder *e)
+{
+    void *ret;
+
+    if (!e->queue_in)
+        return 0;
+
+    tq_send_finish(e->queue_in, 0);
+    tq_receive_finish(e->queue_out, 0);
+    tq_receive_finish(e->queue_out, 1);
+
+    pthread_join(e->thread, &ret);
+
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+
+    return (intptr_t)ret;
+}
+
 void enc_free(Encoder **penc)
 {
     Encoder *enc = *penc;
@@ -76,6 +120,9 @@ void enc_free(Encoder **penc)
     if (!enc)
         return;
 
+    enc_thread_stop(enc);
+
+    av_frame_free(&enc->thread_frame);
     av_frame_free(&enc->last_frame);
     av_frame_free(&enc->sq_frame);
 
@@ -188,6 +235,192 @@ static void set_encoder_id(OutputFile *of, OutputStream *ost)
                 AV_DICT_DONT_STRDUP_VAL | AV_DICT_DONT_OVERWRITE);
 }
 
+static int enc_send_frame(OutputStream *ost, AVFrame *frame)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int ret;
+
+    if (frame && frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
+        enc->sample_aspect_ratio = frame->sample_aspect_ratio;
+
+    update_benchmark(NULL);
+
+    ret = avcodec_send_frame(enc, frame);
+    if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
+        av_log(ost, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
+               av_get_media_type_string(enc->codec_type));
+        return ret;
+    }
+
+    return 0;
+}
+
+static int enc_receive_packet(OutputStream *ost, AVPacket *pkt, int flush)
+{
+    AVCodecContext   *enc = ost->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+    int ret;
+
+    ret = avcodec_receive_packet(enc, pkt);
+    update_benchmark("%s_%s %d.%d", flush ? "flush" : "encode", type_desc,
+                     ost->file_index, ost->index);
+
+    pkt->time_base = enc->time_base;
+
+    /* if two pass, output log on success and EOF */
+    if ((ret >= 0 || ret == AVERROR_EOF) && ost->logfile && enc->stats_out)
+        fprintf(ost->logfile, "%s", enc->stats_out);
+
+    if (ret == AVERROR(EAGAIN))
+        av_assert0(!flush); // should never happen during flushing
+    else if (ret < 0 && ret != AVERROR_EOF)
+        av_log(ost, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
+
+    return ret;
+}
+
+static void enc_thread_set_name(const OutputStream *ost)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "enc%d:%d:%s", ost->file_index, ost->index,
+             ost->enc_ctx->codec->name);
+    ff_thread_setname(name);
+}
+
+static void enc_thread_uninit(EncThreadContext *et)
+{
+    av_packet_free(&et->pkt);
+    av_frame_free(&et->frame);
+
+    memset(et, 0, sizeof(*et));
+}
+
+static int enc_thread_init(EncThreadContext *et)
+{
+    memset(et, 0, sizeof(*et));
+
+    et->frame = av_frame_alloc();
+    if (!et->frame)
+        goto fail;
+
+    et->pkt = av_packet_alloc();
+    if (!et->pkt)
+        goto fail;
+
+    return 0;
+
+fail:
+    enc_thread_uninit(et);
+    return AVERROR(ENOMEM);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    Encoder        *e = ost->enc;
+    EncThreadContext et;
+    int ret = 0, input_status = 0;
+
+    ret = enc_thread_init(&et);
+    if (ret < 0)
+        goto finish;
+
+    enc_thread_set_name(ost);
+
+    while (!input_status) {
+        int dummy;
+
+        input_status = tq_receive(e->queue_in, &dummy, et.frame);
+        if (input_status < 0)
+            av_log(ost, AV_LOG_VERBOSE, "Encoder thread received EOF\n");
+
+        ret = enc_send_frame(ost, input_status >= 0 ? et.frame : NULL);
+        av_frame_unref(et.frame);
+        if (ret < 0)
+            break;
+
+        do {
+            ret = enc_receive_packet(ost, et.pkt, input_status < 0);
+            if (ret >= 0)
+                ret = tq_send(e->queue_out, 0, et.pkt);
+        } while (ret >= 0);
+        // encoder flushed, error or main thread gone
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        // signal to the main thread that the entire frame was processed
+        ret = tq_send(e->queue_out, 1, et.pkt);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF)
+                av_log(ost, AV_LOG_ERROR, "Error communicating with the main thread\n");
+            break;
+        }
+    }
+
+    // EOF is normal thread termination
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+finish:
+    tq_receive_finish(e->queue_in,  0);
+    tq_send_finish   (e->queue_out, 0);
+    tq_send_finish   (e->queue_out, 1);
+
+    enc_thread_uninit(&et);
+
+    av_log(ost, AV_LOG_VERBOSE, "Terminating encoder thread\n");
+
+    return (void*)(intptr_t)ret;
+}
+
+static int enc_thread_start(OutputStream *ost)
+{
+    Encoder *e = ost->enc;
+    ObjPool *op;
+    int ret = 0;
+
+    e->thread_frame = av_frame_alloc();
+    if (!e->thread_frame)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    e->queue_in = tq_alloc(1, 1, op, frame_move);
+    if (!e->queue_in) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc_packets();
+    if (!op)
+        goto fail;
+
+    e->queue_out = tq_alloc(2, 8, op, pkt_move);
+    if (!e->queue_out) {
+        objpool_free(&op);
+        goto fail;
+    }
+
+    ret = pthread_create(&e->thread, NULL, encoder_thread, ost);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(ost, AV_LOG_ERROR, "pthread_create() failed: %s\n",
+               av_err2str(ret));
+        goto fail;
+    }
+
+    return 0;
+fail:
+    if (ret >= 0)
+        ret = AVERROR(ENOMEM);
+
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+    return ret;
+}
+
 int enc_open(OutputStream *ost, AVFrame *frame)
 {
     InputStream *ist = ost->ist;
@@ -466,6 +699,15 @@ int enc_open(OutputStream *ost, AVFrame *frame)
     if (ret < 0)
         return ret;
 
+    /* encode in a separate thread, unless the time spent encoding is being
+     * measured on the main thread */
+    if ((enc->type == AVMEDIA_TYPE_VIDEO || enc->type == AVMEDIA_TYPE_AUDIO) &&
+        !do_benchmark_all) {
+        ret = enc_thread_start(ost);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -695,13 +937,106 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(pict_type));
 }
 
+static void output_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    Encoder            *e = ost->enc;
+    AVCodecContext   *enc = ost->enc_ctx;
+    int ret;
+
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
+        update_video_stats(ost, pkt, !!vstats_filename);
+    if (ost->enc_stats_post.io)
+        enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
+                        e->packets_encoded);
+
+    if (debug_ts) {
+        av_log(ost, AV_LOG_INFO, "encoder -> type:%s "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
+               "duration:%s duration_time:%s\n",
+               av_get_media_type_string(enc->codec_type),
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+    }
+
+    if ((ret = trigger_fix_sub_duration_heartbeat(ost, pkt)) < 0) {
+        av_log(NULL, AV_LOG_ERROR,
+               "Subtitle heartbeat logic failed in %s! (%s)\n",
+               __func__, av_err2str(ret));
+        exit_program(1);
+    }
+
+    e->data_size += pkt->size;
+
+    e->packets_encoded++;
+
+    of_output_packet(of, ost, pkt);
+}
+
+/**
+ * Send a frame to the encoder thread, then output the packets for the
+ * previous frame, so that this frame is encoded while the caller prepares the
+ * next one. When flushing, output all the remaining packets.
+ */
+static int enc_thread_encode(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    Encoder *e = ost->enc;
+    int ret, thread_ret;
+
+    if (frame) {
+        ret = av_frame_ref(e->thread_frame, frame);
+        if (ret < 0)
+            return ret;
+
+        ret = tq_send(e->queue_in, 0, e->thread_frame);
+        if (ret < 0) {
+            av_frame_unref(e->thread_frame);
+            goto finish;
+        }
+        e->frames_pending++;
+    } else
+        tq_send_finish(e->queue_in, 0);
+
+    while (!frame || e->frames_pending > 1) {
+        int stream_idx;
+
+        ret = tq_receive(e->queue_out, &stream_idx, e->pkt);
+        if (ret == AVERROR_EOF && stream_idx >= 0)
+            continue;
+        else if (ret < 0)
+            goto finish;
+
+        // frame fully processed
+        if (stream_idx == 1) {
+            e->frames_pending--;
+            continue;
+        }
+
+        output_packet(of, ost, e->pkt);
+    }
+
+    return 0;
+
+finish:
+    thread_ret = enc_thread_stop(e);
+    if (thread_ret < 0) {
+        av_log(ost, AV_LOG_ERROR, "Encoder thread returned error: %s\n",
+               av_err2str(thread_ret));
+        return thread_ret;
+    }
+    if (ret != AVERROR_EOF)
+        return ret;
+
+    // the encoder was flushed
+    of_output_packet(of, ost, NULL);
+    return AVERROR_EOF;
+}
+
 static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
 {
     Encoder            *e = ost->enc;
     AVCodecContext   *enc = ost->enc_ctx;
     AVPacket         *pkt = e->pkt;
-    const char *type_desc = av_get_media_type_string(enc->codec_type);
-    const char    *action = frame ? "encode" : "flush";
     int ret;
 
     if (frame) {
@@ -715,77 +1050,32 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
         if (debug_ts) {
             av_log(ost, AV_LOG_INFO, "encoder <- type:%s "
                    "frame_pts:%s frame_pts_time:%s time_base:%d/%d\n",
-                   type_desc,
+                   av_get_media_type_string(enc->codec_type),
                    av_ts2str(frame->pts), av_ts2timestr(frame->pts, &enc->time_base),
                    enc->time_base.num, enc->time_base.den);
         }
-
-        if (frame->sample_aspect_ratio.num && !ost->frame_aspect_ratio.num)
-            enc->sample_aspect_ratio = frame->sample_aspect_ratio;
     }
 
-    update_benchmark(NULL);
+    if (e->queue_in)
+        return enc_thread_encode(of, ost, frame);
 
-    ret = avcodec_send_frame(enc, frame);
-    if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
-        av_log(ost, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
-               type_desc);
+    ret = enc_send_frame(ost, frame);
+    if (ret < 0)
         return ret;
-    }
 
     while (1) {
-        ret = avcodec_receive_packet(enc, pkt);
-        update_benchmark("%s_%s %d.%d", action, type_desc,
-                         ost->file_index, ost->index);
-
-        pkt->time_base = enc->time_base;
-
-        /* if two pass, output log on success and EOF */
-        if ((ret >= 0 || ret == AVERROR_EOF) && ost->logfile && enc->stats_out)
-            fprintf(ost->logfile, "%s", enc->stats_out);
-
+        ret = enc_receive_packet(ost, pkt, !frame);
         if (ret == AVERROR(EAGAIN)) {
-            av_assert0(frame); // should never happen during flushing
             return 0;
         } else if (ret == AVERROR_EOF) {
             of_output_packet(of, ost, NULL);
             return ret;
         } else if (ret < 0) {
-            av_log(ost, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
             return ret;
         }
 
-        if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
-            update_video_stats(ost, pkt, !!vstats_filename);
-        if (ost->enc_stats_post.io)
-            enc_stats_write(ost, &ost->enc_stats_post, NULL, pkt,
-                            e->packets_encoded);
-
-        if (debug_ts) {
-            av_log(ost, AV_LOG_INFO, "encoder -> type:%s "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
-                   "duration:%s duration_time:%s\n",
-                   type_desc,
-                   av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
-                   av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
-                   av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
-        }
-
-        if ((ret = trigger_fix_sub_duration_heartbeat(ost, pkt)) < 0) {
-            av_log(NULL, AV_LOG_ERROR,
-                   "Subtitle heartbeat logic failed in %s! (%s)\n",
-                   __func__, av_err2str(ret));
-            exit_program(1);
-        }
-
-        e->data_size += pkt->size;
-
-        e->packets_encoded++;
-
-        of_output_packet(of, ost, pkt);
+        output_packet(of, ost, pkt);
     }
-
-    av_assert0(0);
 }
 
 static int submit_encode_frame(OutputFile *of, OutputStream *ost,
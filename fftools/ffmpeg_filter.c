@@ -635,6 +635,141 @@ static InputFilter *ifilter_alloc(FilterGraph *fg)
     return ifilter;
 }
 
+static void bprint_json_string(AVBPrint *bp, const char *str)
+{
+    av_bprint_chars(bp, '"', 1);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            av_bprintf(bp, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            av_bprintf(bp, "\\u%04x", *str);
+        else
+            av_bprint_chars(bp, *str, 1);
+    }
+    av_bprint_chars(bp, '"', 1);
+}
+
+static void link_name(char *buf, size_t size, const AVFilterLink *link)
+{
+    snprintf(buf, size, "%s:%s -> %s:%s",
+             link->src->name, avfilter_pad_get_name(link->srcpad, 0),
+             link->dst->name, avfilter_pad_get_name(link->dstpad, 0));
+}
+
+static void print_filter_stats(const FilterGraph *fg)
+{
+    AVFilterGraph *graph = fg->graph;
+    const AVFilterStats *gst;
+    const double MiB = 1024 * 1024;
+    char name[256];
+    int width = 6;
+    AVBPrint bp;
+
+    if (filter_stats == FILTER_STATS_NONE || !graph)
+        return;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    gst = avfilter_graph_get_stats(graph);
+
+    if (filter_stats == FILTER_STATS_JSON) {
+        const char *sep = "";
+
+        av_bprintf(&bp, "{\"graph\": %d, \"max_queued_frames\": %"PRIu64", "
+                   "\"max_queued_bytes\": %"PRIu64", \"filters\": [",
+                   fg->index, gst->max_queued_frames, gst->max_queued_bytes);
+        for (unsigned i = 0; i < graph->nb_filters; i++) {
+            const AVFilterContext *f = graph->filters[i];
+            const AVFilterStats *st = avfilter_get_stats(f);
+
+            av_bprintf(&bp, "%s\n  {\"name\": ", i ? "," : "");
+            bprint_json_string(&bp, f->name);
+            av_bprintf(&bp, ", \"filter\": \"%s\", \"activations\": %"PRIu64", "
+                       "\"time_ns\": %"PRId64", \"cpu_time_ns\": %"PRId64", "
+                       "\"frames_in\": %"PRIu64", \"frames_out\": %"PRIu64", "
+                       "\"bytes_in\": %"PRIu64", \"bytes_out\": %"PRIu64"}",
+                       f->filter->name, st->nb_activations, st->time, st->cpu_time,
+                       st->frames_in, st->frames_out, st->bytes_in, st->bytes_out);
+        }
+        av_bprintf(&bp, "\n], \"links\": [");
+        for (unsigned i = 0; i < graph->nb_filters; i++) {
+            const AVFilterContext *f = graph->filters[i];
+
+            for (unsigned j = 0; j < f->nb_outputs; j++) {
+                const AVFilterLink *link = f->outputs[j];
+                const AVFilterStats *st;
+
+                if (!link)
+                    continue;
+                st = avfilter_link_get_stats(link);
+                av_bprintf(&bp, "%s\n  {\"src\": ", sep);
+                bprint_json_string(&bp, link->src->name);
+                av_bprintf(&bp, ", \"srcpad\": ");
+                bprint_json_string(&bp, avfilter_pad_get_name(link->srcpad, 0));
+                av_bprintf(&bp, ", \"dst\": ");
+                bprint_json_string(&bp, link->dst->name);
+                av_bprintf(&bp, ", \"dstpad\": ");
+                bprint_json_string(&bp, avfilter_pad_get_name(link->dstpad, 0));
+                av_bprintf(&bp, ", \"frames_in\": %"PRIu64", \"frames_out\": %"PRIu64", "
+                           "\"bytes_in\": %"PRIu64", \"bytes_out\": %"PRIu64", "
+                           "\"max_queued_frames\": %"PRIu64", \"max_queued_bytes\": %"PRIu64"}",
+                           st->frames_in, st->frames_out, st->bytes_in, st->bytes_out,
+                           st->max_queued_frames, st->max_queued_bytes);
+                sep = ",";
+            }
+        }
+        av_bprintf(&bp, "\n]}\n");
+    } else {
+        for (unsigned i = 0; i < graph->nb_filters; i++) {
+            const AVFilterContext *f = graph->filters[i];
+
+            width = FFMAX(width, (int)strlen(f->name));
+            for (unsigned j = 0; j < f->nb_outputs; j++) {
+                if (!f->outputs[j])
+                    continue;
+                link_name(name, sizeof(name), f->outputs[j]);
+                width = FFMAX(width, (int)strlen(name));
+            }
+        }
+
+        av_bprintf(&bp, "Filtergraph #%d statistics:\n", fg->index);
+        av_bprintf(&bp, "  %-*s %11s %11s %11s %10s %10s %9s %9s\n", width, "filter",
+                   "activations", "time (ms)", "cpu (ms)", "frames in", "frames out",
+                   "MiB in", "MiB out");
+        for (unsigned i = 0; i < graph->nb_filters; i++) {
+            const AVFilterContext *f = graph->filters[i];
+            const AVFilterStats *st = avfilter_get_stats(f);
+
+            av_bprintf(&bp, "  %-*s %11"PRIu64" %11.3f %11.3f %10"PRIu64" %10"PRIu64" %9.1f %9.1f\n",
+                       width, f->name, st->nb_activations, st->time / 1e6, st->cpu_time / 1e6,
+                       st->frames_in, st->frames_out, st->bytes_in / MiB, st->bytes_out / MiB);
+        }
+
+        av_bprintf(&bp, "  %-*s %10s %10s %9s %11s %9s\n", width, "link",
+                   "frames in", "frames out", "MiB in", "peak queue", "peak MiB");
+        for (unsigned i = 0; i < graph->nb_filters; i++) {
+            const AVFilterContext *f = graph->filters[i];
+
+            for (unsigned j = 0; j < f->nb_outputs; j++) {
+                const AVFilterStats *st;
+
+                if (!f->outputs[j])
+                    continue;
+                st = avfilter_link_get_stats(f->outputs[j]);
+                link_name(name, sizeof(name), f->outputs[j]);
+                av_bprintf(&bp, "  %-*s %10"PRIu64" %10"PRIu64" %9.1f %11"PRIu64" %9.1f\n",
+                           width, name, st->frames_in, st->frames_out, st->bytes_in / MiB,
+                           st->max_queued_frames, st->max_queued_bytes / MiB);
+            }
+        }
+        av_bprintf(&bp, "  peak queued in the graph: %"PRIu64" frames, %.1f MiB\n",
+                   gst->max_queued_frames, gst->max_queued_bytes / MiB);
+    }
+
+    if (av_bprint_is_complete(&bp))
+        av_log(NULL, AV_LOG_INFO, "%s", bp.str);
+    av_bprint_finalize(&bp, NULL);
+}
+
 void fg_free(FilterGraph **pfg)
 {
     FilterGraph *fg = *pfg;
@@ -644,6 +779,7 @@ void fg_free(FilterGraph **pfg)
         return;
     fgp = fgp_from_fg(fg);
 
+    print_filter_stats(fg);
     avfilter_graph_free(&fg->graph);
     for (int j = 0; j < fg->nb_inputs; j++) {
         InputFilter *ifilter = fg->inputs[j];
@@ -1378,6 +1514,7 @@ static void cleanup_filtergraph(FilterGraph *fg)
         ofp_from_ofilter(fg->outputs[i])->filter = NULL;
     for (i = 0; i < fg->nb_inputs; i++)
         ifp_from_ifilter(fg->inputs[i])->filter = NULL;
+    print_filter_stats(fg);
     avfilter_graph_free(&fg->graph);
 }
 
@@ -1416,6 +1553,7 @@ static int configure_filtergraph(FilterGraph *fg)
     cleanup_filtergraph(fg);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->stats = filter_stats != FILTER_STATS_NONE;
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -1451,6 +1589,15 @@ static int configure_filtergraph(FilterGraph *fg)
         fg->graph->nb_threads = filter_complex_nbthreads;
     }
 
+    if (filter_graph_opts) {
+        ret = av_set_options_string(fg->graph, filter_graph_opts, "=", ":");
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Invalid filtergraph options '%s'\n",
+                   filter_graph_opts);
+            goto fail;
+        }
+    }
+
     hw_device = hw_device_for_filter();
 
     if ((ret = graph_parse(fg->graph, graph_desc, &inputs, &outputs, hw_device)) < 0)
@@ -83,7 +83,9 @@ int print_stats       = -1;
 int stdin_interaction = 1;
 float max_error_rate  = 2.0/3;
 char *filter_nbthreads;
+char *filter_graph_opts;
 int filter_complex_nbthreads = 0;
+enum FilterStatsFormat filter_stats = FILTER_STATS_NONE;
 int vstats_version = 2;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
@@ -297,6 +299,27 @@ static int opt_filter_threads(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_filter_graph_opts(void *optctx, const char *opt, const char *arg)
+{
+    av_free(filter_graph_opts);
+    filter_graph_opts = av_strdup(arg);
+    return filter_graph_opts ? 0 : AVERROR(ENOMEM);
+}
+
+static int opt_filter_stats(void *optctx, const char *opt, const char *arg)
+{
+    if (!strcmp(arg, "table"))
+        filter_stats = FILTER_STATS_TABLE;
+    else if (!strcmp(arg, "json"))
+        filter_stats = FILTER_STATS_JSON;
+    else {
+        av_log(NULL, AV_LOG_FATAL, "Invalid filter statistics format '%s', "
+               "expected 'table' or 'json'\n", arg);
+        return AVERROR(EINVAL);
+    }
+    return 0;
+}
+
 static int opt_abort_on(void *optctx, const char *opt, const char *arg)
 {
     static const AVOption opts[] = {
@@ -1453,6 +1476,8 @@ const OptionDef options[] = {
         "add timings for benchmarking" },
     { "benchmark_all",  OPT_BOOL | OPT_EXPERT,                       { &do_benchmark_all },
       "add timings for each task" },
+    { "filter_stats",   HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_stats },
+      "print statistics about each filter when the filtergraphs are freed", "table|json" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
@@ -1532,6 +1557,8 @@ const OptionDef options[] = {
         "set stream filtergraph", "filter_graph" },
     { "filter_threads", HAS_ARG,                                     { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "filter_graph_opts", HAS_ARG | OPT_EXPERT,                     { .func_arg = opt_filter_graph_opts },
+        "set options of all the filtergraphs", "options" },
     { "filter_script",  HAS_ARG | OPT_STRING | OPT_SPEC | OPT_OUTPUT, { .off = OFFSET(filter_scripts) },
         "read stream filtergraph description from a file", "filename" },
     { "reinit_filter",  HAS_ARG | OPT_INT | OPT_SPEC | OPT_INPUT,    { .off = OFFSET(reinit_filters) },
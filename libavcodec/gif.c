@@ -30,6 +30,7 @@
  * @see http://www.w3.org/Graphics/GIF/spec-gif89a.txt
  */
 
+#include "libavutil/imgutils_internal.h"
 #include "libavutil/opt.h"
 #include "avcodec.h"
 #include "bytestream.h"
@@ -40,20 +41,56 @@
 
 #define DEFAULT_TRANSPARENCY_INDEX 0x1f
 
-typedef struct GIFContext {
-    const AVClass *class;
+/**
+ * Per-thread LZW coding state and scratch buffers.
+ */
+typedef struct GIFWorker {
     LZWState *lzw;
     uint8_t *buf;
-    uint8_t *shrunk_buf;
     int buf_size;
+    uint8_t *shrunk_buf;                ///< palette-remapped image rectangle
+    uint8_t *tmpl;                      ///< temporary line buffer
+} GIFWorker;
+
+/**
+ * A frame whose headers have been written and whose image data is waiting
+ * to be (or has been) LZW coded.
+ */
+typedef struct GIFJob {
+    AVFrame *frame;
+    AVFrame *ref;                       ///< previous frame, used for transparency diffing
+    uint8_t *outbuf;
+    int outbuf_size;
+    int size;                           ///< bytes written to outbuf so far
+    int x_start, y_start;
+    int width, height;
+    int trans;
+    int honor_transparency;
+    int remap;                          ///< whether the image must be remapped through map
+    uint8_t map[AVPALETTE_COUNT];
+    int key;
+} GIFJob;
+
+typedef struct GIFContext {
+    const AVClass *class;
+    GIFWorker *workers;
+    int nb_workers;
+    /**
+     * Ring of nb_workers jobs starting at job_head. The first nb_coded
+     * jobs are ready for output, the others still need LZW coding.
+     */
+    GIFJob *jobs;
+    int job_head;
+    int nb_jobs;
+    int nb_coded;
     AVFrame *last_frame;
+    uint8_t *trans_line;                ///< line of transparent pixels to crop against
     int flags;
     int image;
     int use_global_palette;
     uint32_t palette[AVPALETTE_COUNT];  ///< local reference palette for !pal8
     int palette_loaded;
     int transparent_index;
-    uint8_t *tmpl;                      ///< temporary line buffer
 } GIFContext;
 
 enum {
@@ -158,70 +195,11 @@ static void gif_crop_translucent(AVCodecContext *avctx,
 
     /* Crop image */
     if ((s->flags & GF_OFFSETTING) && trans >= 0) {
-        const int w = avctx->width;
-        const int h = avctx->height;
-        int x_end = w - 1,
-            y_end = h - 1;
-
-        // crop top
-        while (*y_start < y_end) {
-            int is_trans = 1;
-            for (int i = 0; i < w; i++) {
-                if (buf[linesize * *y_start + i] != trans) {
-                    is_trans = 0;
-                    break;
-                }
-            }
-
-            if (!is_trans)
-                break;
-            (*y_start)++;
-        }
-
-        // crop bottom
-        while (y_end > *y_start) {
-            int is_trans = 1;
-            for (int i = 0; i < w; i++) {
-                if (buf[linesize * y_end + i] != trans) {
-                    is_trans = 0;
-                    break;
-                }
-            }
-            if (!is_trans)
-                break;
-            y_end--;
-        }
-
-        // crop left
-        while (*x_start < x_end) {
-            int is_trans = 1;
-            for (int i = *y_start; i < y_end; i++) {
-                if (buf[linesize * i + *x_start] != trans) {
-                    is_trans = 0;
-                    break;
-                }
-            }
-            if (!is_trans)
-                break;
-            (*x_start)++;
-        }
-
-        // crop right
-        while (x_end > *x_start) {
-            int is_trans = 1;
-            for (int i = *y_start; i < y_end; i++) {
-                if (buf[linesize * i + x_end] != trans) {
-                    is_trans = 0;
-                    break;
-                }
-            }
-            if (!is_trans)
-                break;
-            x_end--;
-        }
-
-        *height = y_end + 1 - *y_start;
-        *width  = x_end + 1 - *x_start;
+        /* crop to the pixels differing from a fully transparent line */
+        memset(s->trans_line, trans, avctx->width);
+        avpriv_image_diff_rect(buf, linesize, s->trans_line, 0, 1,
+                               avctx->width, avctx->height,
+                               x_start, y_start, width, height);
         av_log(avctx, AV_LOG_DEBUG,"%dx%d image at pos (%d;%d) [area:%dx%d]\n",
                *width, *height, *x_start, *y_start, avctx->width, avctx->height);
     }
@@ -236,71 +214,28 @@ static void gif_crop_opaque(AVCodecContext *avctx,
 
     /* Crop image */
     if ((s->flags & GF_OFFSETTING) && s->last_frame && !palette) {
-        const uint8_t *ref = s->last_frame->data[0];
-        const int ref_linesize = s->last_frame->linesize[0];
-        int x_end = avctx->width  - 1,
-            y_end = avctx->height - 1;
-
-        /* skip common lines */
-        while (*y_start < y_end) {
-            if (memcmp(ref + *y_start*ref_linesize, buf + *y_start*linesize, *width))
-                break;
-            (*y_start)++;
-        }
-        while (y_end > *y_start) {
-            if (memcmp(ref + y_end*ref_linesize, buf + y_end*linesize, *width))
-                break;
-            y_end--;
-        }
-        *height = y_end + 1 - *y_start;
-
-        /* skip common columns */
-        while (*x_start < x_end) {
-            int same_column = 1;
-            for (int y = *y_start; y <= y_end; y++) {
-                if (ref[y*ref_linesize + *x_start] != buf[y*linesize + *x_start]) {
-                    same_column = 0;
-                    break;
-                }
-            }
-            if (!same_column)
-                break;
-            (*x_start)++;
-        }
-        while (x_end > *x_start) {
-            int same_column = 1;
-            for (int y = *y_start; y <= y_end; y++) {
-                if (ref[y*ref_linesize + x_end] != buf[y*linesize + x_end]) {
-                    same_column = 0;
-                    break;
-                }
-            }
-            if (!same_column)
-                break;
-            x_end--;
-        }
-        *width = x_end + 1 - *x_start;
-
+        avpriv_image_diff_rect(s->last_frame->data[0], s->last_frame->linesize[0],
+                               buf, linesize, 1, avctx->width, avctx->height,
+                               x_start, y_start, width, height);
         av_log(avctx, AV_LOG_DEBUG,"%dx%d image at pos (%d;%d) [area:%dx%d]\n",
                *width, *height, *x_start, *y_start, avctx->width, avctx->height);
     }
 }
 
-static int gif_image_write_image(AVCodecContext *avctx,
-                                 uint8_t **bytestream, uint8_t *end,
-                                 const uint32_t *palette,
-                                 const uint8_t *buf, const int linesize,
-                                 AVPacket *pkt)
+static void gif_image_write_header(AVCodecContext *avctx, GIFJob *job,
+                                   const uint32_t *palette,
+                                   const uint8_t *buf, const int linesize)
 {
     GIFContext *s = avctx->priv_data;
-    int disposal, len = 0, height = avctx->height, width = avctx->width, x, y;
+    uint8_t *bytestream = job->outbuf;
+    int disposal, height = avctx->height, width = avctx->width;
     int x_start = 0, y_start = 0, trans = s->transparent_index;
     int bcid = -1, honor_transparency = (s->flags & GF_TRANSDIFF) && s->last_frame && !palette;
-    const uint8_t *ptr;
     uint32_t shrunk_palette[AVPALETTE_COUNT];
-    uint8_t map[AVPALETTE_COUNT] = { 0 };
     size_t shrunk_palette_count = 0;
 
+    memset(job->map, 0, sizeof(job->map));
+
     /*
      * We memset to 0xff instead of 0x00 so that the transparency detection
      * doesn't pick anything after the palette entries as the transparency
@@ -329,19 +264,19 @@ static int gif_image_write_image(AVCodecContext *avctx,
                 aspect = 0;
         }
 
-        bytestream_put_buffer(bytestream, gif89a_sig, sizeof(gif89a_sig));
-        bytestream_put_le16(bytestream, avctx->width);
-        bytestream_put_le16(bytestream, avctx->height);
+        bytestream_put_buffer(&bytestream, gif89a_sig, sizeof(gif89a_sig));
+        bytestream_put_le16(&bytestream, avctx->width);
+        bytestream_put_le16(&bytestream, avctx->height);
 
         bcid = get_palette_transparency_index(global_palette);
 
-        bytestream_put_byte(bytestream, ((uint8_t) s->use_global_palette << 7) | 0x70 | (s->use_global_palette ? 7 : 0)); /* flags: global clut, 256 entries */
-        bytestream_put_byte(bytestream, bcid < 0 ? DEFAULT_TRANSPARENCY_INDEX : bcid); /* background color index */
-        bytestream_put_byte(bytestream, aspect);
+        bytestream_put_byte(&bytestream, ((uint8_t) s->use_global_palette << 7) | 0x70 | (s->use_global_palette ? 7 : 0)); /* flags: global clut, 256 entries */
+        bytestream_put_byte(&bytestream, bcid < 0 ? DEFAULT_TRANSPARENCY_INDEX : bcid); /* background color index */
+        bytestream_put_byte(&bytestream, aspect);
         if (s->use_global_palette) {
             for (int i = 0; i < 256; i++) {
                 const uint32_t v = global_palette[i] & 0xffffff;
-                bytestream_put_be24(bytestream, v);
+                bytestream_put_be24(&bytestream, v);
             }
         }
     }
@@ -358,96 +293,125 @@ static int gif_image_write_image(AVCodecContext *avctx,
 
     if (palette || !s->use_global_palette) {
         const uint32_t *pal = palette ? palette : s->palette;
-        shrink_palette(pal, map, shrunk_palette, &shrunk_palette_count);
+        shrink_palette(pal, job->map, shrunk_palette, &shrunk_palette_count);
     }
 
     bcid = honor_transparency || disposal == GCE_DISPOSAL_BACKGROUND ? trans : get_palette_transparency_index(palette);
 
     /* graphic control extension */
-    bytestream_put_byte(bytestream, GIF_EXTENSION_INTRODUCER);
-    bytestream_put_byte(bytestream, GIF_GCE_EXT_LABEL);
-    bytestream_put_byte(bytestream, 0x04); /* block size */
-    bytestream_put_byte(bytestream, disposal<<2 | (bcid >= 0));
-    bytestream_put_le16(bytestream, 5); // default delay
-    bytestream_put_byte(bytestream, bcid < 0 ? DEFAULT_TRANSPARENCY_INDEX : (shrunk_palette_count ? map[bcid] : bcid));
-    bytestream_put_byte(bytestream, 0x00);
+    bytestream_put_byte(&bytestream, GIF_EXTENSION_INTRODUCER);
+    bytestream_put_byte(&bytestream, GIF_GCE_EXT_LABEL);
+    bytestream_put_byte(&bytestream, 0x04); /* block size */
+    bytestream_put_byte(&bytestream, disposal<<2 | (bcid >= 0));
+    bytestream_put_le16(&bytestream, 5); // default delay
+    bytestream_put_byte(&bytestream, bcid < 0 ? DEFAULT_TRANSPARENCY_INDEX : (shrunk_palette_count ? job->map[bcid] : bcid));
+    bytestream_put_byte(&bytestream, 0x00);
 
     /* image block */
-    bytestream_put_byte(bytestream, GIF_IMAGE_SEPARATOR);
-    bytestream_put_le16(bytestream, x_start);
-    bytestream_put_le16(bytestream, y_start);
-    bytestream_put_le16(bytestream, width);
-    bytestream_put_le16(bytestream, height);
+    bytestream_put_byte(&bytestream, GIF_IMAGE_SEPARATOR);
+    bytestream_put_le16(&bytestream, x_start);
+    bytestream_put_le16(&bytestream, y_start);
+    bytestream_put_le16(&bytestream, width);
+    bytestream_put_le16(&bytestream, height);
 
     if (palette || !s->use_global_palette) {
         unsigned pow2_count = av_log2(shrunk_palette_count - 1);
         unsigned i;
 
-        bytestream_put_byte(bytestream, 1<<7 | pow2_count); /* flags */
+        bytestream_put_byte(&bytestream, 1<<7 | pow2_count); /* flags */
         for (i = 0; i < 1 << (pow2_count + 1); i++) {
             const uint32_t v = shrunk_palette[i];
-            bytestream_put_be24(bytestream, v);
+            bytestream_put_be24(&bytestream, v);
         }
     } else {
-        bytestream_put_byte(bytestream, 0x00); /* flags */
+        bytestream_put_byte(&bytestream, 0x00); /* flags */
     }
 
-    bytestream_put_byte(bytestream, 0x08);
+    bytestream_put_byte(&bytestream, 0x08);
+
+    job->size               = bytestream - job->outbuf;
+    job->x_start            = x_start;
+    job->y_start            = y_start;
+    job->width              = width;
+    job->height             = height;
+    job->trans              = trans;
+    job->honor_transparency = honor_transparency;
+    job->remap              = shrunk_palette_count != 0;
+    job->key                = s->image || !avctx->frame_num;
+}
 
-    ff_lzw_encode_init(s->lzw, s->buf, s->buf_size,
+/**
+ * LZW code the image data of a job and append it to the job's output.
+ * This only depends on the job and the worker, so different jobs can be
+ * coded concurrently.
+ */
+static void gif_image_write_lzw(GIFWorker *w, GIFJob *job)
+{
+    uint8_t *bytestream = job->outbuf + job->size;
+    const uint8_t *end  = job->outbuf + job->outbuf_size;
+    const int width = job->width, height = job->height;
+    int linesize = job->frame->linesize[0];
+    const uint8_t *ptr = job->frame->data[0] + job->y_start*linesize + job->x_start;
+    int len = 0, x, y;
+
+    ff_lzw_encode_init(w->lzw, w->buf, w->buf_size,
                        12, FF_LZW_GIF, 1);
 
-    if (shrunk_palette_count) {
-        if (!s->shrunk_buf) {
-            s->shrunk_buf = av_malloc(avctx->height * linesize);
-            if (!s->shrunk_buf) {
-                av_log(avctx, AV_LOG_ERROR, "Could not allocated remapped frame buffer.\n");
-                return AVERROR(ENOMEM);
-            }
-        }
-        remap_frame_to_palette(buf, linesize, s->shrunk_buf, linesize, avctx->width, avctx->height, map);
-        ptr = s->shrunk_buf + y_start*linesize + x_start;
-    } else {
-        ptr = buf + y_start*linesize + x_start;
+    if (job->remap) {
+        remap_frame_to_palette(ptr, linesize, w->shrunk_buf, width,
+                               width, height, job->map);
+        ptr      = w->shrunk_buf;
+        linesize = width;
     }
-    if (honor_transparency) {
-        const int ref_linesize = s->last_frame->linesize[0];
-        const uint8_t *ref = s->last_frame->data[0] + y_start*ref_linesize + x_start;
+    if (job->honor_transparency) {
+        const int ref_linesize = job->ref->linesize[0];
+        const uint8_t *ref = job->ref->data[0] + job->y_start*ref_linesize + job->x_start;
 
         for (y = 0; y < height; y++) {
-            memcpy(s->tmpl, ptr, width);
+            memcpy(w->tmpl, ptr, width);
             for (x = 0; x < width; x++)
                 if (ref[x] == ptr[x])
-                    s->tmpl[x] = trans;
-            len += ff_lzw_encode(s->lzw, s->tmpl, width);
+                    w->tmpl[x] = job->trans;
+            len += ff_lzw_encode(w->lzw, w->tmpl, width);
             ptr += linesize;
             ref += ref_linesize;
         }
     } else {
         for (y = 0; y < height; y++) {
-            len += ff_lzw_encode(s->lzw, ptr, width);
+            len += ff_lzw_encode(w->lzw, ptr, width);
             ptr += linesize;
         }
     }
-    len += ff_lzw_encode_flush(s->lzw);
+    len += ff_lzw_encode_flush(w->lzw);
 
-    ptr = s->buf;
+    ptr = w->buf;
     while (len > 0) {
         int size = FFMIN(255, len);
-        bytestream_put_byte(bytestream, size);
-        if (end - *bytestream < size)
-            return -1;
-        bytestream_put_buffer(bytestream, ptr, size);
+        bytestream_put_byte(&bytestream, size);
+        if (end - bytestream < size)
+            goto end;
+        bytestream_put_buffer(&bytestream, ptr, size);
         ptr += size;
         len -= size;
     }
-    bytestream_put_byte(bytestream, 0x00); /* end of image block */
+    bytestream_put_byte(&bytestream, 0x00); /* end of image block */
+end:
+    job->size = bytestream - job->outbuf;
+}
+
+static int gif_encode_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    GIFContext *s = avctx->priv_data;
+    GIFJob *job = &s->jobs[(s->job_head + s->nb_coded + jobnr) % s->nb_workers];
+
+    gif_image_write_lzw(&s->workers[threadnr], job);
     return 0;
 }
 
 static av_cold int gif_encode_init(AVCodecContext *avctx)
 {
     GIFContext *s = avctx->priv_data;
+    int nb_workers;
 
     if (avctx->width > 65535 || avctx->height > 65535) {
         av_log(avctx, AV_LOG_ERROR, "GIF does not support resolutions above 65535x65535\n");
@@ -456,13 +420,39 @@ static av_cold int gif_encode_init(AVCodecContext *avctx)
 
     s->transparent_index = -1;
 
-    s->lzw = av_mallocz(ff_lzw_encode_state_size);
-    s->buf_size = avctx->width*avctx->height*2 + 1000;
-    s->buf = av_malloc(s->buf_size);
-    s->tmpl = av_malloc(avctx->width);
-    if (!s->tmpl || !s->buf || !s->lzw)
+    /* With slice threading, whole frames are LZW coded in parallel, so up to
+     * thread_count frames are delayed. */
+    nb_workers = avctx->active_thread_type & FF_THREAD_SLICE ? avctx->thread_count : 1;
+    s->workers = av_calloc(nb_workers, sizeof(*s->workers));
+    s->jobs    = av_calloc(nb_workers, sizeof(*s->jobs));
+    if (!s->workers || !s->jobs)
+        return AVERROR(ENOMEM);
+    s->nb_workers = nb_workers;
+
+    s->trans_line = av_malloc(avctx->width);
+    if (!s->trans_line)
         return AVERROR(ENOMEM);
 
+    for (int i = 0; i < nb_workers; i++) {
+        GIFWorker *w = &s->workers[i];
+        GIFJob  *job = &s->jobs[i];
+
+        w->lzw        = av_mallocz(ff_lzw_encode_state_size);
+        w->buf_size   = avctx->width*avctx->height*2 + 1000;
+        w->buf        = av_malloc(w->buf_size);
+        w->shrunk_buf = av_malloc(avctx->width*avctx->height);
+        w->tmpl       = av_malloc(avctx->width);
+        if (!w->lzw || !w->buf || !w->shrunk_buf || !w->tmpl)
+            return AVERROR(ENOMEM);
+
+        job->frame       = av_frame_alloc();
+        job->ref         = av_frame_alloc();
+        job->outbuf_size = avctx->width*avctx->height*7/5 + AV_INPUT_BUFFER_MIN_SIZE;
+        job->outbuf      = av_malloc(job->outbuf_size);
+        if (!job->frame || !job->ref || !job->outbuf)
+            return AVERROR(ENOMEM);
+    }
+
     if (avpriv_set_systematic_pal2(s->palette, avctx->pix_fmt) < 0)
         av_assert0(avctx->pix_fmt == AV_PIX_FMT_PAL8);
 
@@ -473,45 +463,82 @@ static int gif_encode_frame(AVCodecContext *avctx, AVPacket *pkt,
                             const AVFrame *pict, int *got_packet)
 {
     GIFContext *s = avctx->priv_data;
-    uint8_t *outbuf_ptr, *end;
-    const uint32_t *palette = NULL;
+    GIFJob *job;
     int ret;
 
-    if ((ret = ff_alloc_packet(avctx, pkt, avctx->width*avctx->height*7/5 + AV_INPUT_BUFFER_MIN_SIZE)) < 0)
-        return ret;
-    outbuf_ptr = pkt->data;
-    end        = pkt->data + pkt->size;
-
-    if (avctx->pix_fmt == AV_PIX_FMT_PAL8) {
-        palette = (uint32_t*)pict->data[1];
-
-        if (!s->palette_loaded) {
-            memcpy(s->palette, palette, AVPALETTE_SIZE);
-            s->transparent_index = get_palette_transparency_index(palette);
-            s->palette_loaded = 1;
-        } else if (!memcmp(s->palette, palette, AVPALETTE_SIZE)) {
-            palette = NULL;
+    if (pict) {
+        const uint32_t *palette = NULL;
+
+        job = &s->jobs[(s->job_head + s->nb_jobs) % s->nb_workers];
+
+        if (avctx->pix_fmt == AV_PIX_FMT_PAL8) {
+            palette = (uint32_t*)pict->data[1];
+
+            if (!s->palette_loaded) {
+                memcpy(s->palette, palette, AVPALETTE_SIZE);
+                s->transparent_index = get_palette_transparency_index(palette);
+                s->palette_loaded = 1;
+            } else if (!memcmp(s->palette, palette, AVPALETTE_SIZE)) {
+                palette = NULL;
+            }
         }
-    }
 
-    gif_image_write_image(avctx, &outbuf_ptr, end, palette,
-                          pict->data[0], pict->linesize[0], pkt);
-    if (!s->last_frame && !s->image) {
-        s->last_frame = av_frame_alloc();
-        if (!s->last_frame)
-            return AVERROR(ENOMEM);
-    }
+        gif_image_write_header(avctx, job, palette,
+                               pict->data[0], pict->linesize[0]);
 
-    if (!s->image) {
-        av_frame_unref(s->last_frame);
-        ret = av_frame_ref(s->last_frame, pict);
+        ret = av_frame_ref(job->frame, pict);
         if (ret < 0)
             return ret;
+        if (job->honor_transparency) {
+            ret = av_frame_ref(job->ref, s->last_frame);
+            if (ret < 0)
+                return ret;
+        }
+        s->nb_jobs++;
+
+        if (!s->last_frame && !s->image) {
+            s->last_frame = av_frame_alloc();
+            if (!s->last_frame)
+                return AVERROR(ENOMEM);
+        }
+
+        if (!s->image) {
+            av_frame_unref(s->last_frame);
+            ret = av_frame_ref(s->last_frame, pict);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    /* Code a whole batch of frames at once, or whatever is left when flushing. */
+    if (s->nb_jobs > s->nb_coded &&
+        (!pict || s->nb_jobs - s->nb_coded == s->nb_workers)) {
+        avctx->execute2(avctx, gif_encode_job, NULL, NULL, s->nb_jobs - s->nb_coded);
+        s->nb_coded = s->nb_jobs;
     }
 
-    pkt->size   = outbuf_ptr - pkt->data;
-    if (s->image || !avctx->frame_num)
+    if (!s->nb_coded)
+        return 0;
+
+    job = &s->jobs[s->job_head];
+
+    ret = ff_get_encode_buffer(avctx, pkt, job->size, 0);
+    if (ret < 0)
+        return ret;
+    memcpy(pkt->data, job->outbuf, job->size);
+    pkt->pts      = job->frame->pts;
+    pkt->duration = job->frame->duration;
+    ret = ff_encode_reordered_opaque(avctx, pkt, job->frame);
+    if (ret < 0)
+        return ret;
+    if (job->key)
         pkt->flags |= AV_PKT_FLAG_KEY;
+
+    av_frame_unref(job->frame);
+    av_frame_unref(job->ref);
+    s->job_head = (s->job_head + 1) % s->nb_workers;
+    s->nb_jobs--;
+    s->nb_coded--;
     *got_packet = 1;
 
     return 0;
@@ -521,12 +548,23 @@ static int gif_encode_close(AVCodecContext *avctx)
 {
     GIFContext *s = avctx->priv_data;
 
-    av_freep(&s->lzw);
-    av_freep(&s->buf);
-    av_freep(&s->shrunk_buf);
-    s->buf_size = 0;
+    for (int i = 0; i < s->nb_workers; i++) {
+        GIFWorker *w = &s->workers[i];
+        GIFJob  *job = &s->jobs[i];
+
+        av_freep(&w->lzw);
+        av_freep(&w->buf);
+        av_freep(&w->shrunk_buf);
+        av_freep(&w->tmpl);
+        av_frame_free(&job->frame);
+        av_frame_free(&job->ref);
+        av_freep(&job->outbuf);
+    }
+    av_freep(&s->workers);
+    av_freep(&s->jobs);
+    s->nb_workers = 0;
+    av_freep(&s->trans_line);
     av_frame_free(&s->last_frame);
-    av_freep(&s->tmpl);
     return 0;
 }
 
@@ -553,7 +591,8 @@ const FFCodec ff_gif_encoder = {
     CODEC_LONG_NAME("GIF (Graphics Interchange Format)"),
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_GIF,
-    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                      AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(GIFContext),
     .init           = gif_encode_init,
     FF_CODEC_ENCODE_CB(gif_encode_frame),
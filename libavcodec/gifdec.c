@@ -21,6 +21,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "avcodec.h"
 #include "bytestream.h"
@@ -35,6 +36,26 @@
  */
 #define GIF_TRANSPARENT_COLOR    0x00ffffff
 
+/**
+ * Canvas and disposal state after a frame, from which decoding can resume
+ * at the frame following it, and the frames following it up to the next
+ * checkpoint, which are decoded again to resume at any of them.
+ */
+typedef struct GifCheckpoint {
+    int64_t pos;                ///< position of the next frame in the file
+    AVFrame *canvas;
+    int gce_prev_disposal;
+    int gce_l, gce_t, gce_w, gce_h;
+    uint32_t *stored_img;
+    int stored_img_size;
+    int stored_bg_color;
+
+    AVPacket **pkts;            ///< data of the frames following pos, in order
+    int nb_pkts;
+    int64_t next_pos;           ///< position following the last of pkts
+    uint64_t last_use;          ///< for evicting the least recently used
+} GifCheckpoint;
+
 typedef struct GifState {
     const AVClass *class;
     AVFrame *frame;
@@ -46,10 +67,10 @@ typedef struct GifState {
     int background_color_index;
     int transparent_color_index;
     int color_resolution;
-    /* intermediate buffer for storing color indices
+    /* intermediate buffer for storing the color indices of a whole image
      * obtained from lzw-encoded data stream */
-    uint8_t *idx_line;
-    int idx_line_size;
+    uint8_t *idx_buf;
+    unsigned idx_buf_size;
 
     /* after the frame is displayed, the disposal method is used */
     int gce_prev_disposal;
@@ -74,6 +95,19 @@ typedef struct GifState {
     int keyframe;
     int keyframe_ok;
     int trans_color;    /**< color value that is used instead of transparent color */
+
+    int independent;    ///< the last image covers the whole screen and is opaque
+    int flushed;        ///< nothing was decoded since flushing
+    int decoded;        ///< a frame was decoded since opening
+    int corrupt;        ///< the canvas is unknown after a seek
+
+    int checkpoint_interval;
+    int max_checkpoints;
+    int nb_frames;      ///< frames decoded since the last checkpoint
+    GifCheckpoint *checkpoints;
+    int nb_checkpoints;
+    int cur_checkpoint; ///< checkpoint collecting the frames decoded, or -1
+    uint64_t nb_uses;
 } GifState;
 
 static void gif_read_palette(GifState *s, uint32_t *pal, int nb)
@@ -130,7 +164,7 @@ static void gif_copy_img_rect(const uint32_t *src, uint32_t *dst,
 static int gif_read_image(GifState *s, AVFrame *frame)
 {
     int left, top, width, height, bits_per_pixel, code_size, flags, pw;
-    int is_interleaved, has_local_palette, y, pass, y1, linesize, pal_size, lzwed_len;
+    int is_interleaved, has_local_palette, y, pass, y1, linesize, pal_size, lzwed_len, count;
     uint32_t *ptr, *pal, *px, *pr, *ptr1;
     int ret;
     uint8_t *idx;
@@ -195,6 +229,8 @@ static int gif_read_image(GifState *s, AVFrame *frame)
         av_log(s->avctx, AV_LOG_ERROR, "Invalid top position: %d.\n", top);
         return AVERROR_INVALIDDATA;
     }
+    s->independent = !left && !top && width >= s->screen_width && height >= s->screen_height &&
+                     s->transparent_color_index == -1;
     if (left + width > s->screen_width) {
         /* width must be kept around to avoid lzw vs line desync */
         pw = s->screen_width - left;
@@ -251,23 +287,24 @@ static int gif_read_image(GifState *s, AVFrame *frame)
         return ret;
     }
 
+    av_fast_malloc(&s->idx_buf, &s->idx_buf_size, (size_t)width * height);
+    if (!s->idx_buf)
+        return AVERROR(ENOMEM);
+
     /* read all the image */
+    count = ff_lzw_decode_all(s->lzw, s->idx_buf, width * height);
+    if (count != width * height && count % width)
+        av_log(s->avctx, AV_LOG_ERROR, "LZW decode failed\n");
+
     linesize = frame->linesize[0] / sizeof(uint32_t);
     ptr1 = (uint32_t *)frame->data[0] + top * linesize + left;
     ptr = ptr1;
     pass = 0;
     y1 = 0;
-    for (y = 0; y < height; y++) {
-        int count = ff_lzw_decode(s->lzw, s->idx_line, width);
-        if (count != width) {
-            if (count)
-                av_log(s->avctx, AV_LOG_ERROR, "LZW decode failed\n");
-            goto decode_tail;
-        }
-
+    for (y = 0; y < count / width; y++) {
         pr = ptr + pw;
 
-        for (px = ptr, idx = s->idx_line; px < pr; px++, idx++) {
+        for (px = ptr, idx = s->idx_buf + y * width; px < pr; px++, idx++) {
             if (*idx != s->transparent_color_index)
                 *px = pal[*idx];
         }
@@ -299,7 +336,6 @@ static int gif_read_image(GifState *s, AVFrame *frame)
         }
     }
 
- decode_tail:
     /* read the garbage data until end marker is found */
     lzwed_len = ff_lzw_decode_tail(s->lzw);
     bytestream2_skipu(&s->gb, lzwed_len);
@@ -448,6 +484,167 @@ static int gif_parse_next_image(GifState *s, AVFrame *frame)
     return AVERROR_EOF;
 }
 
+static void free_checkpoint(GifCheckpoint *cp)
+{
+    av_frame_free(&cp->canvas);
+    av_freep(&cp->stored_img);
+    for (int i = 0; i < cp->nb_pkts; i++)
+        av_packet_free(&cp->pkts[i]);
+    av_freep(&cp->pkts);
+}
+
+/**
+ * Save the state after the current frame, evicting the least recently used
+ * checkpoint if there are too many already.
+ */
+static int add_checkpoint(GifState *s, int64_t pos)
+{
+    GifCheckpoint *cp;
+    int idx = s->nb_checkpoints;
+
+    s->cur_checkpoint = -1;
+    for (int i = 0; i < s->nb_checkpoints; i++)
+        if (s->checkpoints[i].pos == pos)
+            return 0;
+
+    if (s->nb_checkpoints == s->max_checkpoints) {
+        idx = 0;
+        for (int i = 1; i < s->nb_checkpoints; i++)
+            if (s->checkpoints[i].last_use < s->checkpoints[idx].last_use)
+                idx = i;
+        free_checkpoint(&s->checkpoints[idx]);
+    } else {
+        s->nb_checkpoints++;
+    }
+    cp = &s->checkpoints[idx];
+
+    *cp = (GifCheckpoint) {
+        .pos               = pos,
+        .gce_prev_disposal = s->gce_prev_disposal,
+        .gce_l             = s->gce_l,
+        .gce_t             = s->gce_t,
+        .gce_w             = s->gce_w,
+        .gce_h             = s->gce_h,
+        .stored_bg_color   = s->stored_bg_color,
+        .next_pos          = pos,
+        .last_use          = ++s->nb_uses,
+    };
+    cp->pkts = av_calloc(s->checkpoint_interval, sizeof(*cp->pkts));
+    /* the canvas is copied when the next frame is drawn on it */
+    cp->canvas = av_frame_clone(s->frame);
+    if (!cp->pkts || !cp->canvas)
+        goto fail;
+    if (s->gce_prev_disposal == GCE_DISPOSAL_RESTORE) {
+        cp->stored_img = av_memdup(s->stored_img, s->stored_img_size);
+        if (!cp->stored_img)
+            goto fail;
+        cp->stored_img_size = s->stored_img_size;
+    }
+
+    s->cur_checkpoint = idx;
+    return 0;
+
+fail:
+    free_checkpoint(cp);
+    *cp = s->checkpoints[--s->nb_checkpoints];
+    return AVERROR(ENOMEM);
+}
+
+/**
+ * Keep the data of the frame just decoded, starting at offset in the packet,
+ * along with the checkpoint preceding it.
+ */
+static int add_checkpoint_frame(GifState *s, const AVPacket *avpkt, int offset)
+{
+    GifCheckpoint *cp = &s->checkpoints[s->cur_checkpoint];
+    AVPacket *pkt;
+    int ret;
+
+    if (cp->nb_pkts == s->checkpoint_interval || cp->next_pos != avpkt->pos + offset) {
+        s->cur_checkpoint = -1;
+        return 0;
+    }
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        return AVERROR(ENOMEM);
+    if ((ret = av_packet_ref(pkt, avpkt)) < 0) {
+        av_packet_free(&pkt);
+        return ret;
+    }
+    pkt->data += offset;
+    pkt->size -= offset;
+    pkt->pos  += offset;
+
+    cp->pkts[cp->nb_pkts++] = pkt;
+    cp->next_pos = pkt->pos + pkt->size;
+    return 0;
+}
+
+/**
+ * Restore the state before the frame at pos from the nearest checkpoint
+ * preceding it, decoding again the frames between them.
+ *
+ * @return 1 if the state was restored, 0 if no checkpoint leads to pos
+ */
+static int resume_from_checkpoint(GifState *s, int64_t pos)
+{
+    const GetByteContext gb = s->gb;
+    GifCheckpoint *cp = NULL;
+    int nb_pkts = 0, ret;
+
+    for (int i = 0; i < s->nb_checkpoints; i++) {
+        GifCheckpoint *c = &s->checkpoints[i];
+        int n;
+
+        if (c->pos > pos || (cp && c->pos < cp->pos) ||
+            c->canvas->width  != s->screen_width ||
+            c->canvas->height != s->screen_height)
+            continue;
+        for (n = 0; n < c->nb_pkts && c->pkts[n]->pos < pos; n++);
+        if ((n < c->nb_pkts ? c->pkts[n]->pos : c->next_pos) != pos)
+            continue;
+        cp      = c;
+        nb_pkts = n;
+    }
+    if (!cp)
+        return 0;
+    cp->last_use = ++s->nb_uses;
+
+    av_frame_unref(s->frame);
+    if ((ret = av_frame_ref(s->frame, cp->canvas)) < 0)
+        return ret;
+
+    s->gce_prev_disposal = cp->gce_prev_disposal;
+    s->gce_l             = cp->gce_l;
+    s->gce_t             = cp->gce_t;
+    s->gce_w             = cp->gce_w;
+    s->gce_h             = cp->gce_h;
+    s->stored_bg_color   = cp->stored_bg_color;
+    if (cp->stored_img) {
+        av_fast_malloc(&s->stored_img, &s->stored_img_size, cp->stored_img_size);
+        if (!s->stored_img)
+            return AVERROR(ENOMEM);
+        memcpy(s->stored_img, cp->stored_img, cp->stored_img_size);
+    }
+
+    s->keyframe = 0;
+    for (int i = 0; i < nb_pkts; i++) {
+        bytestream2_init(&s->gb, cp->pkts[i]->data, cp->pkts[i]->size);
+        if ((ret = ff_reget_buffer(s->avctx, s->frame, 0)) < 0 ||
+            (ret = gif_parse_next_image(s, s->frame)) < 0)
+            return ret;
+    }
+    s->gb = gb;
+
+    /* keep the next checkpoints where they were, extending this one if the
+     * frames following it were not all kept */
+    s->nb_frames      = nb_pkts;
+    s->cur_checkpoint = nb_pkts == cp->nb_pkts ? cp - s->checkpoints : -1;
+
+    return 1;
+}
+
 static av_cold int gif_decode_init(AVCodecContext *avctx)
 {
     GifState *s = avctx->priv_data;
@@ -461,6 +658,13 @@ static av_cold int gif_decode_init(AVCodecContext *avctx)
     ff_lzw_decode_open(&s->lzw);
     if (!s->lzw)
         return AVERROR(ENOMEM);
+
+    s->cur_checkpoint = -1;
+    if (s->checkpoint_interval) {
+        s->checkpoints = av_calloc(s->max_checkpoints, sizeof(*s->checkpoints));
+        if (!s->checkpoints)
+            return AVERROR(ENOMEM);
+    }
     return 0;
 }
 
@@ -468,8 +672,10 @@ static int gif_decode_frame(AVCodecContext *avctx, AVFrame *rframe,
                             int *got_frame, AVPacket *avpkt)
 {
     GifState *s = avctx->priv_data;
-    int ret;
+    const int flushed = s->flushed;
+    int offset = 0, ret;
 
+    s->flushed = 0;
     bytestream2_init(&s->gb, avpkt->data, avpkt->size);
 
     if (avpkt->size >= 6) {
@@ -489,9 +695,25 @@ static int gif_decode_frame(AVCodecContext *avctx, AVFrame *rframe,
             return ret;
 
         av_frame_unref(s->frame);
-        av_fast_malloc(&s->idx_line, &s->idx_line_size, s->screen_width);
-        if (!s->idx_line)
-            return AVERROR(ENOMEM);
+        offset = bytestream2_tell(&s->gb);
+        s->cur_checkpoint = -1;
+        s->corrupt = 0;
+
+        /* After a seek, the demuxer sends the header again before the frame,
+         * the file itself only has it at its start. Unless the frame does not
+         * depend on the previous ones, resume from the nearest checkpoint.
+         * Streams in other containers may have their first header anywhere,
+         * so nothing is resumed before the first frame was decoded. */
+        if (flushed && avpkt->pos > 0 && (s->decoded || s->nb_checkpoints)) {
+            if ((ret = resume_from_checkpoint(s, avpkt->pos + offset)) < 0)
+                return ret;
+            s->corrupt     = !ret;
+            s->keyframe    = !ret;
+            s->keyframe_ok = 1;
+        }
+        /* save the state after the first frame whose canvas is known */
+        if (!s->keyframe_ok || s->corrupt)
+            s->nb_frames = s->checkpoint_interval - 1;
     } else if (!s->keyframe_ok) {
         av_log(avctx, AV_LOG_ERROR, "cannot decode frame without keyframe\n");
         return AVERROR_INVALIDDATA;
@@ -504,12 +726,28 @@ static int gif_decode_frame(AVCodecContext *avctx, AVFrame *rframe,
     ret = gif_parse_next_image(s, s->frame);
     if (ret < 0)
         return ret;
+    if (s->independent)
+        s->corrupt = 0;
+
+    s->decoded = 1;
+
+    if (s->checkpoint_interval && avpkt->pos >= 0 && !s->corrupt) {
+        if (s->cur_checkpoint >= 0 &&
+            (ret = add_checkpoint_frame(s, avpkt, offset)) < 0)
+            return ret;
+        if (++s->nb_frames >= s->checkpoint_interval) {
+            if ((ret = add_checkpoint(s, avpkt->pos + avpkt->size)) < 0)
+                return ret;
+            s->nb_frames = 0;
+        }
+    }
 
     if ((ret = av_frame_ref(rframe, s->frame)) < 0)
         return ret;
 
     rframe->pict_type = s->keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
-    rframe->flags     = AV_FRAME_FLAG_KEY * s->keyframe;
+    rframe->flags     = AV_FRAME_FLAG_KEY     * (s->keyframe && !s->corrupt) |
+                        AV_FRAME_FLAG_CORRUPT * s->corrupt;
     s->keyframe_ok   |= !!s->keyframe;
 
     *got_frame = 1;
@@ -517,15 +755,27 @@ static int gif_decode_frame(AVCodecContext *avctx, AVFrame *rframe,
     return bytestream2_tell(&s->gb);
 }
 
+static void gif_decode_flush(AVCodecContext *avctx)
+{
+    GifState *s = avctx->priv_data;
+
+    /* the checkpoints are kept to resume from them after a seek */
+    s->flushed = 1;
+}
+
 static av_cold int gif_decode_close(AVCodecContext *avctx)
 {
     GifState *s = avctx->priv_data;
 
     ff_lzw_decode_close(&s->lzw);
     av_frame_free(&s->frame);
-    av_freep(&s->idx_line);
+    av_freep(&s->idx_buf);
     av_freep(&s->stored_img);
 
+    for (int i = 0; i < s->nb_checkpoints; i++)
+        free_checkpoint(&s->checkpoints[i]);
+    av_freep(&s->checkpoints);
+
     return 0;
 }
 
@@ -534,6 +784,14 @@ static const AVOption options[] = {
       offsetof(GifState, trans_color), AV_OPT_TYPE_INT,
       {.i64 = GIF_TRANSPARENT_COLOR}, 0, 0xffffffff,
       AV_OPT_FLAG_DECODING_PARAM|AV_OPT_FLAG_VIDEO_PARAM },
+    { "checkpoint_interval", "save the canvas every N frames to resume decoding from it after a seek",
+      offsetof(GifState, checkpoint_interval), AV_OPT_TYPE_INT,
+      {.i64 = 0}, 0, 1024,
+      AV_OPT_FLAG_DECODING_PARAM|AV_OPT_FLAG_VIDEO_PARAM },
+    { "max_checkpoints", "maximum number of saved canvases",
+      offsetof(GifState, max_checkpoints), AV_OPT_TYPE_INT,
+      {.i64 = 8}, 1, 1024,
+      AV_OPT_FLAG_DECODING_PARAM|AV_OPT_FLAG_VIDEO_PARAM },
     { NULL },
 };
 
@@ -553,6 +811,7 @@ const FFCodec ff_gif_decoder = {
     .priv_data_size = sizeof(GifState),
     .init           = gif_decode_init,
     .close          = gif_decode_close,
+    .flush          = gif_decode_flush,
     FF_CODEC_DECODE_CB(gif_decode_frame),
     .p.capabilities = AV_CODEC_CAP_DR1,
     .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP,
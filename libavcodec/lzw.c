@@ -63,6 +63,9 @@ struct LZWState {
     uint8_t stack[LZW_SIZTABLE];
     uint8_t suffix[LZW_SIZTABLE];
     uint16_t prefix[LZW_SIZTABLE];
+    /* strings of the codes, as offsets into the output of ff_lzw_decode_all() */
+    unsigned str_off[LZW_SIZTABLE];
+    uint16_t str_len[LZW_SIZTABLE];
     int bs;                     ///< current buffer size for GIF
 };
 
@@ -227,3 +230,81 @@ int ff_lzw_decode(LZWState *p, uint8_t *buf, int len){
     s->fc = fc;
     return len - l;
 }
+
+/**
+ * Decode given number of bytes in one go into a contiguous buffer.
+ * Instead of walking the prefix chain of every code, each code is expanded
+ * by copying its string from where it was previously written to buf.
+ * This must only be called once after ff_lzw_decode_init() and cannot be
+ * mixed with ff_lzw_decode().
+ *
+ * @param p LZW context
+ * @param buf output buffer
+ * @param len number of bytes to decode
+ * @return number of bytes decoded
+ */
+int ff_lzw_decode_all(LZWState *p, uint8_t *buf, int len)
+{
+    struct LZWState *s = (struct LZWState *)p;
+    uint8_t *dst = buf;
+    const uint8_t *const end = buf + len;
+    unsigned prev_off = 0;
+    int prev_len = 0, oc = -1;
+
+    if (s->end_code < 0)
+        return 0;
+
+    while (dst < end) {
+        int c = lzw_get_code(s);
+        unsigned cur_off = dst - buf;
+        int cur_len, n;
+
+        if (c == s->end_code) {
+            break;
+        } else if (c == s->clear_code) {
+            s->cursize = s->codesize + 1;
+            s->curmask = mask[s->cursize];
+            s->slot = s->newcodes;
+            s->top_slot = 1 << s->cursize;
+            oc = -1;
+            continue;
+        } else if (c < s->clear_code) {
+            cur_len = 1;
+            *dst++ = c;
+        } else if (c >= s->newcodes && c < s->slot) {
+            cur_len = s->str_len[c];
+            n = FFMIN(cur_len, end - dst);
+            memcpy(dst, buf + s->str_off[c], n);
+            dst += n;
+        } else if (c == s->slot && oc >= 0) {
+            /* the string of the previous code followed by its first byte */
+            cur_len = prev_len + 1;
+            n = FFMIN(prev_len, end - dst);
+            memcpy(dst, buf + prev_off, n);
+            dst += n;
+            if (dst < end)
+                *dst++ = buf[prev_off];
+        } else {
+            break;
+        }
+
+        /* The new code is the previous string followed by the first byte
+         * of the current one, which is right after it in the output. */
+        if (s->slot < s->top_slot && oc >= 0) {
+            s->str_off[s->slot]   = prev_off;
+            s->str_len[s->slot++] = prev_len + 1;
+        }
+        prev_off = cur_off;
+        prev_len = cur_len;
+        oc = c;
+        if (s->slot >= s->top_slot - s->extra_slot) {
+            if (s->cursize < LZW_MAXBITS) {
+                s->top_slot <<= 1;
+                s->curmask = mask[++s->cursize];
+            }
+        }
+    }
+    if (dst < end)
+        s->end_code = -1;
+    return dst - buf;
+}
@@ -47,6 +47,7 @@ void ff_lzw_decode_open(LZWState **p);
 void ff_lzw_decode_close(LZWState **p);
 int ff_lzw_decode_init(LZWState *s, int csize, const uint8_t *buf, int buf_size, int mode);
 int ff_lzw_decode(LZWState *s, uint8_t *buf, int len);
+int ff_lzw_decode_all(LZWState *s, uint8_t *buf, int len);
 int ff_lzw_decode_tail(LZWState *lzw);
 
 /** LZW encode state */
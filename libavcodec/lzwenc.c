@@ -33,26 +33,21 @@
 
 #define LZW_MAXBITS 12
 #define LZW_SIZTABLE (1<<LZW_MAXBITS)
-#define LZW_HASH_SIZE 16411
-#define LZW_HASH_SHIFT 6
 
 #define LZW_PREFIX_EMPTY -1
-#define LZW_PREFIX_FREE -2
-
-/** One code in hash table */
-typedef struct Code{
-    /// Hash code of prefix, LZW_PREFIX_EMPTY if empty prefix, or LZW_PREFIX_FREE if no code
-    int hash_prefix;
-    int code;               ///< LZW code
-    uint8_t suffix;         ///< Last character in code block
-}Code;
 
 /** LZW encode state */
 typedef struct LZWEncodeState {
     int clear_code;          ///< Value of clear code
     int end_code;            ///< Value of end code
-    Code tab[LZW_HASH_SIZE]; ///< Hash table
-    int tabsize;             ///< Number of values in hash table
+    /**
+     * Code table directly indexed by (prefix code << 8 | character).
+     * An entry is only valid if it is a code currently in use whose key
+     * matches, so the table never has to be cleared.
+     */
+    uint16_t child[LZW_SIZTABLE << 8];
+    uint32_t key[LZW_SIZTABLE]; ///< (prefix code << 8 | character) of each code
+    int tabsize;             ///< Number of values in the code table
     int bits;                ///< Actual bits code
     int bufsize;             ///< Size of output buffer
     PutBitContext pb;        ///< Put bit context for output
@@ -67,54 +62,16 @@ typedef struct LZWEncodeState {
 
 const int ff_lzw_encode_state_size = sizeof(LZWEncodeState);
 
-/**
- * Hash function adding character
- * @param head LZW code for prefix
- * @param add Character to add
- * @return New hash value
- */
-static inline int hash(int head, const int add)
-{
-    head ^= (add << LZW_HASH_SHIFT);
-    if (head >= LZW_HASH_SIZE)
-        head -= LZW_HASH_SIZE;
-    av_assert2(head >= 0 && head < LZW_HASH_SIZE);
-    return head;
-}
-
-/**
- * Hash function calculates next hash value
- * @param head Actual hash code
- * @param offset Offset calculated by hashOffset
- * @return New hash value
- */
-static inline int hashNext(int head, const int offset)
-{
-    head -= offset;
-    if(head < 0)
-        head += LZW_HASH_SIZE;
-    return head;
-}
-
-/**
- * Hash function calculates hash offset
- * @param head Actual hash code
- * @return Hash offset
- */
-static inline int hashOffset(const int head)
-{
-    return head ? LZW_HASH_SIZE - head : 1;
-}
-
 /**
  * Write one code to stream
  * @param s LZW state
  * @param c code to write
+ * @param little_endian whether to write the code LSB first
  */
-static inline void writeCode(LZWEncodeState * s, int c)
+static av_always_inline void writeCode(LZWEncodeState *s, int c, int little_endian)
 {
     av_assert2(0 <= c && c < 1 << s->bits);
-    if (s->little_endian)
+    if (little_endian)
         put_bits_le(&s->pb, s->bits, c);
     else
         put_bits(&s->pb, s->bits, c);
@@ -125,36 +82,32 @@ static inline void writeCode(LZWEncodeState * s, int c)
  * Find LZW code for block
  * @param s LZW state
  * @param c Last character in block
- * @param hash_prefix LZW code for prefix
+ * @param prefix LZW code for prefix
  * @return LZW code for block or -1 if not found in table
  */
-static inline int findCode(LZWEncodeState * s, uint8_t c, int hash_prefix)
+static inline int findCode(const LZWEncodeState *s, uint8_t c, int prefix)
 {
-    int h = hash(FFMAX(hash_prefix, 0), c);
-    int hash_offset = hashOffset(h);
+    const unsigned key  = prefix << 8 | c;
+    const unsigned code = s->child[key];
 
-    while (s->tab[h].hash_prefix != LZW_PREFIX_FREE) {
-        if ((s->tab[h].suffix == c)
-            && (s->tab[h].hash_prefix == hash_prefix))
-            return h;
-        h = hashNext(h, hash_offset);
-    }
+    if (code < s->tabsize && s->key[code] == key)
+        return code;
 
-    return h;
+    return -1;
 }
 
 /**
  * Add block to LZW code table
  * @param s LZW state
  * @param c Last character in block
- * @param hash_prefix LZW code for prefix
- * @param hash_code LZW code for bytes block
+ * @param prefix LZW code for prefix
  */
-static inline void addCode(LZWEncodeState * s, uint8_t c, int hash_prefix, int hash_code)
+static inline void addCode(LZWEncodeState *s, uint8_t c, int prefix)
 {
-    s->tab[hash_code].code = s->tabsize;
-    s->tab[hash_code].suffix = c;
-    s->tab[hash_code].hash_prefix = hash_prefix;
+    const unsigned key = prefix << 8 | c;
+
+    s->child[key]      = s->tabsize;
+    s->key[s->tabsize] = key;
 
     s->tabsize++;
 
@@ -165,22 +118,12 @@ static inline void addCode(LZWEncodeState * s, uint8_t c, int hash_prefix, int h
 /**
  * Clear LZW code table
  * @param s LZW state
+ * @param little_endian whether to write the clear code LSB first
  */
-static void clearTable(LZWEncodeState * s)
+static av_always_inline void clearTable(LZWEncodeState *s, int little_endian)
 {
-    int i, h;
-
-    writeCode(s, s->clear_code);
+    writeCode(s, s->clear_code, little_endian);
     s->bits = 9;
-    for (i = 0; i < LZW_HASH_SIZE; i++) {
-        s->tab[i].hash_prefix = LZW_PREFIX_FREE;
-    }
-    for (i = 0; i < 256; i++) {
-        h = hash(0, i);
-        s->tab[h].code = i;
-        s->tab[h].suffix = i;
-        s->tab[h].hash_prefix = LZW_PREFIX_EMPTY;
-    }
     s->tabsize = 258;
 }
 
@@ -216,8 +159,42 @@ void ff_lzw_encode_init(LZWEncodeState *s, uint8_t *outbuf, int outsize,
     s->output_bytes = 0;
     s->last_code = LZW_PREFIX_EMPTY;
     s->bits = 9;
+    s->tabsize = 258;
     s->mode = mode;
     s->little_endian = little_endian;
+    /* Single characters and the special codes are never looked up through
+     * the child table, make sure they never match. */
+    for (int i = 0; i < 258; i++)
+        s->key[i] = UINT32_MAX;
+}
+
+static av_always_inline void lzw_encode(LZWEncodeState *s, const uint8_t *inbuf,
+                                        int insize, int little_endian)
+{
+    const uint8_t *const end = inbuf + insize;
+    int last_code = s->last_code;
+
+    if (last_code == LZW_PREFIX_EMPTY) {
+        clearTable(s, little_endian);
+        if (inbuf == end)
+            return;
+        last_code = *inbuf++;
+    }
+
+    while (inbuf < end) {
+        uint8_t c = *inbuf++;
+        int code = findCode(s, c, last_code);
+        if (code < 0) {
+            writeCode(s, last_code, little_endian);
+            addCode(s, c, last_code);
+            code = c;
+            if (s->tabsize >= s->maxcode - 1)
+                clearTable(s, little_endian);
+        }
+        last_code = code;
+    }
+
+    s->last_code = last_code;
 }
 
 /**
@@ -229,28 +206,14 @@ void ff_lzw_encode_init(LZWEncodeState *s, uint8_t *outbuf, int outsize,
  */
 int ff_lzw_encode(LZWEncodeState * s, const uint8_t * inbuf, int insize)
 {
-    int i;
-
     if(insize * 3 > (s->bufsize - s->output_bytes) * 2){
         return -1;
     }
 
-    if (s->last_code == LZW_PREFIX_EMPTY)
-        clearTable(s);
-
-    for (i = 0; i < insize; i++) {
-        uint8_t c = *inbuf++;
-        int code = findCode(s, c, s->last_code);
-        if (s->tab[code].hash_prefix == LZW_PREFIX_FREE) {
-            writeCode(s, s->last_code);
-            addCode(s, c, s->last_code, code);
-            code= hash(0, c);
-        }
-        s->last_code = s->tab[code].code;
-        if (s->tabsize >= s->maxcode - 1) {
-            clearTable(s);
-        }
-    }
+    if (s->little_endian)
+        lzw_encode(s, inbuf, insize, 1);
+    else
+        lzw_encode(s, inbuf, insize, 0);
 
     return writtenBytes(s);
 }
@@ -262,15 +225,18 @@ int ff_lzw_encode(LZWEncodeState * s, const uint8_t * inbuf, int insize)
  */
 int ff_lzw_encode_flush(LZWEncodeState *s)
 {
-    if (s->last_code != -1)
-        writeCode(s, s->last_code);
-    writeCode(s, s->end_code);
     if (s->little_endian) {
+        if (s->last_code != -1)
+            writeCode(s, s->last_code, 1);
+        writeCode(s, s->end_code, 1);
         if (s->mode == FF_LZW_GIF)
             put_bits_le(&s->pb, 1, 0);
 
         flush_put_bits_le(&s->pb);
     } else {
+        if (s->last_code != -1)
+            writeCode(s, s->last_code, 0);
+        writeCode(s, s->end_code, 0);
         if (s->mode == FF_LZW_GIF)
             put_bits(&s->pb, 1, 0);
 
@@ -48,6 +48,8 @@ typedef struct APNGFctlChunk {
     uint8_t dispose_op, blend_op;
 } APNGFctlChunk;
 
+typedef struct APNGTrial APNGTrial;
+
 typedef struct PNGEncContext {
     AVClass *class;
     LLVidEncDSPContext llvidencdsp;
@@ -80,8 +82,28 @@ typedef struct PNGEncContext {
     APNGFctlChunk last_frame_fctl;
     uint8_t *last_frame_packet;
     size_t last_frame_packet_size;
+    APNGTrial *trials;
 } PNGEncContext;
 
+/* Number of dispose_op and blend_op combinations tried for each APNG frame */
+#define APNG_NB_TRIALS 6
+
+/**
+ * Candidate encoding of an APNG frame. Trials are run concurrently, so each
+ * one has its own zlib stream and output buffer.
+ */
+struct APNGTrial {
+    PNGEncContext enc;
+    const AVFrame *pict;
+    AVFrame *frame;             ///< disposed previous frame, then the inverse blended image
+    APNGFctlChunk fctl_chunk;
+    APNGFctlChunk last_fctl_chunk;
+    uint8_t *buf;
+    size_t buf_size;
+    size_t size;
+    int skip;
+};
+
 static void png_get_interlaced_row(uint8_t *dst, int row_size,
                                    int bits_per_pixel, int pass,
                                    const uint8_t *src, int width)
@@ -244,10 +266,9 @@ static void png_write_chunk(uint8_t **f, uint32_t tag,
     bytestream_put_be32(f, ~crc);
 }
 
-static void png_write_image_data(AVCodecContext *avctx,
+static void png_write_image_data(AVCodecContext *avctx, PNGEncContext *s,
                                  const uint8_t *buf, int length)
 {
-    PNGEncContext *s = avctx->priv_data;
     const AVCRC *crc_table = av_crc_get_table(AV_CRC_32_IEEE_LE);
     uint32_t crc = ~0U;
 
@@ -272,9 +293,9 @@ static void png_write_image_data(AVCodecContext *avctx,
 }
 
 /* XXX: do filtering */
-static int png_write_row(AVCodecContext *avctx, const uint8_t *data, int size)
+static int png_write_row(AVCodecContext *avctx, PNGEncContext *s,
+                         const uint8_t *data, int size)
 {
-    PNGEncContext *s = avctx->priv_data;
     z_stream *const zstream = &s->zstream.zstream;
     int ret;
 
@@ -286,7 +307,7 @@ static int png_write_row(AVCodecContext *avctx, const uint8_t *data, int size)
             return -1;
         if (zstream->avail_out == 0) {
             if (s->bytestream_end - s->bytestream > IOBUF_SIZE + 100)
-                png_write_image_data(avctx, s->buf, IOBUF_SIZE);
+                png_write_image_data(avctx, s, s->buf, IOBUF_SIZE);
             zstream->avail_out = IOBUF_SIZE;
             zstream->next_out  = s->buf;
         }
@@ -478,9 +499,8 @@ static int encode_headers(AVCodecContext *avctx, const AVFrame *pict)
     return 0;
 }
 
-static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
+static int encode_frame(AVCodecContext *avctx, PNGEncContext *s, const AVFrame *pict)
 {
-    PNGEncContext *s       = avctx->priv_data;
     z_stream *const zstream = &s->zstream.zstream;
     const AVFrame *const p = pict;
     int y, len, ret;
@@ -529,7 +549,7 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
                                                ptr, pict->width);
                         crow = png_choose_filter(s, crow_buf, progressive_buf,
                                                  top, pass_row_size, s->bits_per_pixel >> 3);
-                        png_write_row(avctx, crow, pass_row_size + 1);
+                        png_write_row(avctx, s, crow, pass_row_size + 1);
                         top = progressive_buf;
                     }
             }
@@ -540,7 +560,7 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
             const uint8_t *ptr = p->data[0] + y * p->linesize[0];
             crow = png_choose_filter(s, crow_buf, ptr, top,
                                      row_size, s->bits_per_pixel >> 3);
-            png_write_row(avctx, crow, row_size + 1);
+            png_write_row(avctx, s, crow, row_size + 1);
             top = ptr;
         }
     }
@@ -550,7 +570,7 @@ static int encode_frame(AVCodecContext *avctx, const AVFrame *pict)
         if (ret == Z_OK || ret == Z_STREAM_END) {
             len = IOBUF_SIZE - zstream->avail_out;
             if (len > 0 && s->bytestream_end - s->bytestream > len + 100) {
-                png_write_image_data(avctx, s->buf, len);
+                png_write_image_data(avctx, s, s->buf, len);
             }
             zstream->avail_out = IOBUF_SIZE;
             zstream->next_out  = s->buf;
@@ -633,7 +653,7 @@ static int encode_png(AVCodecContext *avctx, AVPacket *pkt,
     if (ret < 0)
         return ret;
 
-    ret = encode_frame(avctx, pict);
+    ret = encode_frame(avctx, s, pict);
     if (ret < 0)
         return ret;
 
@@ -789,21 +809,109 @@ static int apng_do_inverse_blend(AVFrame *output, const AVFrame *input,
     return 0;
 }
 
+static int apng_has_alpha(enum AVPixelFormat format)
+{
+    switch (format) {
+    case AV_PIX_FMT_RGBA64BE:
+    case AV_PIX_FMT_YA16BE:
+    case AV_PIX_FMT_RGBA:
+    case AV_PIX_FMT_GRAY8A:
+    case AV_PIX_FMT_PAL8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Dispose the previous frame and inverse blend the new one for a trial.
+ */
+static int apng_prepare_trial(AVCodecContext *avctx, void *arg)
+{
+    PNGEncContext *s = avctx->priv_data;
+    APNGTrial *t = arg;
+    const AVFrame *pict = t->pict;
+    uint8_t bpp = (s->bits_per_pixel + 7) >> 3;
+    int ret;
+
+    if (t->skip)
+        return 0;
+
+    // Do disposal
+    t->frame->width  = pict->width;
+    t->frame->height = pict->height;
+    if (t->last_fctl_chunk.dispose_op != APNG_DISPOSE_OP_PREVIOUS) {
+        ret = av_frame_copy(t->frame, s->last_frame);
+        if (ret < 0)
+            return ret;
+
+        if (t->last_fctl_chunk.dispose_op == APNG_DISPOSE_OP_BACKGROUND) {
+            for (unsigned y = t->last_fctl_chunk.y_offset; y < t->last_fctl_chunk.y_offset + t->last_fctl_chunk.height; ++y) {
+                size_t row_start = t->frame->linesize[0] * y + bpp * t->last_fctl_chunk.x_offset;
+                memset(t->frame->data[0] + row_start, 0, bpp * t->last_fctl_chunk.width);
+            }
+        }
+    } else {
+        ret = av_frame_copy(t->frame, s->prev_frame);
+        if (ret < 0)
+            return ret;
+    }
+
+    // Do inverse blending
+    if (apng_do_inverse_blend(t->frame, pict, &t->fctl_chunk, bpp) < 0)
+        t->skip = 1;
+
+    return 0;
+}
+
+static int apng_encode_trial(AVCodecContext *avctx, void *arg)
+{
+    APNGTrial *t = arg;
+    PNGEncContext *enc = &t->enc;
+    int ret;
+
+    if (t->skip)
+        return 0;
+
+    enc->bytestream     = t->buf;
+    enc->bytestream_end = t->buf + t->buf_size;
+    ret = encode_frame(avctx, enc, t->frame);
+    t->size = enc->bytestream - t->buf;
+
+    return ret;
+}
+
+/**
+ * Check whether two trials produced the same image, which would then
+ * compress to the same size.
+ */
+static int apng_same_trial(const APNGTrial *a, const APNGTrial *b, uint8_t bpp)
+{
+    if (a->fctl_chunk.width    != b->fctl_chunk.width    ||
+        a->fctl_chunk.height   != b->fctl_chunk.height   ||
+        a->fctl_chunk.x_offset != b->fctl_chunk.x_offset ||
+        a->fctl_chunk.y_offset != b->fctl_chunk.y_offset ||
+        a->fctl_chunk.blend_op != b->fctl_chunk.blend_op)
+        return 0;
+
+    for (int y = 0; y < a->frame->height; y++)
+        if (memcmp(a->frame->data[0] + y * a->frame->linesize[0],
+                   b->frame->data[0] + y * b->frame->linesize[0],
+                   bpp * a->frame->width))
+            return 0;
+
+    return 1;
+}
+
 static int apng_encode_frame(AVCodecContext *avctx, const AVFrame *pict,
                              APNGFctlChunk *best_fctl_chunk, APNGFctlChunk *best_last_fctl_chunk)
 {
     PNGEncContext *s = avctx->priv_data;
-    int ret;
-    unsigned int y;
-    AVFrame* diffFrame;
+    const size_t max_size = s->bytestream_end - s->bytestream;
     uint8_t bpp = (s->bits_per_pixel + 7) >> 3;
-    uint8_t *original_bytestream, *original_bytestream_end;
-    uint8_t *temp_bytestream = 0, *temp_bytestream_end;
-    uint32_t best_sequence_number;
-    uint8_t *best_bytestream;
-    size_t best_bytestream_size = SIZE_MAX;
-    APNGFctlChunk last_fctl_chunk = *best_last_fctl_chunk;
-    APNGFctlChunk fctl_chunk = *best_fctl_chunk;
+    int rets[APNG_NB_TRIALS];
+    APNGTrial *best = NULL;
+    int ret;
 
     if (avctx->frame_num == 0) {
         best_fctl_chunk->width = pict->width;
@@ -811,111 +919,81 @@ static int apng_encode_frame(AVCodecContext *avctx, const AVFrame *pict,
         best_fctl_chunk->x_offset = 0;
         best_fctl_chunk->y_offset = 0;
         best_fctl_chunk->blend_op = APNG_BLEND_OP_SOURCE;
-        return encode_frame(avctx, pict);
+        return encode_frame(avctx, s, pict);
     }
 
-    diffFrame = av_frame_alloc();
-    if (!diffFrame)
-        return AVERROR(ENOMEM);
-
-    diffFrame->format = pict->format;
-    diffFrame->width = pict->width;
-    diffFrame->height = pict->height;
-    if ((ret = av_frame_get_buffer(diffFrame, 0)) < 0)
-        goto fail;
-
-    original_bytestream = s->bytestream;
-    original_bytestream_end = s->bytestream_end;
-
-    temp_bytestream = av_malloc(original_bytestream_end - original_bytestream);
-    if (!temp_bytestream) {
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-    temp_bytestream_end = temp_bytestream + (original_bytestream_end - original_bytestream);
+    for (int i = 0; i < APNG_NB_TRIALS; i++) {
+        APNGTrial *t = &s->trials[i];
 
-    for (last_fctl_chunk.dispose_op = 0; last_fctl_chunk.dispose_op < 3; ++last_fctl_chunk.dispose_op) {
+        t->pict            = pict;
+        t->enc.sequence_number = s->sequence_number;
+        t->fctl_chunk      = *best_fctl_chunk;
+        t->last_fctl_chunk = *best_last_fctl_chunk;
         // 0: APNG_DISPOSE_OP_NONE
         // 1: APNG_DISPOSE_OP_BACKGROUND
         // 2: APNG_DISPOSE_OP_PREVIOUS
-
-        for (fctl_chunk.blend_op = 0; fctl_chunk.blend_op < 2; ++fctl_chunk.blend_op) {
-            // 0: APNG_BLEND_OP_SOURCE
-            // 1: APNG_BLEND_OP_OVER
-
-            uint32_t original_sequence_number = s->sequence_number, sequence_number;
-            uint8_t *bytestream_start = s->bytestream;
-            size_t bytestream_size;
-
-            // Do disposal
-            if (last_fctl_chunk.dispose_op != APNG_DISPOSE_OP_PREVIOUS) {
-                diffFrame->width = pict->width;
-                diffFrame->height = pict->height;
-                ret = av_frame_copy(diffFrame, s->last_frame);
-                if (ret < 0)
-                    goto fail;
-
-                if (last_fctl_chunk.dispose_op == APNG_DISPOSE_OP_BACKGROUND) {
-                    for (y = last_fctl_chunk.y_offset; y < last_fctl_chunk.y_offset + last_fctl_chunk.height; ++y) {
-                        size_t row_start = diffFrame->linesize[0] * y + bpp * last_fctl_chunk.x_offset;
-                        memset(diffFrame->data[0] + row_start, 0, bpp * last_fctl_chunk.width);
-                    }
-                }
-            } else {
-                if (!s->prev_frame)
-                    continue;
-
-                diffFrame->width = pict->width;
-                diffFrame->height = pict->height;
-                ret = av_frame_copy(diffFrame, s->prev_frame);
-                if (ret < 0)
-                    goto fail;
+        t->last_fctl_chunk.dispose_op = i / 2;
+        // 0: APNG_BLEND_OP_SOURCE
+        // 1: APNG_BLEND_OP_OVER
+        t->fctl_chunk.blend_op = i % 2;
+
+        // Inverse blending with APNG_BLEND_OP_OVER needs transparency
+        t->skip = (t->last_fctl_chunk.dispose_op == APNG_DISPOSE_OP_PREVIOUS && !s->prev_frame) ||
+                  (t->fctl_chunk.blend_op == APNG_BLEND_OP_OVER && !apng_has_alpha(pict->format));
+        if (t->skip)
+            continue;
+
+        if (!t->frame->buf[0]) {
+            t->frame->format = pict->format;
+            t->frame->width  = pict->width;
+            t->frame->height = pict->height;
+            if ((ret = av_frame_get_buffer(t->frame, 0)) < 0)
+                return ret;
+        }
+        if (t->buf_size < max_size) {
+            av_freep(&t->buf);
+            t->buf = av_malloc(max_size);
+            if (!t->buf) {
+                t->buf_size = 0;
+                return AVERROR(ENOMEM);
             }
+            t->buf_size = max_size;
+        }
+    }
 
-            // Do inverse blending
-            if (apng_do_inverse_blend(diffFrame, pict, &fctl_chunk, bpp) < 0)
-                continue;
+    avctx->execute(avctx, apng_prepare_trial, s->trials, rets, APNG_NB_TRIALS, sizeof(*s->trials));
+    for (int i = 0; i < APNG_NB_TRIALS; i++)
+        if (rets[i] < 0)
+            return rets[i];
 
-            // Do encoding
-            ret = encode_frame(avctx, diffFrame);
-            sequence_number = s->sequence_number;
-            s->sequence_number = original_sequence_number;
-            bytestream_size = s->bytestream - bytestream_start;
-            s->bytestream = bytestream_start;
-            if (ret < 0)
-                goto fail;
-
-            if (bytestream_size < best_bytestream_size) {
-                *best_fctl_chunk = fctl_chunk;
-                *best_last_fctl_chunk = last_fctl_chunk;
-
-                best_sequence_number = sequence_number;
-                best_bytestream = s->bytestream;
-                best_bytestream_size = bytestream_size;
-
-                if (best_bytestream == original_bytestream) {
-                    s->bytestream = temp_bytestream;
-                    s->bytestream_end = temp_bytestream_end;
-                } else {
-                    s->bytestream = original_bytestream;
-                    s->bytestream_end = original_bytestream_end;
-                }
-            }
-        }
+    // Identical candidates give the same size, only the first one is kept
+    for (int i = 1; i < APNG_NB_TRIALS; i++) {
+        APNGTrial *t = &s->trials[i];
+
+        for (int j = 0; j < i && !t->skip; j++)
+            if (!s->trials[j].skip && apng_same_trial(t, &s->trials[j], bpp))
+                t->skip = 1;
     }
 
-    s->sequence_number = best_sequence_number;
-    s->bytestream = original_bytestream + best_bytestream_size;
-    s->bytestream_end = original_bytestream_end;
-    if (best_bytestream != original_bytestream)
-        memcpy(original_bytestream, best_bytestream, best_bytestream_size);
+    avctx->execute(avctx, apng_encode_trial, s->trials, rets, APNG_NB_TRIALS, sizeof(*s->trials));
+    for (int i = 0; i < APNG_NB_TRIALS; i++) {
+        APNGTrial *t = &s->trials[i];
 
-    ret = 0;
+        if (rets[i] < 0)
+            return rets[i];
+        if (!t->skip && (!best || t->size < best->size))
+            best = t;
+    }
+    // APNG_BLEND_OP_SOURCE after APNG_DISPOSE_OP_NONE always succeeds
+    av_assert1(best);
 
-fail:
-    av_freep(&temp_bytestream);
-    av_frame_free(&diffFrame);
-    return ret;
+    *best_fctl_chunk      = best->fctl_chunk;
+    *best_last_fctl_chunk = best->last_fctl_chunk;
+    memcpy(s->bytestream, best->buf, best->size);
+    s->bytestream     += best->size;
+    s->sequence_number = best->enc.sequence_number;
+
+    return 0;
 }
 
 static int encode_apng(AVCodecContext *avctx, AVPacket *pkt,
@@ -1157,6 +1235,30 @@ static av_cold int png_enc_init(AVCodecContext *avctx)
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT
                       ? Z_DEFAULT_COMPRESSION
                       : av_clip(avctx->compression_level, 0, 9);
+
+    if (avctx->codec_id == AV_CODEC_ID_APNG) {
+        s->trials = av_calloc(APNG_NB_TRIALS, sizeof(*s->trials));
+        if (!s->trials)
+            return AVERROR(ENOMEM);
+
+        for (int i = 0; i < APNG_NB_TRIALS; i++) {
+            APNGTrial *t = &s->trials[i];
+            PNGEncContext *enc = &t->enc;
+            int ret;
+
+            enc->llvidencdsp    = s->llvidencdsp;
+            enc->filter_type    = s->filter_type;
+            enc->is_progressive = s->is_progressive;
+            enc->bits_per_pixel = s->bits_per_pixel;
+            if ((ret = ff_deflate_init(&enc->zstream, compression_level, avctx)) < 0)
+                return ret;
+
+            t->frame = av_frame_alloc();
+            if (!t->frame)
+                return AVERROR(ENOMEM);
+        }
+    }
+
     return ff_deflate_init(&s->zstream, compression_level, avctx);
 }
 
@@ -1165,6 +1267,12 @@ static av_cold int png_enc_close(AVCodecContext *avctx)
     PNGEncContext *s = avctx->priv_data;
 
     ff_deflate_end(&s->zstream);
+    for (int i = 0; s->trials && i < APNG_NB_TRIALS; i++) {
+        ff_deflate_end(&s->trials[i].enc.zstream);
+        av_frame_free(&s->trials[i].frame);
+        av_freep(&s->trials[i].buf);
+    }
+    av_freep(&s->trials);
     av_frame_free(&s->last_frame);
     av_frame_free(&s->prev_frame);
     av_freep(&s->last_frame_packet);
@@ -1224,6 +1332,7 @@ const FFCodec ff_apng_encoder = {
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_APNG,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
+                      AV_CODEC_CAP_SLICE_THREADS |
                       AV_CODEC_CAP_ENCODER_REORDERED_OPAQUE,
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
@@ -1238,5 +1347,5 @@ const FFCodec ff_apng_encoder = {
         AV_PIX_FMT_NONE
     },
     .p.priv_class   = &pngenc_class,
-    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES,
+    .caps_internal  = FF_CODEC_CAP_ICC_PROFILES | FF_CODEC_CAP_INIT_CLEANUP,
 };
@@ -0,0 +1,253 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Checks the LZW encoder against the original hash table based
+ * implementation. Pass any argument to also benchmark both.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/lfg.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "libavcodec/lzw.h"
+#include "libavcodec/put_bits.h"
+
+#define WIDTH  320
+#define HEIGHT 240
+#define BUF_SIZE (WIDTH * HEIGHT * 2 + 1000)
+
+#define REF_HASH_SIZE 16411
+#define REF_HASH_SHIFT 6
+#define REF_PREFIX_EMPTY -1
+#define REF_PREFIX_FREE -2
+
+typedef struct RefCode {
+    int hash_prefix;
+    int code;
+    uint8_t suffix;
+} RefCode;
+
+typedef struct RefLZWEncodeState {
+    RefCode tab[REF_HASH_SIZE];
+    int tabsize;
+    int bits;
+    PutBitContext pb;
+    int maxcode;
+    int last_code;
+    enum FF_LZW_MODES mode;
+    int little_endian;
+} RefLZWEncodeState;
+
+static int ref_hash(int head, const int add)
+{
+    head ^= add << REF_HASH_SHIFT;
+    if (head >= REF_HASH_SIZE)
+        head -= REF_HASH_SIZE;
+    return head;
+}
+
+static void ref_write_code(RefLZWEncodeState *s, int c)
+{
+    if (s->little_endian)
+        put_bits_le(&s->pb, s->bits, c);
+    else
+        put_bits(&s->pb, s->bits, c);
+}
+
+static int ref_find_code(RefLZWEncodeState *s, uint8_t c, int hash_prefix)
+{
+    int h = ref_hash(FFMAX(hash_prefix, 0), c);
+    int hash_offset = h ? REF_HASH_SIZE - h : 1;
+
+    while (s->tab[h].hash_prefix != REF_PREFIX_FREE) {
+        if (s->tab[h].suffix == c && s->tab[h].hash_prefix == hash_prefix)
+            return h;
+        h -= hash_offset;
+        if (h < 0)
+            h += REF_HASH_SIZE;
+    }
+    return h;
+}
+
+static void ref_clear_table(RefLZWEncodeState *s)
+{
+    ref_write_code(s, 256);
+    s->bits = 9;
+    for (int i = 0; i < REF_HASH_SIZE; i++)
+        s->tab[i].hash_prefix = REF_PREFIX_FREE;
+    for (int i = 0; i < 256; i++) {
+        int h = ref_hash(0, i);
+        s->tab[h].code        = i;
+        s->tab[h].suffix      = i;
+        s->tab[h].hash_prefix = REF_PREFIX_EMPTY;
+    }
+    s->tabsize = 258;
+}
+
+static void ref_encode_init(RefLZWEncodeState *s, uint8_t *outbuf, int outsize,
+                            enum FF_LZW_MODES mode, int little_endian)
+{
+    init_put_bits(&s->pb, outbuf, outsize);
+    s->maxcode       = 1 << 12;
+    s->last_code     = REF_PREFIX_EMPTY;
+    s->bits          = 9;
+    s->mode          = mode;
+    s->little_endian = little_endian;
+}
+
+static void ref_encode(RefLZWEncodeState *s, const uint8_t *inbuf, int insize)
+{
+    if (s->last_code == REF_PREFIX_EMPTY)
+        ref_clear_table(s);
+
+    for (int i = 0; i < insize; i++) {
+        uint8_t c = *inbuf++;
+        int code = ref_find_code(s, c, s->last_code);
+        if (s->tab[code].hash_prefix == REF_PREFIX_FREE) {
+            ref_write_code(s, s->last_code);
+            s->tab[code].code        = s->tabsize;
+            s->tab[code].suffix      = c;
+            s->tab[code].hash_prefix = s->last_code;
+            s->tabsize++;
+            if (s->tabsize >= (1 << s->bits) + (s->mode == FF_LZW_GIF))
+                s->bits++;
+            code = ref_hash(0, c);
+        }
+        s->last_code = s->tab[code].code;
+        if (s->tabsize >= s->maxcode - 1)
+            ref_clear_table(s);
+    }
+}
+
+static int ref_encode_flush(RefLZWEncodeState *s)
+{
+    ref_write_code(s, s->last_code);
+    ref_write_code(s, 257);
+    if (s->little_endian) {
+        if (s->mode == FF_LZW_GIF)
+            put_bits_le(&s->pb, 1, 0);
+        flush_put_bits_le(&s->pb);
+    } else {
+        if (s->mode == FF_LZW_GIF)
+            put_bits(&s->pb, 1, 0);
+        flush_put_bits(&s->pb);
+    }
+    return put_bytes_output(&s->pb);
+}
+
+static int encode_ref(RefLZWEncodeState *s, uint8_t *out, const uint8_t *img,
+                      enum FF_LZW_MODES mode, int little_endian)
+{
+    ref_encode_init(s, out, BUF_SIZE, mode, little_endian);
+    for (int y = 0; y < HEIGHT; y++)
+        ref_encode(s, img + y * WIDTH, WIDTH);
+    return ref_encode_flush(s);
+}
+
+static int encode_new(struct LZWEncodeState *s, uint8_t *out, const uint8_t *img,
+                      enum FF_LZW_MODES mode, int little_endian)
+{
+    int len = 0;
+
+    ff_lzw_encode_init(s, out, BUF_SIZE, 12, mode, little_endian);
+    for (int y = 0; y < HEIGHT; y++)
+        len += ff_lzw_encode(s, img + y * WIDTH, WIDTH);
+    return len + ff_lzw_encode_flush(s);
+}
+
+static void fill_image(uint8_t *img, int type, AVLFG *prng)
+{
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint8_t *p = &img[y * WIDTH + x];
+            switch (type) {
+            case 0: *p = av_lfg_get(prng);                       break;
+            case 1: *p = av_lfg_get(prng) % 7;                   break;
+            case 2: *p = (x / 16 + y / 16) & 15;                 break;
+            case 3: *p = (x * y) >> 5 ^ (av_lfg_get(prng) & 1);  break;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const names[] = { "random", "7 colors", "blocks", "dithered" };
+    RefLZWEncodeState *ref = av_mallocz(sizeof(*ref));
+    struct LZWEncodeState *lzw = av_mallocz(ff_lzw_encode_state_size);
+    uint8_t *img  = av_malloc(WIDTH * HEIGHT);
+    uint8_t *out0 = av_malloc(BUF_SIZE);
+    uint8_t *out1 = av_malloc(BUF_SIZE);
+    int bench = argc > 1, ret = 0;
+    AVLFG prng;
+
+    if (!ref || !lzw || !img || !out0 || !out1) {
+        ret = 1;
+        goto end;
+    }
+
+    av_lfg_init(&prng, 1);
+    for (int type = 0; type < FF_ARRAY_ELEMS(names); type++) {
+        fill_image(img, type, &prng);
+        for (int le = 0; le < 2; le++) {
+            enum FF_LZW_MODES mode = le ? FF_LZW_GIF : FF_LZW_TIFF;
+            int len0 = encode_ref(ref, out0, img, mode, le);
+            int len1 = encode_new(lzw, out1, img, mode, le);
+
+            if (len0 != len1 || memcmp(out0, out1, len0)) {
+                av_log(NULL, AV_LOG_ERROR, "mismatch on %s image, %s mode: %d != %d bytes\n",
+                       names[type], le ? "GIF" : "TIFF", len1, len0);
+                ret = 1;
+                continue;
+            }
+
+            if (bench) {
+                int64_t t0, t1;
+
+                t0 = av_gettime_relative();
+                for (int i = 0; i < 100; i++)
+                    encode_ref(ref, out0, img, mode, le);
+                t0 = av_gettime_relative() - t0;
+
+                t1 = av_gettime_relative();
+                for (int i = 0; i < 100; i++)
+                    encode_new(lzw, out1, img, mode, le);
+                t1 = av_gettime_relative() - t1;
+
+                printf("%-9s %-4s: hash %6.1f MB/s, direct %6.1f MB/s\n",
+                       names[type], le ? "GIF" : "TIFF",
+                       100.0 * WIDTH * HEIGHT / t0, 100.0 * WIDTH * HEIGHT / t1);
+            }
+        }
+    }
+
+end:
+    av_free(ref);
+    av_free(lzw);
+    av_free(img);
+    av_free(out0);
+    av_free(out1);
+    return ret;
+}
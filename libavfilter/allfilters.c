@@ -601,6 +601,7 @@ extern const AVFilter ff_vsrc_ebsnapchat;
 extern const AVFilter ff_vsrc_ebsnapchatref;
 extern const AVFilter ff_vsrc_ebmeme;
 extern const AVFilter ff_vsrc_ebmemeref;
+extern const AVFilter ff_vf_ebvips;
 
 /* those filters are part of public or internal API,
  * they are formatted to not be found by the grep
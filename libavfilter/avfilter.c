@@ -19,6 +19,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+
+#include <time.h>
+
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -33,6 +37,7 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/rational.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/time.h"
 
 #define FF_INTERNAL_FIELDS 1
 #include "framequeue.h"
@@ -189,6 +194,42 @@ int avfilter_link(AVFilterContext *src, unsigned srcpad,
     return 0;
 }
 
+const AVFilterStats *avfilter_get_stats(const AVFilterContext *filter)
+{
+    return filter->graph ? &filter->internal->stats : NULL;
+}
+
+const AVFilterStats *avfilter_link_get_stats(const AVFilterLink *link)
+{
+    return &link->stats;
+}
+
+static int stats_enabled(const AVFilterContext *filter)
+{
+    return filter->graph && filter->graph->stats;
+}
+
+static int64_t gettime_ns(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#else
+    return av_gettime_relative() * 1000;
+#endif
+}
+
+static int64_t thread_cpu_time_ns(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#endif
+    return 0;
+}
+
 void avfilter_link_free(AVFilterLink **link)
 {
     if (!*link)
@@ -203,7 +244,18 @@ void avfilter_link_free(AVFilterLink **link)
 
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
-    filter->ready = FFMAX(filter->ready, priority);
+    AVFilterGraph *graph = filter->graph;
+
+    if (!graph) {
+        filter->ready = FFMAX(filter->ready, priority);
+        return;
+    }
+    ff_filter_graph_lock(graph);
+    if (priority > filter->ready) {
+        filter->ready = priority;
+        ff_filter_graph_update_ready(graph, filter);
+    }
+    ff_filter_graph_unlock(graph);
 }
 
 /**
@@ -214,8 +266,12 @@ static void filter_unblock(AVFilterContext *filter)
 {
     unsigned i;
 
+    if (filter->graph)
+        ff_filter_graph_lock(filter->graph);
     for (i = 0; i < filter->nb_outputs; i++)
         filter->outputs[i]->frame_blocked_in = 0;
+    if (filter->graph)
+        ff_filter_graph_unlock(filter->graph);
 }
 
 
@@ -671,6 +727,7 @@ AVFilterContext *ff_filter_alloc(const AVFilter *filter, const char *inst_name)
     if (!ret->internal)
         goto err;
     ret->internal->execute = default_execute;
+    ret->internal->ready_index = -1;
 
     ret->nb_inputs  = filter->nb_inputs;
     if (ret->nb_inputs ) {
@@ -1018,6 +1075,19 @@ FF_ENABLE_DEPRECATION_WARNINGS
         av_frame_free(&frame);
         return ret;
     }
+    if (stats_enabled(link->src)) {
+        AVFilterStats *stats = &link->src->internal->stats;
+        uint64_t size = ff_framequeue_frame_size(frame);
+
+        stats->frames_out++;
+        stats->bytes_out += size;
+        link->stats.frames_in++;
+        link->stats.bytes_in += size;
+        link->stats.max_queued_frames = FFMAX(link->stats.max_queued_frames,
+                                              ff_framequeue_queued_frames(&link->fifo));
+        link->stats.max_queued_bytes  = FFMAX(link->stats.max_queued_bytes,
+                                              link->fifo.queued_bytes);
+    }
     ff_filter_set_ready(link->dst, 300);
     return 0;
 
@@ -1041,7 +1111,9 @@ static int take_samples(AVFilterLink *link, unsigned min, unsigned max,
     int ret;
 
     /* Note: this function relies on no format changes and must only be
-       called with enough samples. */
+       called with enough samples.
+       Audio frames are never spilled, so their data need not be loaded
+       before they are peeked at or taken. */
     av_assert1(samples_ready(link, link->min_samples));
     frame0 = frame = ff_framequeue_peek(&link->fifo, 0);
     if (!link->fifo.samples_skipped && frame->nb_samples >= min && frame->nb_samples <= max) {
@@ -1250,7 +1322,8 @@ static int ff_filter_activate_default(AVFilterContext *filter)
      ff_avfilter_link_set_out_status().
 
    Filters are activated according to the ready field, set using the
-   ff_filter_set_ready(). Eventually, a priority queue will be used.
+   ff_filter_set_ready() function, which keeps the ready filters of the graph
+   in a priority queue.
    ff_filter_set_ready() is called whenever anything could cause progress to
    be possible. Marking a filter ready when it is not is not a problem,
    except for the small overhead it causes.
@@ -1312,6 +1385,29 @@ static int ff_filter_activate_default(AVFilterContext *filter)
      [buffersrc1][testsrc1][buffersrc2][testsrc2]concat=v=2).
  */
 
+/**
+ * Check if the activation of a filter must be held back because one of its
+ * outputs is over its frame queue budget, and remember it for
+ * relieve_budgets() in that case.
+ */
+static int budget_hold_back(AVFilterContext *filter)
+{
+    const FFFrameQueueGlobal *fqg;
+
+    if (!filter->graph || filter->internal->budget_exceed)
+        return 0;
+    fqg = &filter->graph->internal->frame_queues;
+    if (!fqg->max_queue_bytes && !fqg->max_bytes)
+        return 0;
+    for (unsigned i = 0; i < filter->nb_outputs; i++) {
+        if (ff_framequeue_over_budget(&filter->outputs[i]->fifo)) {
+            filter->internal->budget_blocked = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int ff_filter_activate(AVFilterContext *filter)
 {
     int ret;
@@ -1319,9 +1415,32 @@ int ff_filter_activate(AVFilterContext *filter)
     /* Generic timeline support is not yet implemented but should be easy */
     av_assert1(!(filter->filter->flags & AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC &&
                  filter->filter->activate));
-    filter->ready = 0;
-    ret = filter->filter->activate ? filter->filter->activate(filter) :
-          ff_filter_activate_default(filter);
+    if (filter->graph) {
+        ff_filter_graph_lock(filter->graph);
+        filter->ready = 0;
+        ff_filter_graph_update_ready(filter->graph, filter);
+        ff_filter_graph_unlock(filter->graph);
+    } else {
+        filter->ready = 0;
+    }
+    /* Let the rest of the graph drain the outputs first,
+       relieve_budgets() activates the filter again. */
+    if (budget_hold_back(filter))
+        return 0;
+    if (stats_enabled(filter)) {
+        AVFilterStats *stats = &filter->internal->stats;
+        int64_t time = gettime_ns(), cpu_time = thread_cpu_time_ns();
+
+        ret = filter->filter->activate ? filter->filter->activate(filter) :
+              ff_filter_activate_default(filter);
+        stats->nb_activations++;
+        stats->time     += gettime_ns() - time;
+        stats->cpu_time += thread_cpu_time_ns() - cpu_time;
+    } else {
+        ret = filter->filter->activate ? filter->filter->activate(filter) :
+              ff_filter_activate_default(filter);
+    }
+    filter->internal->budget_exceed = 0;
     if (ret == FFERROR_NOT_READY)
         ret = 0;
     return ret;
@@ -1371,15 +1490,27 @@ static void consume_update(AVFilterLink *link, const AVFrame *frame)
     link->dst->is_disabled = !ff_inlink_evaluate_timeline_at_frame(link, frame);
     link->frame_count_out++;
     link->sample_count_out += frame->nb_samples;
+    if (stats_enabled(link->dst)) {
+        AVFilterStats *stats = &link->dst->internal->stats;
+        uint64_t size = ff_framequeue_frame_size(frame);
+
+        stats->frames_in++;
+        stats->bytes_in += size;
+        link->stats.frames_out++;
+        link->stats.bytes_out += size;
+    }
 }
 
 int ff_inlink_consume_frame(AVFilterLink *link, AVFrame **rframe)
 {
     AVFrame *frame;
+    int ret;
 
     *rframe = NULL;
     if (!ff_inlink_check_available_frame(link))
         return 0;
+    if ((ret = ff_framequeue_load(&link->fifo, 0, link->dst)) < 0)
+        return ret;
 
     if (link->fifo.samples_skipped) {
         frame = ff_framequeue_peek(&link->fifo, 0);
@@ -1414,6 +1545,14 @@ int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
 
 AVFrame *ff_inlink_peek_frame(AVFilterLink *link, size_t idx)
 {
+    int ret = ff_framequeue_load(&link->fifo, idx, link->dst);
+
+    if (ret < 0) {
+        /* the data can not be read back, close the link with the error so
+           that the filter forwards it when it acknowledges the status */
+        ff_inlink_set_status(link, ret);
+        return NULL;
+    }
     return ff_framequeue_peek(&link->fifo, idx);
 }
 
@@ -1509,7 +1648,11 @@ void ff_inlink_set_status(AVFilterLink *link, int status)
     if (link->status_out)
         return;
     link->frame_wanted_out = 0;
+    if (link->graph)
+        ff_filter_graph_lock(link->graph);
     link->frame_blocked_in = 0;
+    if (link->graph)
+        ff_filter_graph_unlock(link->graph);
     ff_avfilter_link_set_out_status(link, status, AV_NOPTS_VALUE);
     while (ff_framequeue_queued_frames(&link->fifo)) {
            AVFrame *frame = ff_framequeue_take(&link->fifo);
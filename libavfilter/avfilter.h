@@ -391,6 +391,14 @@ unsigned avfilter_filter_pad_count(const AVFilter *filter, int is_output);
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Activate filters which do not share a link concurrently, e.g. the branches
+ * following a split. Only meaningful in AVFilterGraph.thread_type; it is not
+ * enabled by default. Slice threading is not available to filters while they
+ * are activated concurrently with others.
+ */
+#define AVFILTER_THREAD_GRAPH (1 << 1)
+
 typedef struct AVFilterInternal AVFilterInternal;
 
 /** An instance of a filter */
@@ -516,6 +524,58 @@ typedef struct AVFilterFormatsConfig {
 
 } AVFilterFormatsConfig;
 
+/**
+ * Statistics collected on the filters and links of a graph while
+ * AVFilterGraph.stats is set.
+ *
+ * sizeof(AVFilterStats) is not a part of the public ABI, new fields may be
+ * added at the end with minor version bumps.
+ */
+typedef struct AVFilterStats {
+    /**
+     * Number of times the filter was activated. Always 0 for links.
+     */
+    uint64_t nb_activations;
+
+    /**
+     * Wall clock time spent activating the filter, in nanoseconds.
+     * Always 0 for links.
+     */
+    int64_t time;
+
+    /**
+     * CPU time used by the thread activating the filter, in nanoseconds.
+     * Jobs run by slice threading on other threads are not accounted.
+     * Always 0 for links, and where the CPU time of a thread can not be
+     * measured.
+     */
+    int64_t cpu_time;
+
+    /**
+     * Number of frames, and total size of their buffers in bytes, taken by
+     * the filter from its inputs, or sent on the link by its source filter.
+     */
+    uint64_t frames_in;
+    uint64_t bytes_in;
+
+    /**
+     * Number of frames, and total size of their buffers in bytes, sent by
+     * the filter on its outputs, or taken from the link by its destination
+     * filter.
+     */
+    uint64_t frames_out;
+    uint64_t bytes_out;
+
+    /**
+     * Peak number of frames queued on the link, and peak size of their
+     * buffers in bytes. Frames spilled to disk are not counted.
+     * For avfilter_graph_get_stats(), the peaks over all the links of the
+     * graph at once. Always 0 for filters.
+     */
+    uint64_t max_queued_frames;
+    uint64_t max_queued_bytes;
+} AVFilterStats;
+
 /**
  * A link between two filters. This contains pointers to the source and
  * destination filters between which this link exists, and the indexes of
@@ -710,6 +770,11 @@ struct AVFilterLink {
      */
     int status_out;
 
+    /**
+     * Statistics of the link, see AVFilterGraph.stats.
+     */
+    AVFilterStats stats;
+
 #endif /* FF_INTERNAL_FIELDS */
 
 };
@@ -731,6 +796,23 @@ int avfilter_link(AVFilterContext *src, unsigned srcpad,
  */
 void avfilter_link_free(AVFilterLink **link);
 
+/**
+ * Get the statistics collected on a filter of a graph.
+ *
+ * @return the statistics, valid until the filter is freed, or NULL if the
+ *         filter is not in a graph
+ * @see AVFilterGraph.stats
+ */
+const AVFilterStats *avfilter_get_stats(const AVFilterContext *filter);
+
+/**
+ * Get the statistics collected on a link of a graph.
+ *
+ * @return the statistics, valid until the link is freed
+ * @see AVFilterGraph.stats
+ */
+const AVFilterStats *avfilter_link_get_stats(const AVFilterLink *link);
+
 /**
  * Negotiate the media format, dimensions, etc of all inputs to a filter.
  *
@@ -873,12 +955,17 @@ typedef struct AVFilterGraph {
      * of AVFILTER_THREAD_* flags.
      *
      * May be set by the caller at any point, the setting will apply to all
-     * filters initialized after that. The default is allowing everything.
+     * filters initialized after that. The default is allowing everything
+     * except AVFILTER_THREAD_GRAPH.
      *
      * When a filter in this graph is initialized, this field is combined using
      * bit AND with AVFilterContext.thread_type to get the final mask used for
      * determining allowed threading types. I.e. a threading type needs to be
      * set in both to be allowed.
+     *
+     * AVFILTER_THREAD_GRAPH applies to the whole graph instead and must be set
+     * before adding any filters to the graph. It is not used when the graph
+     * has a single thread or a custom execute callback.
      */
     int thread_type;
 
@@ -917,6 +1004,39 @@ typedef struct AVFilterGraph {
 
     char *aresample_swr_opts; ///< swr options to use for the auto-inserted aresample filters, Access ONLY through AVOptions
 
+    /**
+     * If nonzero, collect statistics about the activity of the filters and
+     * links of this graph, see avfilter_get_stats() and
+     * avfilter_link_get_stats(). May be set by the caller at any point, only
+     * the activity while it is set is accounted. Disabled by default.
+     */
+    int stats;
+
+    /**
+     * Budget, in bytes of frame buffers, of the frames queued on each link.
+     * While a link is over budget, the filter feeding it is not activated,
+     * letting the rest of the graph drain it first. If the graph
+     * can not progress otherwise, the link is spilled to disk if spill is
+     * set, or the budget is exceeded. 0 for no limit, the default.
+     * Must be set before avfilter_graph_config().
+     */
+    int64_t max_link_bytes;
+
+    /**
+     * Budget, in bytes of frame buffers, of the frames queued on all the
+     * links of the graph together. While it is exceeded, every link holding
+     * frames is over budget, as described for max_link_bytes.
+     * 0 for no limit, the default. Must be set before avfilter_graph_config().
+     */
+    int64_t max_queued_bytes;
+
+    /**
+     * If nonzero, the video frames queued on links over budget are moved to a
+     * temporary file when the graph can not progress otherwise, instead of
+     * exceeding the budget. Disabled by default.
+     */
+    int spill;
+
     /**
      * Private fields
      *
@@ -1006,6 +1126,18 @@ enum {
  */
 int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx);
 
+/**
+ * Get the statistics of a whole graph: nb_activations, time and cpu_time are
+ * the sums over its filters, max_queued_frames and max_queued_bytes the
+ * peaks of the frames queued on all its links at once, which are collected
+ * if AVFilterGraph.stats or AVFilterGraph.max_queued_bytes is set when the
+ * graph is configured. The other fields are 0.
+ *
+ * @return the statistics, valid until the next call or until the graph is
+ *         freed
+ */
+const AVFilterStats *avfilter_graph_get_stats(AVFilterGraph *graph);
+
 /**
  * Free a graph, destroy its links, and set *graph to NULL.
  * If *graph is NULL, do nothing.
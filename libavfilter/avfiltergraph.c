@@ -36,6 +36,7 @@
 
 #include "avfilter.h"
 #include "buffersink.h"
+#include "filters.h"
 #include "formats.h"
 #include "internal.h"
 #include "thread.h"
@@ -48,6 +49,7 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "graph", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_GRAPH }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, F|V|A, "threads"},
         {"auto", "autodetect a suitable number of threads to use", 0, AV_OPT_TYPE_CONST, {.i64 = 0 }, .flags = F|V|A, .unit = "threads"},
@@ -55,6 +57,14 @@ static const AVOption filtergraph_options[] = {
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|V },
     {"aresample_swr_opts"   , "default aresample filter options"    , OFFSET(aresample_swr_opts)    ,
         AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, F|A },
+    { "stats",       "Collect statistics about the filters and links", OFFSET(stats), AV_OPT_TYPE_BOOL,
+        { .i64 = 0 }, 0, 1, F|V|A },
+    { "max_link_bytes",   "Budget of the frames queued on each link", OFFSET(max_link_bytes), AV_OPT_TYPE_INT64,
+        { .i64 = 0 }, 0, INT64_MAX, F|V|A },
+    { "max_queued_bytes", "Budget of the frames queued on all links", OFFSET(max_queued_bytes), AV_OPT_TYPE_INT64,
+        { .i64 = 0 }, 0, INT64_MAX, F|V|A },
+    { "spill",       "Spill the frames queued on links over budget to disk", OFFSET(spill), AV_OPT_TYPE_BOOL,
+        { .i64 = 0 }, 0, 1, F|V|A },
     { NULL },
 };
 
@@ -77,6 +87,11 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     graph->nb_threads  = 1;
     return 0;
 }
+
+int ff_graph_thread_busy(AVFilterGraph *graph)
+{
+    return 0;
+}
 #endif
 
 AVFilterGraph *avfilter_graph_alloc(void)
@@ -93,19 +108,104 @@ AVFilterGraph *avfilter_graph_alloc(void)
 
     ret->av_class = &filtergraph_class;
     av_opt_set_defaults(ret);
-    ff_framequeue_global_init(&ret->internal->frame_queues);
+    if (ff_framequeue_global_init(&ret->internal->frame_queues) < 0) {
+        av_freep(&ret->internal);
+        av_freep(&ret);
+        return NULL;
+    }
 
     return ret;
 }
 
+static int ready_before(const AVFilterContext *a, const AVFilterContext *b)
+{
+    return a->ready > b->ready ||
+           (a->ready == b->ready && a->internal->graph_index < b->internal->graph_index);
+}
+
+static void ready_bubble_up(AVFilterGraphInternal *graphi,
+                            AVFilterContext *filter, int index)
+{
+    AVFilterContext **filters = graphi->ready_filters;
+
+    while (index) {
+        int parent = (index - 1) >> 1;
+        if (!ready_before(filter, filters[parent]))
+            break;
+        filters[index] = filters[parent];
+        filters[index]->internal->ready_index = index;
+        index = parent;
+    }
+    filters[index] = filter;
+    filter->internal->ready_index = index;
+}
+
+static void ready_bubble_down(AVFilterGraphInternal *graphi,
+                              AVFilterContext *filter, int index)
+{
+    AVFilterContext **filters = graphi->ready_filters;
+
+    while (1) {
+        int child = 2 * index + 1;
+        if (child >= graphi->nb_ready_filters)
+            break;
+        if (child + 1 < graphi->nb_ready_filters &&
+            ready_before(filters[child + 1], filters[child]))
+            child++;
+        if (!ready_before(filters[child], filter))
+            break;
+        filters[index] = filters[child];
+        filters[index]->internal->ready_index = index;
+        index = child;
+    }
+    filters[index] = filter;
+    filter->internal->ready_index = index;
+}
+
+static void ready_heap_remove(AVFilterGraphInternal *graphi, AVFilterContext *filter)
+{
+    int index = filter->internal->ready_index;
+
+    if (index < 0)
+        return;
+    filter->internal->ready_index = -1;
+    if (index == --graphi->nb_ready_filters)
+        return;
+    filter = graphi->ready_filters[graphi->nb_ready_filters];
+    ready_bubble_up  (graphi, filter, index);
+    ready_bubble_down(graphi, filter, filter->internal->ready_index);
+}
+
+void ff_filter_graph_update_ready(AVFilterGraph *graph, AVFilterContext *filter)
+{
+    AVFilterGraphInternal *graphi = graph->internal;
+    int index = filter->internal->ready_index;
+
+    if (!filter->ready) {
+        ready_heap_remove(graphi, filter);
+        return;
+    }
+    if (index < 0)
+        index = graphi->nb_ready_filters++;
+    ready_bubble_up  (graphi, filter, index);
+    ready_bubble_down(graphi, filter, filter->internal->ready_index);
+}
+
 void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
     int i, j;
     for (i = 0; i < graph->nb_filters; i++) {
         if (graph->filters[i] == filter) {
+            ready_heap_remove(graph->internal, filter);
             FFSWAP(AVFilterContext*, graph->filters[i],
                    graph->filters[graph->nb_filters - 1]);
             graph->nb_filters--;
+            if (i < graph->nb_filters) {
+                AVFilterContext *moved = graph->filters[i];
+                moved->internal->graph_index = i;
+                if (moved->ready)
+                    ff_filter_graph_update_ready(graph, moved);
+            }
             filter->graph = NULL;
             for (j = 0; j<filter->nb_outputs; j++)
                 if (filter->outputs[j])
@@ -127,6 +227,12 @@ void avfilter_graph_free(AVFilterGraph **graph)
     ff_graph_thread_free(*graph);
 
     av_freep(&(*graph)->sink_links);
+    av_freep(&(*graph)->internal->ready_filters);
+    if ((*graph)->internal->wave)
+        ff_mutex_destroy(&(*graph)->internal->lock);
+    av_freep(&(*graph)->internal->wave);
+    av_freep(&(*graph)->internal->wave_rets);
+    ff_framequeue_global_uninit(&(*graph)->internal->frame_queues);
 
     av_opt_free(*graph);
 
@@ -162,6 +268,30 @@ void avfilter_graph_set_auto_convert(AVFilterGraph *graph, unsigned flags)
     graph->disable_auto_convert = flags;
 }
 
+static int graph_threading_init(AVFilterGraph *graph)
+{
+    AVFilterGraphInternal *graphi = graph->internal;
+    int ret;
+
+    graphi->wave      = av_malloc_array(graph->nb_threads, sizeof(*graphi->wave));
+    graphi->wave_rets = av_malloc_array(graph->nb_threads, sizeof(*graphi->wave_rets));
+    if (!graphi->wave || !graphi->wave_rets) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    ret = ff_mutex_init(&graphi->lock, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    av_freep(&graphi->wave);
+    av_freep(&graphi->wave_rets);
+    return ret;
+}
+
 AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
                                              const AVFilter *filter,
                                              const char *name)
@@ -171,6 +301,7 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
     if (graph->thread_type && !graph->internal->thread_execute) {
         if (graph->execute) {
             graph->internal->thread_execute = graph->execute;
+            graph->thread_type &= ~AVFILTER_THREAD_GRAPH;
         } else {
             int ret = ff_graph_thread_init(graph);
             if (ret < 0) {
@@ -178,6 +309,9 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
                 return NULL;
             }
         }
+        if (graph->thread_type & AVFILTER_THREAD_GRAPH &&
+            graph_threading_init(graph) < 0)
+            return NULL;
     }
 
     filters = av_realloc_array(graph->filters, graph->nb_filters + 1, sizeof(*filters));
@@ -185,10 +319,17 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
         return NULL;
     graph->filters = filters;
 
+    filters = av_realloc_array(graph->internal->ready_filters,
+                               graph->nb_filters + 1, sizeof(*filters));
+    if (!filters)
+        return NULL;
+    graph->internal->ready_filters = filters;
+
     s = ff_filter_alloc(filter, name);
     if (!s)
         return NULL;
 
+    s->internal->graph_index = graph->nb_filters;
     graph->filters[graph->nb_filters++] = s;
 
     s->graph = graph;
@@ -1181,6 +1322,11 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
     if ((ret = graph_config_pointers(graphctx, log_ctx)))
         return ret;
 
+    graphctx->internal->frame_queues.max_queue_bytes = graphctx->max_link_bytes;
+    graphctx->internal->frame_queues.max_bytes       = graphctx->max_queued_bytes;
+    graphctx->internal->frame_queues.accounting      = graphctx->stats ||
+                                                       graphctx->max_queued_bytes;
+
     return 0;
 }
 
@@ -1338,17 +1484,166 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+void ff_filter_graph_lock(AVFilterGraph *graph)
+{
+    if (graph->internal->parallel)
+        ff_mutex_lock(&graph->internal->lock);
+}
+
+void ff_filter_graph_unlock(AVFilterGraph *graph)
+{
+    if (graph->internal->parallel)
+        ff_mutex_unlock(&graph->internal->lock);
+}
+
+int ff_filter_execute_serial(AVFilterContext *ctx)
+{
+    return ctx->graph && ff_graph_thread_busy(ctx->graph);
+}
+
+/**
+ * Mark a filter and its neighbours as unavailable for the current wave.
+ */
+static void wave_mark(AVFilterContext *filter, unsigned wave_id)
+{
+    filter->internal->wave_id = wave_id;
+    for (unsigned i = 0; i < filter->nb_inputs; i++)
+        filter->inputs[i]->src->internal->wave_id = wave_id;
+    for (unsigned i = 0; i < filter->nb_outputs; i++)
+        filter->outputs[i]->dst->internal->wave_id = wave_id;
+}
+
+/**
+ * Pick ready filters which can be activated concurrently with the most
+ * urgent one.
+ *
+ * A filter only touches its own links and, through ff_filter_set_ready() and
+ * the frame_blocked_in fields, the state of its neighbours, which is
+ * protected by ff_filter_graph_lock(). Filters sharing a link are never
+ * picked together, and neither are two sinks, which would both update the
+ * age heap of the sink links.
+ */
+static int wave_pick(AVFilterGraph *graph)
+{
+    AVFilterGraphInternal *graphi = graph->internal;
+    /* the heap is not sorted, but its first entries are the most urgent ones */
+    const int nb_candidates = FFMIN(graphi->nb_ready_filters, 4 * graph->nb_threads);
+    unsigned wave_id = ++graphi->wave_id;
+    int nb_filters = 0, sink = 0;
+
+    for (int i = 0; i < nb_candidates && nb_filters < graph->nb_threads; i++) {
+        AVFilterContext *filter = graphi->ready_filters[i];
+
+        if (filter->internal->wave_id == wave_id ||
+            (sink && !filter->nb_outputs))
+            continue;
+        sink |= !filter->nb_outputs;
+        wave_mark(filter, wave_id);
+        graphi->wave[nb_filters++] = filter;
+    }
+
+    return nb_filters;
+}
+
+static int activate_job(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AVFilterContext **wave = arg;
+
+    return ff_filter_activate(wave[jobnr]);
+}
+
+/**
+ * Activate again the filters held back by the frame queue budgets, when no
+ * filter is ready: spill their outputs over budget if allowed, and let them
+ * exceed the budget once if they are still over.
+ */
+static int relieve_budgets(AVFilterGraph *graph)
+{
+    AVFilterGraphInternal *graphi = graph->internal;
+    int progress = 0;
+
+    if (!graph->max_link_bytes && !graph->max_queued_bytes)
+        return AVERROR(EAGAIN);
+
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        int over = 0;
+
+        if (!filter->internal->budget_blocked)
+            continue;
+        filter->internal->budget_blocked = 0;
+
+        for (unsigned j = 0; j < filter->nb_outputs; j++) {
+            AVFilterLink *link = filter->outputs[j];
+
+            /* the filter may have been held back in the middle of a request */
+            link->frame_blocked_in = 0;
+            if (!ff_framequeue_over_budget(&link->fifo))
+                continue;
+            if (graph->spill) {
+                int ret = ff_framequeue_spill(&link->fifo, link->dst);
+                if (ret < 0)
+                    return ret;
+                if (ret)
+                    av_log(link->dst, AV_LOG_DEBUG, "Spilled %d frames of input '%s'.\n",
+                           ret, link->dstpad->name);
+            }
+            over |= ff_framequeue_over_budget(&link->fifo);
+        }
+
+        if (over) {
+            if (!graphi->budget_exceeded)
+                av_log(graph, AV_LOG_VERBOSE, "Exceeding the frame queue budget, "
+                       "the graph can not progress otherwise.\n");
+            graphi->budget_exceeded = 1;
+            filter->internal->budget_exceed = 1;
+        }
+        ff_filter_set_ready(filter, 100);
+        progress = 1;
+    }
+
+    return progress ? 0 : AVERROR(EAGAIN);
+}
+
+const AVFilterStats *avfilter_graph_get_stats(AVFilterGraph *graph)
+{
+    AVFilterGraphInternal *graphi = graph->internal;
+    AVFilterStats *stats = &graphi->stats;
+
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned i = 0; i < graph->nb_filters; i++) {
+        const AVFilterStats *fs = &graph->filters[i]->internal->stats;
+
+        stats->nb_activations += fs->nb_activations;
+        stats->time           += fs->time;
+        stats->cpu_time       += fs->cpu_time;
+    }
+    stats->max_queued_frames = atomic_load(&graphi->frame_queues.max_queued_frames);
+    stats->max_queued_bytes  = atomic_load(&graphi->frame_queues.max_queued_bytes);
+
+    return stats;
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
-    AVFilterContext *filter;
-    unsigned i;
+    AVFilterGraphInternal *graphi = graph->internal;
+    int nb_filters;
 
     av_assert0(graph->nb_filters);
-    filter = graph->filters[0];
-    for (i = 1; i < graph->nb_filters; i++)
-        if (graph->filters[i]->ready > filter->ready)
-            filter = graph->filters[i];
-    if (!filter->ready)
-        return AVERROR(EAGAIN);
-    return ff_filter_activate(filter);
+    if (!graphi->nb_ready_filters)
+        return relieve_budgets(graph);
+    av_assert1(graphi->ready_filters[0]->ready);
+    if (!graphi->wave || graphi->nb_ready_filters == 1 ||
+        (nb_filters = wave_pick(graph)) == 1)
+        return ff_filter_activate(graphi->ready_filters[0]);
+
+    graphi->parallel = 1;
+    graphi->thread_execute(graphi->wave[0], activate_job, graphi->wave,
+                           graphi->wave_rets, nb_filters);
+    graphi->parallel = 0;
+
+    for (int i = 0; i < nb_filters; i++)
+        if (graphi->wave_rets[i] < 0)
+            return graphi->wave_rets[i];
+    return 0;
 }
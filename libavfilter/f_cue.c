@@ -45,8 +45,13 @@ static int activate(AVFilterContext *ctx)
 
     if (ff_inlink_queued_frames(inlink)) {
         AVFrame *frame = ff_inlink_peek_frame(inlink, 0);
-        int64_t pts = av_rescale_q(frame->pts, inlink->time_base, AV_TIME_BASE_Q);
+        int64_t pts;
 
+        if (!frame) {
+            ff_filter_set_ready(ctx, 100);
+            return 0;
+        }
+        pts = av_rescale_q(frame->pts, inlink->time_base, AV_TIME_BASE_Q);
         if (!s->status) {
             s->first_pts = pts;
             s->status++;
@@ -63,6 +68,10 @@ static int activate(AVFilterContext *ctx)
         }
         if (s->status == 2) {
             frame = ff_inlink_peek_frame(inlink, ff_inlink_queued_frames(inlink) - 1);
+            if (!frame) {
+                ff_filter_set_ready(ctx, 100);
+                return 0;
+            }
             pts = av_rescale_q(frame->pts, inlink->time_base, AV_TIME_BASE_Q);
             if (!(pts - s->first_pts < s->buffer && (av_gettime() - s->cue) < 0))
                 s->status++;
@@ -103,6 +103,10 @@ static int activate(AVFilterContext *ctx)
                 continue;
 
             frame = ff_inlink_peek_frame(ctx->inputs[i], 0);
+            if (!frame) {
+                ff_filter_set_ready(ctx, 100);
+                return 0;
+            }
             if (frame->pts == AV_NOPTS_VALUE) {
                 int ret;
 
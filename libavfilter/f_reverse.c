@@ -18,17 +18,33 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
 #include "config_components.h"
 
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_MMAP && HAVE_POSIX_MADVISE
+#include <sys/mman.h>
+#endif
+
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/samplefmt.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "internal.h"
+#include "spillfile.h"
 #include "video.h"
 
 #define DEFAULT_LENGTH 300
+#define ALIGN FF_SPILL_ALIGN
 
 typedef struct ReverseContext {
+    const AVClass *class;
+    int64_t max_memory;
+
     int nb_frames;
     AVFrame **frames;
     unsigned int frames_size;
@@ -38,12 +54,33 @@ typedef struct ReverseContext {
     int64_t *duration;
     int flush_idx;
     int64_t nb_samples;
+
+    int64_t memory;             ///< size of the buffers of the frames held in memory
+    int64_t *offsets;           ///< position of each frame in the temporary file, -1 if in memory
+    unsigned int offsets_size;
+    FFSpillFile spill;          ///< temporary file the frames are spilled to
+    uint8_t *spill_buf;
+    unsigned int spill_buf_size;
+    AVBufferRef *map;           ///< mapping of the temporary file, once the input has ended
 } ReverseContext;
 
+#define OFFSET(x) offsetof(ReverseContext, x)
+#define FLAGS AV_OPT_FLAG_AUDIO_PARAM|AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption options[] = {
+    { "max_memory", "set the memory used to store frames before spilling them to a file, 0 for no limit",
+        OFFSET(max_memory), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS_EXT(reverse, "(a)reverse", options);
+
 static av_cold int init(AVFilterContext *ctx)
 {
     ReverseContext *s = ctx->priv;
 
+    ff_spill_file_init(&s->spill, "ffreverse");
+
     s->pts = av_fast_realloc(NULL, &s->pts_size,
                              DEFAULT_LENGTH * sizeof(*(s->pts)));
     if (!s->pts)
@@ -59,6 +96,11 @@ static av_cold int init(AVFilterContext *ctx)
     if (!s->frames)
         return AVERROR(ENOMEM);
 
+    s->offsets = av_fast_realloc(NULL, &s->offsets_size,
+                                 DEFAULT_LENGTH * sizeof(*(s->offsets)));
+    if (!s->offsets)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
@@ -74,6 +116,156 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->pts);
     av_freep(&s->duration);
     av_freep(&s->frames);
+    av_freep(&s->offsets);
+    av_freep(&s->spill_buf);
+    av_buffer_unref(&s->map);
+    ff_spill_file_uninit(&s->spill);
+}
+
+static int64_t frame_memory(const AVFrame *frame)
+{
+    int64_t size = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
+
+    return size;
+}
+
+/**
+ * Get the size of a frame's data stored contiguously in the temporary file.
+ */
+static int stored_size(const AVFrame *frame, enum AVMediaType type)
+{
+    if (type == AVMEDIA_TYPE_VIDEO)
+        return av_image_get_buffer_size(frame->format, frame->width, frame->height, ALIGN);
+
+    /* planes beyond the frame's data array would need their own allocation */
+    if (av_sample_fmt_is_planar(frame->format) &&
+        frame->ch_layout.nb_channels > AV_NUM_DATA_POINTERS)
+        return AVERROR(ENOSYS);
+    return av_samples_get_buffer_size(NULL, frame->ch_layout.nb_channels,
+                                      frame->nb_samples, frame->format, ALIGN);
+}
+
+/**
+ * Point the planes of a frame's data to its contiguous copy in buf.
+ */
+static int fill_arrays(const AVFrame *frame, enum AVMediaType type,
+                       uint8_t *data[AV_NUM_DATA_POINTERS], int linesize[AV_NUM_DATA_POINTERS],
+                       const uint8_t *buf)
+{
+    if (type == AVMEDIA_TYPE_VIDEO)
+        return av_image_fill_arrays(data, linesize, buf, frame->format,
+                                    frame->width, frame->height, ALIGN);
+    return av_samples_fill_arrays(data, linesize, buf, frame->ch_layout.nb_channels,
+                                  frame->nb_samples, frame->format, ALIGN);
+}
+
+/**
+ * Move the data of a frame to the temporary file, keeping its properties in memory.
+ *
+ * @return 1 if the frame was spilled, 0 if its data can not be stored in the
+ *         file, or a negative error code
+ */
+static int spill_frame(AVFilterContext *ctx, AVFrame *frame, int64_t *offset)
+{
+    ReverseContext *s = ctx->priv;
+    enum AVMediaType type = ctx->inputs[0]->type;
+    uint8_t *data[AV_NUM_DATA_POINTERS] = { NULL };
+    int linesize[AV_NUM_DATA_POINTERS] = { 0 };
+    int size, ret;
+
+    if (frame->hw_frames_ctx)
+        return 0;
+    size = stored_size(frame, type);
+    if (size < 0)
+        return 0;
+    size = FFALIGN(size, ALIGN);
+
+    av_fast_mallocz(&s->spill_buf, &s->spill_buf_size, size);
+    if (!s->spill_buf)
+        return AVERROR(ENOMEM);
+    ret = fill_arrays(frame, type, data, linesize, s->spill_buf);
+    if (ret < 0)
+        return ret;
+    if (type == AVMEDIA_TYPE_VIDEO)
+        av_image_copy(data, linesize, (const uint8_t **)frame->data, frame->linesize,
+                      frame->format, frame->width, frame->height);
+    else
+        av_samples_copy(data, frame->extended_data, 0, 0, frame->nb_samples,
+                        frame->ch_layout.nb_channels, frame->format);
+
+    /* nothing is released before the end, so the frames are stored one
+     * after the other */
+    ret = ff_spill_file_write(&s->spill, s->spill_buf, size, offset, ctx);
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf); i++)
+        av_buffer_unref(&frame->buf[i]);
+    memset(frame->data, 0, sizeof(frame->data));
+    memset(frame->linesize, 0, sizeof(frame->linesize));
+    frame->extended_data = frame->data;
+
+    return 1;
+}
+
+/**
+ * Ask the system to read the data of a spilled frame ahead of its use.
+ * The frame after it must be spilled too, its data ends where the next begins.
+ */
+static void prefetch_frame(ReverseContext *s, int idx)
+{
+#if HAVE_MMAP && HAVE_POSIX_MADVISE && HAVE_SYSCONF
+    const uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start;
+
+    if (idx < 0 || s->offsets[idx] < 0)
+        return;
+    start = (uintptr_t)(s->map->data + s->offsets[idx]);
+    posix_madvise((void *)(start & ~page_mask),
+                  s->offsets[idx + 1] - s->offsets[idx] + (start & page_mask),
+                  POSIX_MADV_WILLNEED);
+#endif
+}
+
+/**
+ * Take the last stored frame, reading its data back from the temporary file
+ * if it was spilled.
+ */
+static int pop_frame(AVFilterContext *ctx, AVFrame **out)
+{
+    ReverseContext *s = ctx->priv;
+    const int idx = s->nb_frames - 1;
+    AVFrame *frame = s->frames[idx];
+    int ret;
+
+    if (s->offsets[idx] >= 0) {
+        if (!s->map && (ret = ff_spill_file_map(&s->spill, &s->map, ctx)) < 0)
+            return ret;
+
+        frame->buf[0] = av_buffer_ref(s->map);
+        if (!frame->buf[0])
+            return AVERROR(ENOMEM);
+        ret = fill_arrays(frame, ctx->inputs[0]->type, frame->data, frame->linesize,
+                          s->map->data + s->offsets[idx]);
+        if (ret < 0)
+            return ret;
+
+        /* the next frame is likely spilled too, start reading it while this
+         * one is processed */
+        prefetch_frame(s, idx - 1);
+    } else {
+        s->memory -= frame_memory(frame);
+    }
+
+    s->frames[idx] = NULL;
+    s->nb_frames--;
+    *out = frame;
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
@@ -103,6 +295,24 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         s->frames = ptr;
     }
 
+    if (s->nb_frames + 1 > s->offsets_size / sizeof(*(s->offsets))) {
+        ptr = av_fast_realloc(s->offsets, &s->offsets_size, s->offsets_size * 2);
+        if (!ptr)
+            return AVERROR(ENOMEM);
+        s->offsets = ptr;
+    }
+
+    s->offsets[s->nb_frames] = -1;
+    if (s->max_memory && s->memory + frame_memory(in) > s->max_memory) {
+        int ret = spill_frame(ctx, in, &s->offsets[s->nb_frames]);
+        if (ret < 0) {
+            av_frame_free(&in);
+            return ret;
+        }
+    }
+    if (s->offsets[s->nb_frames] < 0)
+        s->memory += frame_memory(in);
+
     s->frames[s->nb_frames] = in;
     s->pts[s->nb_frames]    = in->pts;
     s->duration[s->nb_frames] = in->duration;
@@ -122,12 +332,13 @@ static int request_frame(AVFilterLink *outlink)
     ret = ff_request_frame(ctx->inputs[0]);
 
     if (ret == AVERROR_EOF && s->nb_frames > 0) {
-        AVFrame *out = s->frames[s->nb_frames - 1];
+        AVFrame *out;
+
+        if ((ret = pop_frame(ctx, &out)) < 0)
+            return ret;
         out->duration= s->duration[s->flush_idx];
         out->pts     = s->pts[s->flush_idx++];
         ret          = ff_filter_frame(outlink, out);
-        s->frames[s->nb_frames - 1] = NULL;
-        s->nb_frames--;
     }
 
     return ret;
@@ -153,6 +364,7 @@ const AVFilter ff_vf_reverse = {
     .name        = "reverse",
     .description = NULL_IF_CONFIG_SMALL("Reverse a clip."),
     .priv_size   = sizeof(ReverseContext),
+    .priv_class  = &reverse_class,
     .init        = init,
     .uninit      = uninit,
     FILTER_INPUTS(reverse_inputs),
@@ -266,7 +478,15 @@ static int areverse_request_frame(AVFilterLink *outlink)
     ret = ff_request_frame(ctx->inputs[0]);
 
     if (ret == AVERROR_EOF && s->nb_frames > 0) {
-        AVFrame *out = s->frames[s->nb_frames - 1];
+        AVFrame *out;
+
+        if ((ret = pop_frame(ctx, &out)) < 0)
+            return ret;
+        /* frames read back from the temporary file are not writable */
+        if ((ret = av_frame_make_writable(out)) < 0) {
+            av_frame_free(&out);
+            return ret;
+        }
         out->duration = s->duration[s->flush_idx];
         out->pts     = s->pts[s->flush_idx++] - s->nb_samples;
         s->nb_samples += s->pts[s->flush_idx] - s->pts[s->flush_idx - 1] - out->nb_samples;
@@ -276,8 +496,6 @@ static int areverse_request_frame(AVFilterLink *outlink)
         else
             reverse_samples_packed(out);
         ret = ff_filter_frame(outlink, out);
-        s->frames[s->nb_frames - 1] = NULL;
-        s->nb_frames--;
     }
 
     return ret;
@@ -304,6 +522,7 @@ const AVFilter ff_af_areverse = {
     .name          = "areverse",
     .description   = NULL_IF_CONFIG_SMALL("Reverse an audio clip."),
     .priv_size     = sizeof(ReverseContext),
+    .priv_class    = &reverse_class,
     .init          = init,
     .uninit        = uninit,
     FILTER_INPUTS(areverse_inputs),
@@ -118,7 +118,9 @@ int ff_inlink_consume_samples(AVFilterLink *link, unsigned min, unsigned max,
 /**
  * Access a frame in the link fifo without consuming it.
  * The first frame is numbered 0; the designated frame must exist.
- * @return the frame at idx position in the link fifo.
+ * @return the frame at idx position in the link fifo, or NULL if its data
+ *         could not be read back from the spill file, in which case the
+ *         link is closed with the error as status.
  */
 AVFrame *ff_inlink_peek_frame(AVFilterLink *link, size_t idx);
 
@@ -0,0 +1,125 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/buffer.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/rational.h"
+
+#include "framecache.h"
+
+static int same_buffer(const AVBufferRef *a, const AVBufferRef *b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->buffer == b->buffer;
+}
+
+int ff_frame_is_repeat(const AVFrame *prev, const AVFrame *frame)
+{
+    if (!frame->buf[0] || frame->hw_frames_ctx || frame->nb_extended_buf ||
+        prev->nb_extended_buf)
+        return 0;
+
+    if (frame->format != prev->format ||
+        frame->width  != prev->width  ||
+        frame->height != prev->height ||
+        frame->flags  != prev->flags  ||
+        frame->crop_top    != prev->crop_top    ||
+        frame->crop_bottom != prev->crop_bottom ||
+        frame->crop_left   != prev->crop_left   ||
+        frame->crop_right  != prev->crop_right  ||
+        frame->color_range     != prev->color_range     ||
+        frame->color_primaries != prev->color_primaries ||
+        frame->color_trc       != prev->color_trc       ||
+        frame->colorspace      != prev->colorspace      ||
+        frame->chroma_location != prev->chroma_location ||
+        av_cmp_q(frame->sample_aspect_ratio, prev->sample_aspect_ratio))
+        return 0;
+
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        if (frame->data[i]     != prev->data[i]     ||
+            frame->linesize[i] != prev->linesize[i] ||
+            !same_buffer(frame->buf[i], prev->buf[i]))
+            return 0;
+    }
+
+    if (frame->nb_side_data != prev->nb_side_data)
+        return 0;
+    for (int i = 0; i < frame->nb_side_data; i++) {
+        if (frame->side_data[i]->type != prev->side_data[i]->type ||
+            !same_buffer(frame->side_data[i]->buf, prev->side_data[i]->buf))
+            return 0;
+    }
+
+    return 1;
+}
+
+void ff_frame_cache_reset(FFFrameCache *c)
+{
+    av_frame_free(&c->in);
+    av_frame_free(&c->out);
+    c->repeat = 0;
+}
+
+int ff_frame_cache_get(FFFrameCache *c, const AVFrame *in, AVFrame **out)
+{
+    AVFrame *dst;
+
+    if (c->in && ff_frame_is_repeat(c->in, in)) {
+        c->repeat = 1;
+        if (!c->out)
+            return 0;
+
+        dst = av_frame_clone(c->out);
+        if (!dst)
+            return AVERROR(ENOMEM);
+        /* the metadata may change while the picture does not */
+        av_dict_free(&dst->metadata);
+        if (av_dict_copy(&dst->metadata, in->metadata, 0) < 0 ||
+            av_buffer_replace(&dst->opaque_ref, in->opaque_ref) < 0) {
+            av_frame_free(&dst);
+            return AVERROR(ENOMEM);
+        }
+        dst->opaque                = in->opaque;
+        dst->pts                   = in->pts;
+        dst->pkt_dts               = in->pkt_dts;
+        dst->best_effort_timestamp = in->best_effort_timestamp;
+        dst->duration              = in->duration;
+        dst->time_base             = in->time_base;
+        *out = dst;
+        return 1;
+    }
+
+    ff_frame_cache_reset(c);
+    if (av_frame_is_writable((AVFrame *)in))
+        return 0;
+
+    c->in = av_frame_clone(in);
+    return c->in ? 0 : AVERROR(ENOMEM);
+}
+
+int ff_frame_cache_put(FFFrameCache *c, const AVFrame *out)
+{
+    if (!c->repeat || c->out)
+        return 0;
+
+    c->out = av_frame_clone(out);
+    return c->out ? 0 : AVERROR(ENOMEM);
+}
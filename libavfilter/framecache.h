@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMECACHE_H
+#define AVFILTER_FRAMECACHE_H
+
+#include "libavutil/frame.h"
+
+/**
+ * Cache of the output a filter produced for a repeated input frame.
+ *
+ * Sources showing a still picture, like a static overlay, send references
+ * to the same frame over and over. Data buffers shared between several
+ * references are read-only, so a frame referencing the same buffers as the
+ * previous one holds the same picture, and a filter whose output only
+ * depends on that picture can send its previous output again instead of
+ * computing it anew.
+ *
+ * A frame which is writable is not shared, so it can not be repeated later
+ * and is not remembered: filters working in place on it keep doing so.
+ */
+typedef struct FFFrameCache {
+    AVFrame *in;    ///< last input frame, if it was shared
+    AVFrame *out;   ///< output for it, once it has been repeated
+    int repeat;     ///< the current input repeats the last one
+} FFFrameCache;
+
+/**
+ * Check whether a frame holds the same picture, with the same properties,
+ * as a previous frame, that is whether it references the same data buffers.
+ * The timestamps, metadata and opaque fields are not compared.
+ *
+ * prev must still be referenced, so that its buffers can not have been
+ * reused.
+ */
+int ff_frame_is_repeat(const AVFrame *prev, const AVFrame *frame);
+
+/**
+ * Look up the output for an input frame, remembering the input.
+ *
+ * @param out set to a new reference to the cached output, with the
+ *            timestamps, metadata and opaque fields of in, on success
+ * @return 1 if in repeats the last input and an output was cached for it,
+ *         0 if the output must be computed and passed to ff_frame_cache_put(),
+ *         a negative error code on failure
+ */
+int ff_frame_cache_get(FFFrameCache *c, const AVFrame *in, AVFrame **out);
+
+/**
+ * Store the output computed for the last input passed to ff_frame_cache_get().
+ *
+ * The output is only kept if that input was a repeat, so that filters
+ * receiving outputs which are not going to be repeated can still write to
+ * them in place.
+ */
+int ff_frame_cache_put(FFFrameCache *c, const AVFrame *out);
+
+/**
+ * Forget the cached input and output, e.g. when the output also depends on
+ * something else which changed.
+ */
+void ff_frame_cache_reset(FFFrameCache *c);
+
+#endif /* AVFILTER_FRAMECACHE_H */
@@ -20,6 +20,8 @@
  */
 
 #include "libavutil/avassert.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
 #include "framequeue.h"
 
 static inline FFFrameBucket *bucket(FFFrameQueue *fq, size_t idx)
@@ -27,8 +29,68 @@ static inline FFFrameBucket *bucket(FFFrameQueue *fq, size_t idx)
     return &fq->queue[(fq->tail + idx) & (fq->allocated - 1)];
 }
 
-void ff_framequeue_global_init(FFFrameQueueGlobal *fqg)
+int ff_framequeue_global_init(FFFrameQueueGlobal *fqg)
 {
+    memset(fqg, 0, sizeof(*fqg));
+    atomic_init(&fqg->queued_frames,     0);
+    atomic_init(&fqg->queued_bytes,      0);
+    atomic_init(&fqg->max_queued_frames, 0);
+    atomic_init(&fqg->max_queued_bytes,  0);
+    ff_spill_file_init(&fqg->spill, "ffspill");
+    return ff_mutex_init(&fqg->spill_lock, NULL) ? AVERROR(ENOMEM) : 0;
+}
+
+void ff_framequeue_global_uninit(FFFrameQueueGlobal *fqg)
+{
+    av_assert0(!fqg->nb_spilled);
+    ff_spill_file_uninit(&fqg->spill);
+    av_freep(&fqg->spill_buf);
+    ff_mutex_destroy(&fqg->spill_lock);
+}
+
+uint64_t ff_framequeue_frame_size(const AVFrame *frame)
+{
+    uint64_t size = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf) && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    for (int i = 0; i < frame->nb_extended_buf; i++)
+        size += frame->extended_buf[i]->size;
+
+    return size;
+}
+
+static void update_max(atomic_uint_least64_t *max, uint64_t value)
+{
+    uint_least64_t cur = atomic_load_explicit(max, memory_order_relaxed);
+
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(max, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+/**
+ * Account for frames entering (positive arguments) or leaving the memory
+ * of a queue.
+ */
+static void account(FFFrameQueue *fq, int64_t frames, int64_t bytes)
+{
+    FFFrameQueueGlobal *fqg = fq->global;
+    uint64_t total_frames, total_bytes;
+
+    fq->queued_bytes += bytes;
+    if (!fqg || !fqg->accounting)
+        return;
+    total_frames = atomic_fetch_add_explicit(&fqg->queued_frames, frames,
+                                             memory_order_relaxed) + frames;
+    total_bytes  = atomic_fetch_add_explicit(&fqg->queued_bytes, bytes,
+                                             memory_order_relaxed) + bytes;
+    if (frames > 0) {
+        update_max(&fqg->max_queued_frames, total_frames);
+        update_max(&fqg->max_queued_bytes,  total_bytes);
+    }
 }
 
 static void check_consistency(FFFrameQueue *fq)
@@ -48,6 +110,7 @@ void ff_framequeue_init(FFFrameQueue *fq, FFFrameQueueGlobal *fqg)
 {
     fq->queue = &fq->first_bucket;
     fq->allocated = 1;
+    fq->global = fqg;
 }
 
 void ff_framequeue_free(FFFrameQueue *fq)
@@ -88,6 +151,9 @@ int ff_framequeue_add(FFFrameQueue *fq, AVFrame *frame)
     }
     b = bucket(fq, fq->queued);
     b->frame = frame;
+    b->size = ff_framequeue_frame_size(frame);
+    b->spill_pos = -1;
+    account(fq, 1, b->size);
     fq->queued++;
     fq->total_frames_head++;
     fq->total_samples_head += frame->nb_samples;
@@ -95,6 +161,15 @@ int ff_framequeue_add(FFFrameQueue *fq, AVFrame *frame)
     return 0;
 }
 
+/**
+ * Get the size of the data of a frame in the spill file.
+ */
+static int image_size(const AVFrame *frame)
+{
+    return av_image_get_buffer_size(frame->format, frame->width, frame->height,
+                                    FF_SPILL_ALIGN);
+}
+
 AVFrame *ff_framequeue_take(FFFrameQueue *fq)
 {
     FFFrameBucket *b;
@@ -102,6 +177,17 @@ AVFrame *ff_framequeue_take(FFFrameQueue *fq)
     check_consistency(fq);
     av_assert1(fq->queued);
     b = bucket(fq, 0);
+    if (b->spill_pos >= 0) {
+        FFFrameQueueGlobal *fqg = fq->global;
+
+        fq->nb_spilled--;
+        ff_mutex_lock(&fqg->spill_lock);
+        ff_spill_file_release(&fqg->spill, b->spill_pos, image_size(b->frame));
+        fqg->nb_spilled--;
+        ff_mutex_unlock(&fqg->spill_lock);
+    } else {
+        account(fq, -1, -(int64_t)b->size);
+    }
     fq->queued--;
     fq->tail++;
     fq->tail &= fq->allocated - 1;
@@ -123,6 +209,132 @@ AVFrame *ff_framequeue_peek(FFFrameQueue *fq, size_t idx)
     return b->frame;
 }
 
+/**
+ * Get the size of the data of a frame stored in the spill file, 0 if it
+ * can not be spilled.
+ */
+static int spill_size(const AVFrame *frame)
+{
+    int size;
+
+    if (frame->nb_samples || frame->hw_frames_ctx || !frame->buf[0] ||
+        frame->width <= 0 || frame->height <= 0)
+        return 0;
+    size = image_size(frame);
+    return FFMAX(size, 0);
+}
+
+/**
+ * Move the data of a frame to the spill file. Must be called with
+ * spill_lock held.
+ */
+static int spill_frame(FFFrameQueueGlobal *fqg, FFFrameBucket *b, int size,
+                       void *log_ctx)
+{
+    AVFrame *frame = b->frame;
+    int ret;
+
+    av_fast_malloc(&fqg->spill_buf, &fqg->spill_buf_size, size);
+    if (!fqg->spill_buf)
+        return AVERROR(ENOMEM);
+    ret = av_image_copy_to_buffer(fqg->spill_buf, size,
+                                  (const uint8_t * const *)frame->data, frame->linesize,
+                                  frame->format, frame->width, frame->height,
+                                  FF_SPILL_ALIGN);
+    if (ret < 0)
+        return ret;
+
+    ret = ff_spill_file_write(&fqg->spill, fqg->spill_buf, size,
+                              &b->spill_pos, log_ctx);
+    if (ret < 0)
+        return ret;
+    fqg->nb_spilled++;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(frame->buf); i++)
+        av_buffer_unref(&frame->buf[i]);
+    memset(frame->data, 0, sizeof(frame->data));
+    memset(frame->linesize, 0, sizeof(frame->linesize));
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int ff_framequeue_spill(FFFrameQueue *fq, void *log_ctx)
+{
+    FFFrameQueueGlobal *fqg = fq->global;
+    int nb_spilled = 0, ret = 0;
+
+    if (!fqg)
+        return 0;
+
+    check_consistency(fq);
+    ff_mutex_lock(&fqg->spill_lock);
+    for (size_t i = 1; i < fq->queued; i++) {
+        FFFrameBucket *b = bucket(fq, i);
+        int size;
+
+        if (b->spill_pos >= 0 || !(size = spill_size(b->frame)))
+            continue;
+        ret = spill_frame(fqg, b, size, log_ctx);
+        if (ret < 0)
+            break;
+        account(fq, -1, -(int64_t)b->size);
+        fq->nb_spilled++;
+        nb_spilled++;
+    }
+    ff_mutex_unlock(&fqg->spill_lock);
+    check_consistency(fq);
+
+    return ret < 0 ? ret : nb_spilled;
+}
+
+int ff_framequeue_load(FFFrameQueue *fq, size_t idx, void *log_ctx)
+{
+    FFFrameQueueGlobal *fqg = fq->global;
+    FFFrameBucket *b;
+    AVFrame *frame;
+    AVBufferRef *buf;
+    int size, ret;
+
+    av_assert1(idx < fq->queued);
+    if (!fq->nb_spilled)
+        return 0;
+    b = bucket(fq, idx);
+    if (b->spill_pos < 0)
+        return 0;
+
+    frame = b->frame;
+    size = image_size(frame);
+    buf = av_buffer_alloc(size);
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    ff_mutex_lock(&fqg->spill_lock);
+    ret = ff_spill_file_read(&fqg->spill, b->spill_pos, buf->data, size, log_ctx);
+    if (ret >= 0) {
+        ff_spill_file_release(&fqg->spill, b->spill_pos, size);
+        fqg->nb_spilled--;
+    }
+    ff_mutex_unlock(&fqg->spill_lock);
+    if (ret < 0) {
+        av_buffer_unref(&buf);
+        return ret;
+    }
+
+    ret = av_image_fill_arrays(frame->data, frame->linesize, buf->data,
+                               frame->format, frame->width, frame->height,
+                               FF_SPILL_ALIGN);
+    if (ret < 0) {
+        av_buffer_unref(&buf);
+        return ret;
+    }
+    frame->buf[0] = buf;
+    b->spill_pos = -1;
+    b->size = buf->size;
+    fq->nb_spilled--;
+    account(fq, 1, b->size);
+    return 0;
+}
+
 void ff_framequeue_skip_samples(FFFrameQueue *fq, size_t samples, AVRational time_base)
 {
     FFFrameBucket *b;
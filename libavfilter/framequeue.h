@@ -29,22 +29,75 @@
  * must be protected by a mutex or any synchronization mechanism.
  */
 
+#include <stdatomic.h>
+#include <stdint.h>
+
 #include "libavutil/frame.h"
+#include "libavutil/thread.h"
+#include "spillfile.h"
 
 typedef struct FFFrameBucket {
     AVFrame *frame;
+
+    /**
+     * Size of the buffers of the frame, when it was added.
+     */
+    uint64_t size;
+
+    /**
+     * Position of the data of the frame in the spill file, -1 if the data
+     * is in memory.
+     */
+    int64_t spill_pos;
 } FFFrameBucket;
 
 /**
  * Structure to hold global options and statistics for frame queues.
  *
- * This structure is intended to allow implementing global control of the
- * frame queues, including memory consumption caps.
- *
- * It is currently empty.
+ * It accounts the memory used by the frames of all the queues attached to
+ * it, and holds the file the frames are spilled to.
+ * The counters can be updated concurrently from several queues; the options
+ * must be set before any frame is queued.
  */
 typedef struct FFFrameQueueGlobal {
-    char dummy; /* C does not allow empty structs */
+    /**
+     * Size of the buffers of the frames queued in a single queue above which
+     * it is over budget, 0 for no limit.
+     */
+    uint64_t max_queue_bytes;
+
+    /**
+     * Size of the buffers of the frames queued in all queues above which
+     * every non-empty queue is over budget, 0 for no limit.
+     */
+    uint64_t max_bytes;
+
+    /**
+     * If nonzero, account the frames of all queues in the following fields.
+     * It is required by max_bytes and must not change while frames are
+     * queued.
+     */
+    int accounting;
+
+    /**
+     * Number of frames and size of their buffers queued in all queues,
+     * not counting the frames spilled to the file, and their maximum.
+     */
+    atomic_uint_least64_t queued_frames;
+    atomic_uint_least64_t queued_bytes;
+    atomic_uint_least64_t max_queued_frames;
+    atomic_uint_least64_t max_queued_bytes;
+
+    /**
+     * Spill file, shared by all queues and protected by spill_lock.
+     * The ranges of the frames read back or dropped are reused, so its size
+     * is bounded by the largest amount of data spilled at once.
+     */
+    AVMutex spill_lock;
+    FFSpillFile spill;
+    size_t nb_spilled;
+    uint8_t *spill_buf;
+    unsigned spill_buf_size;
 } FFFrameQueueGlobal;
 
 /**
@@ -105,15 +158,39 @@ typedef struct FFFrameQueue {
      */
     int samples_skipped;
 
+    /**
+     * Global structure the queue is attached to, or NULL.
+     */
+    FFFrameQueueGlobal *global;
+
+    /**
+     * Size of the buffers of the queued frames, not counting the frames
+     * spilled to the file.
+     */
+    uint64_t queued_bytes;
+
+    /**
+     * Number of frames spilled to the file.
+     */
+    size_t nb_spilled;
+
 } FFFrameQueue;
 
 /**
  * Init a global structure.
+ * @return  >=0 or an AVERROR code.
  */
-void ff_framequeue_global_init(FFFrameQueueGlobal *fqg);
+int ff_framequeue_global_init(FFFrameQueueGlobal *fqg);
 
 /**
- * Init a frame queue and attach it to a global structure.
+ * Free the resources of a global structure. All the queues attached to it
+ * must have been freed.
+ */
+void ff_framequeue_global_uninit(FFFrameQueueGlobal *fqg);
+
+/**
+ * Init a frame queue and attach it to a global structure, which may be NULL
+ * for a queue without budget nor spilling.
  */
 void ff_framequeue_init(FFFrameQueue *fq, FFFrameQueueGlobal *fqg);
 
@@ -131,15 +208,52 @@ int ff_framequeue_add(FFFrameQueue *fq, AVFrame *frame);
 /**
  * Take the first frame in the queue.
  * Must not be used with empty queues.
+ * The data of the frame must have been loaded with ff_framequeue_load()
+ * if the queue may have been spilled, or the frame is only to be freed.
  */
 AVFrame *ff_framequeue_take(FFFrameQueue *fq);
 
 /**
  * Access a frame in the queue, without removing it.
  * The first frame is numbered 0; the designated frame must exist.
+ * The same remark as for ff_framequeue_take() applies.
  */
 AVFrame *ff_framequeue_peek(FFFrameQueue *fq, size_t idx);
 
+/**
+ * Move the data of the queued frames, except the first one, to the spill
+ * file of the global structure, keeping their properties in memory.
+ * Only video frames in system memory are spilled.
+ * @return  the number of spilled frames or an AVERROR code.
+ */
+int ff_framequeue_spill(FFFrameQueue *fq, void *log_ctx);
+
+/**
+ * Read the data of a queued frame back from the spill file, if it was
+ * spilled.
+ * @return  >=0 or an AVERROR code.
+ */
+int ff_framequeue_load(FFFrameQueue *fq, size_t idx, void *log_ctx);
+
+/**
+ * Check if a queue holds more frames than the budgets of its global
+ * structure allow.
+ */
+static inline int ff_framequeue_over_budget(FFFrameQueue *fq)
+{
+    const FFFrameQueueGlobal *fqg = fq->global;
+
+    return fqg && fq->queued_bytes &&
+           ((fqg->max_queue_bytes && fq->queued_bytes > fqg->max_queue_bytes) ||
+            (fqg->max_bytes &&
+             atomic_load_explicit(&fqg->queued_bytes, memory_order_relaxed) > fqg->max_bytes));
+}
+
+/**
+ * Get the size of the buffers of a frame, as accounted by the queues.
+ */
+uint64_t ff_framequeue_frame_size(const AVFrame *frame);
+
 /**
  * Get the number of queued frames.
  */
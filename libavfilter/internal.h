@@ -25,6 +25,7 @@
  */
 
 #include "libavutil/internal.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "framequeue.h"
@@ -43,6 +44,22 @@ typedef struct AVFilterCommand {
  */
 void ff_avfilter_graph_update_heap(AVFilterGraph *graph, AVFilterLink *link);
 
+/**
+ * Update the position of a filter in the ready heap after a change of its
+ * ready field.
+ */
+void ff_filter_graph_update_ready(AVFilterGraph *graph, AVFilterContext *filter);
+
+/**
+ * Lock the state shared between neighbouring filters of a graph: the ready
+ * fields, the ready heap and the frame_blocked_in fields of the links.
+ * This is only needed, and only does anything, while several filters of the
+ * graph are being activated concurrently.
+ */
+void ff_filter_graph_lock(AVFilterGraph *graph);
+
+void ff_filter_graph_unlock(AVFilterGraph *graph);
+
 /**
  * A filter pad used for either input or output.
  */
@@ -133,6 +150,39 @@ struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
     FFFrameQueueGlobal frame_queues;
+
+    /**
+     * Filters with a non-zero ready field, as a heap ordered by decreasing
+     * ready value, then by increasing index in AVFilterGraph.filters.
+     */
+    AVFilterContext **ready_filters;
+    int nb_ready_filters;
+
+    /**
+     * Filters activated concurrently with AVFILTER_THREAD_GRAPH, and their
+     * return values. They can hold up to nb_threads entries.
+     */
+    AVFilterContext **wave;
+    int *wave_rets;
+    unsigned wave_id;
+
+    /**
+     * Nonzero while the filters in wave are being activated, see
+     * ff_filter_graph_lock().
+     */
+    int parallel;
+    AVMutex lock;
+
+    /**
+     * Nonzero once a frame queue budget was exceeded to let the graph
+     * progress, see AVFilterGraph.max_link_bytes.
+     */
+    int budget_exceeded;
+
+    /**
+     * Storage for avfilter_graph_get_stats().
+     */
+    AVFilterStats stats;
 };
 
 struct AVFilterInternal {
@@ -141,6 +191,39 @@ struct AVFilterInternal {
     // 1 when avfilter_init_*() was successfully called on this filter
     // 0 otherwise
     int initialized;
+
+    /**
+     * Index of the filter in AVFilterGraph.filters.
+     */
+    int graph_index;
+
+    /**
+     * Index of the filter in AVFilterGraphInternal.ready_filters,
+     * -1 if it is not there.
+     */
+    int ready_index;
+
+    /**
+     * Last value of AVFilterGraphInternal.wave_id for which the filter or
+     * one of its neighbours was picked to be activated concurrently.
+     */
+    unsigned wave_id;
+
+    /**
+     * Statistics of the filter, see AVFilterGraph.stats.
+     */
+    AVFilterStats stats;
+
+    /**
+     * Set when the activation of the filter was held back because one of
+     * its outputs was over its frame queue budget.
+     */
+    int budget_blocked;
+
+    /**
+     * Activate the filter once whatever the budgets.
+     */
+    int budget_exceed;
 };
 
 static av_always_inline int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -149,6 +232,13 @@ static av_always_inline int ff_filter_execute(AVFilterContext *ctx, avfilter_act
     return ctx->internal->execute(ctx, func, arg, ret, nb_jobs);
 }
 
+/**
+ * Check whether ff_filter_execute() currently runs the jobs one after the
+ * other, which happens while the filter is activated concurrently with others
+ * (AVFILTER_THREAD_GRAPH). Jobs waiting on each other must not be split then.
+ */
+int ff_filter_execute_serial(AVFilterContext *ctx);
+
 enum FilterFormatsState {
     /**
      * The default value meaning that this filter supports all formats
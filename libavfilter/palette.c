@@ -20,6 +20,7 @@
  */
 
 #include "libavutil/common.h"
+#include "libavutil/thread.h"
 #include "palette.h"
 
 #define K ((1 << 16) - 1)
@@ -165,9 +166,22 @@ static int32_t cbrt01_int(int32_t x)
     return u;
 }
 
+/**
+ * cbrt01_int() of every value in [0;K], the Halley iterations and their 64-bit
+ * divisions are the bulk of the sRGB to OkLab conversion cost.
+ */
+static uint16_t cbrt_table[K + 1];
+static AVOnce cbrt_table_once = AV_ONCE_INIT;
+
+static av_cold void init_cbrt_table(void)
+{
+    for (int i = 0; i <= K; i++)
+        cbrt_table[i] = cbrt01_int(i);
+}
+
 static int64_t div_round64(int64_t a, int64_t b) { return (a^b)<0 ? (a-b/2)/b : (a+b/2)/b; }
 
-struct Lab ff_srgb_u8_to_oklab_int(uint32_t srgb)
+static av_always_inline struct Lab srgb_u8_to_oklab_int(uint32_t srgb)
 {
     const int32_t r = (int32_t)srgb2linear[srgb >> 16 & 0xff];
     const int32_t g = (int32_t)srgb2linear[srgb >>  8 & 0xff];
@@ -178,9 +192,9 @@ struct Lab ff_srgb_u8_to_oklab_int(uint32_t srgb)
     const int32_t m = (13887LL*r + 44610LL*g +  7038LL*b + K/2) / K;
     const int32_t s = ( 5787LL*r + 18462LL*g + 41286LL*b + K/2) / K;
 
-    const int32_t l_ = cbrt01_int(l);
-    const int32_t m_ = cbrt01_int(m);
-    const int32_t s_ = cbrt01_int(s);
+    const int32_t l_ = cbrt_table[FFMIN(l, K)];
+    const int32_t m_ = cbrt_table[FFMIN(m, K)];
+    const int32_t s_ = cbrt_table[FFMIN(s, K)];
 
     const struct Lab ret = {
         .L = div_round64( 13792LL*l_ +  52010LL*m_ -   267LL*s_, K),
@@ -191,6 +205,19 @@ struct Lab ff_srgb_u8_to_oklab_int(uint32_t srgb)
     return ret;
 }
 
+struct Lab ff_srgb_u8_to_oklab_int(uint32_t srgb)
+{
+    ff_thread_once(&cbrt_table_once, init_cbrt_table);
+    return srgb_u8_to_oklab_int(srgb);
+}
+
+void ff_srgb_u8_to_oklab_int_array(struct Lab *dst, const uint32_t *srgb, int nb)
+{
+    ff_thread_once(&cbrt_table_once, init_cbrt_table);
+    for (int i = 0; i < nb; i++)
+        dst[i] = srgb_u8_to_oklab_int(srgb[i]);
+}
+
 uint32_t ff_oklab_int_to_srgb_u8(struct Lab c)
 {
     const int64_t l_ = c.L + div_round64(25974LL * c.a, K) + div_round64(14143LL * c.b, K);
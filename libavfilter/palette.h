@@ -49,6 +49,12 @@ uint8_t ff_linear_int_to_srgb_u8(int32_t x);
  */
 struct Lab ff_srgb_u8_to_oklab_int(uint32_t srgb);
 
+/**
+ * Convert nb sRGB colors to OkLab, same as ff_srgb_u8_to_oklab_int() on
+ * each of them.
+ */
+void ff_srgb_u8_to_oklab_int_array(struct Lab *dst, const uint32_t *srgb, int nb);
+
 /**
  * OkLab to sRGB (non-linear) conversion
  * @see https://bottosson.github.io/posts/oklab/
@@ -21,6 +21,7 @@
  * Libavfilter multithreading support
  */
 
+#include <stdatomic.h>
 #include <stddef.h>
 
 #include "libavutil/error.h"
@@ -37,6 +38,10 @@ typedef struct ThreadContext {
     AVSliceThread *thread;
     avfilter_action_func *func;
 
+    /* set while the threads run jobs, during which the jobs themselves may
+     * call execute (see AVFILTER_THREAD_GRAPH) */
+    atomic_int busy;
+
     /* per-execute parameters */
     AVFilterContext *ctx;
     void *arg;
@@ -63,17 +68,28 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
 
     if (nb_jobs <= 0)
         return 0;
+    if (atomic_load(&c->busy)) {
+        for (int i = 0; i < nb_jobs; i++) {
+            int r = func(ctx, arg, i, nb_jobs);
+            if (ret)
+                ret[i] = r;
+        }
+        return 0;
+    }
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
+    atomic_store(&c->busy, 1);
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    atomic_store(&c->busy, 0);
     return 0;
 }
 
 static int thread_init_internal(ThreadContext *c, int nb_threads)
 {
+    atomic_init(&c->busy, 0);
     nb_threads = avpriv_slicethread_create(&c->thread, c, worker_func, NULL, nb_threads);
     if (nb_threads <= 1)
         avpriv_slicethread_free(&c->thread);
@@ -107,6 +123,13 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     return 0;
 }
 
+int ff_graph_thread_busy(AVFilterGraph *graph)
+{
+    ThreadContext *c = graph->internal->thread;
+
+    return c && atomic_load(&c->busy);
+}
+
 void ff_graph_thread_free(AVFilterGraph *graph)
 {
     if (graph->internal->thread)
@@ -0,0 +1,372 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#include <utime.h>
+#endif
+#if HAVE_IO_H
+#include <io.h>
+#endif
+
+#include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/file.h"
+#include "libavutil/file_open.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/sha.h"
+
+#include "rendercache.h"
+
+#define CACHE_EXT       ".ffrc"
+#define CACHE_MAGIC     "FFRCACHE"
+#define HEADER_SIZE     64
+#define FMT_NAME_OFFSET 24
+#define FMT_NAME_SIZE   32
+#define REVISION_OFFSET 56
+#define ALIGN           64
+
+/**
+ * Revision of the file format and of the keys, to be bumped when they change
+ * so that the pictures stored by older versions are not used.
+ */
+#define CACHE_REVISION  2
+
+int ff_render_cache_init(FFRenderCache *c)
+{
+    const char *dir     = getenv("FFMPEG_RENDER_CACHE_DIR");
+    const char *size    = getenv("FFMPEG_RENDER_CACHE_SIZE");
+    const char *version = getenv("FFMPEG_RENDER_CACHE_VERSION");
+
+    c->max_size = 256 << 20;
+    if (size) {
+        char *end;
+        long long max_size = strtoll(size, &end, 10);
+        if (!*end && max_size > 0)
+            c->max_size = max_size;
+    }
+
+    if (!dir || !*dir)
+        return 0;
+    c->dir     = av_strdup(dir);
+    c->version = av_strdup(version ? version : "");
+    if (!c->dir || !c->version) {
+        ff_render_cache_uninit(c);
+        return AVERROR(ENOMEM);
+    }
+    return 1;
+}
+
+void ff_render_cache_uninit(FFRenderCache *c)
+{
+    av_freep(&c->dir);
+    av_freep(&c->version);
+}
+
+/**
+ * Get the key a picture is stored with, made of the caller's key and of
+ * everything else the picture depends on.
+ */
+static char *full_key(const FFRenderCache *c, const char *key)
+{
+    return av_asprintf("%d\n%s\n%s", CACHE_REVISION, c->version, key);
+}
+
+static char *cache_path(const FFRenderCache *c, const char *key)
+{
+    uint8_t digest[20];
+    char hex[2 * sizeof(digest) + 1];
+    struct AVSHA *sha = av_sha_alloc();
+
+    if (!sha)
+        return NULL;
+    av_sha_init(sha, 160);
+    av_sha_update(sha, (const uint8_t *)key, strlen(key));
+    av_sha_final(sha, digest);
+    av_free(sha);
+
+    for (int i = 0; i < sizeof(digest); i++)
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+
+    return av_asprintf("%s/%s" CACHE_EXT, c->dir, hex);
+}
+
+static size_t data_offset(size_t key_len)
+{
+    return FFALIGN(HEADER_SIZE + key_len, ALIGN);
+}
+
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    av_file_unmap(data, (uintptr_t)opaque);
+}
+
+/**
+ * Check that a mapped file holds the picture for key.
+ */
+static int check_file(const uint8_t *data, size_t size, const char *key,
+                      enum AVPixelFormat format)
+{
+    const char *fmt_name = av_get_pix_fmt_name(format);
+    size_t key_len = strlen(key);
+    unsigned width, height, linesize;
+
+    if (size < HEADER_SIZE || memcmp(data, CACHE_MAGIC, 8))
+        return 0;
+    width    = AV_RL32(data +  8);
+    height   = AV_RL32(data + 12);
+    linesize = AV_RL32(data + 16);
+
+    if (AV_RL32(data + 20) != key_len ||
+        strncmp((const char *)data + FMT_NAME_OFFSET, fmt_name, FMT_NAME_SIZE) ||
+        av_image_check_size(width, height, 0, NULL) < 0 ||
+        AV_RL32(data + REVISION_OFFSET) != CACHE_REVISION ||
+        linesize < av_image_get_linesize(format, width, 0) ||
+        size < data_offset(key_len) + (uint64_t)linesize * height ||
+        memcmp(data + HEADER_SIZE, key, key_len))
+        return 0;
+
+    return 1;
+}
+
+int ff_render_cache_get(FFRenderCache *c, void *log_ctx, const char *key,
+                        enum AVPixelFormat format, AVFrame **frame)
+{
+    char *stored_key = full_key(c, key), *path = NULL;
+    uint8_t *data;
+    size_t size, offset;
+    AVFrame *dst;
+    int ret;
+
+    if (stored_key)
+        path = cache_path(c, stored_key);
+    if (!path) {
+        av_free(stored_key);
+        return AVERROR(ENOMEM);
+    }
+
+    /* a missing file is just a miss */
+    ret = av_file_map(path, &data, &size, AV_LOG_DEBUG - AV_LOG_ERROR, log_ctx);
+    if (ret < 0 || !check_file(data, size, stored_key, format)) {
+        if (ret >= 0)
+            av_file_unmap(data, size);
+        av_free(path);
+        av_free(stored_key);
+        c->nb_misses++;
+        return 0;
+    }
+    offset = data_offset(strlen(stored_key));
+    av_free(stored_key);
+
+    /* mark the picture as recently used */
+#if HAVE_UNISTD_H
+    utime(path, NULL);
+#endif
+    av_free(path);
+
+    dst = av_frame_alloc();
+    if (!dst) {
+        av_file_unmap(data, size);
+        return AVERROR(ENOMEM);
+    }
+    dst->buf[0] = av_buffer_create(data, size, unmap_file, (void *)(uintptr_t)size,
+                                   AV_BUFFER_FLAG_READONLY);
+    if (!dst->buf[0]) {
+        av_file_unmap(data, size);
+        av_frame_free(&dst);
+        return AVERROR(ENOMEM);
+    }
+    dst->format      = format;
+    dst->width       = AV_RL32(data +  8);
+    dst->height      = AV_RL32(data + 12);
+    dst->linesize[0] = AV_RL32(data + 16);
+    dst->data[0]     = data + offset;
+
+    *frame = dst;
+    c->nb_hits++;
+    return 1;
+}
+
+#if HAVE_DIRENT_H
+typedef struct CacheEntry {
+    char *path;
+    time_t mtime;
+    int64_t size;
+} CacheEntry;
+
+static int cmp_entries(const void *a, const void *b)
+{
+    const CacheEntry *ea = a, *eb = b;
+    return (ea->mtime > eb->mtime) - (ea->mtime < eb->mtime);
+}
+
+/**
+ * Remove the least recently used pictures until the cache fits its maximum size.
+ */
+static void evict(FFRenderCache *c, void *log_ctx)
+{
+    DIR *dir = opendir(c->dir);
+    CacheEntry *entries = NULL;
+    unsigned nb_entries = 0, entries_size = 0;
+    struct dirent *dirent;
+    int64_t total = 0;
+
+    if (!dir)
+        return;
+
+    while ((dirent = readdir(dir))) {
+        size_t len = strlen(dirent->d_name);
+        struct stat st;
+        CacheEntry *tmp;
+        char *path;
+
+        if (len < strlen(CACHE_EXT) || strcmp(dirent->d_name + len - strlen(CACHE_EXT), CACHE_EXT))
+            continue;
+        path = av_asprintf("%s/%s", c->dir, dirent->d_name);
+        if (!path)
+            break;
+        if (stat(path, &st) < 0) {
+            av_free(path);
+            continue;
+        }
+
+        tmp = av_fast_realloc(entries, &entries_size, (nb_entries + 1) * sizeof(*entries));
+        if (!tmp) {
+            av_free(path);
+            break;
+        }
+        entries = tmp;
+        entries[nb_entries++] = (CacheEntry){ path, st.st_mtime, st.st_size };
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    if (total > c->max_size) {
+        qsort(entries, nb_entries, sizeof(*entries), cmp_entries);
+        for (unsigned i = 0; i < nb_entries && total > c->max_size; i++) {
+            if (unlink(entries[i].path) < 0)
+                continue;
+            av_log(log_ctx, AV_LOG_DEBUG, "Evicted %s from the render cache\n", entries[i].path);
+            total -= entries[i].size;
+        }
+    }
+
+    for (unsigned i = 0; i < nb_entries; i++)
+        av_free(entries[i].path);
+    av_free(entries);
+}
+#endif
+
+int ff_render_cache_put(FFRenderCache *c, void *log_ctx, const char *key,
+                        const AVFrame *frame)
+{
+    static const uint8_t zeros[ALIGN];
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    uint8_t header[HEADER_SIZE] = { 0 };
+    char *stored_key = NULL, *path = NULL, *tmp_path = NULL;
+    int row_size, linesize, ret = 0;
+    size_t key_len;
+    FILE *f;
+
+    if (!desc || av_pix_fmt_count_planes(frame->format) != 1 ||
+        desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))
+        return AVERROR(ENOSYS);
+    row_size = av_image_get_linesize(frame->format, frame->width, 0);
+    if (row_size < 0)
+        return row_size;
+    linesize = FFALIGN(row_size, ALIGN);
+
+    stored_key = full_key(c, key);
+    if (stored_key)
+        path = cache_path(c, stored_key);
+    if (path)
+        tmp_path = av_asprintf("%s.%08x.tmp", path, av_get_random_seed());
+    if (!tmp_path) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    key_len = strlen(stored_key);
+
+    /* write to a temporary file first, so that other processes never map a
+     * partial picture */
+    f = avpriv_fopen_utf8(tmp_path, "wb");
+    if (!f) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+
+    memcpy(header, CACHE_MAGIC, 8);
+    AV_WL32(header +  8, frame->width);
+    AV_WL32(header + 12, frame->height);
+    AV_WL32(header + 16, linesize);
+    AV_WL32(header + 20, key_len);
+    av_strlcpy((char *)header + FMT_NAME_OFFSET, desc->name, FMT_NAME_SIZE);
+    AV_WL32(header + REVISION_OFFSET, CACHE_REVISION);
+
+    fwrite(header, 1, HEADER_SIZE, f);
+    fwrite(stored_key, 1, key_len, f);
+    fwrite(zeros, 1, data_offset(key_len) - HEADER_SIZE - key_len, f);
+    for (int y = 0; y < frame->height; y++) {
+        fwrite(frame->data[0] + y * frame->linesize[0], 1, row_size, f);
+        fwrite(zeros, 1, linesize - row_size, f);
+    }
+    if (ferror(f))
+        ret = AVERROR(EIO);
+    if (fclose(f) && ret >= 0)
+        ret = AVERROR(errno);
+
+    if (ret >= 0 && rename(tmp_path, path) < 0)
+        ret = AVERROR(errno);
+    if (ret < 0) {
+        unlink(tmp_path);
+        goto end;
+    }
+
+#if HAVE_DIRENT_H
+    evict(c, log_ctx);
+#endif
+
+end:
+    av_free(tmp_path);
+    av_free(path);
+    av_free(stored_key);
+    return ret;
+}
+
+void ff_render_cache_log_stats(const FFRenderCache *c, void *log_ctx, int level)
+{
+    av_log(log_ctx, level, "Render cache: %u hits, %u misses\n",
+           c->nb_hits, c->nb_misses);
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_RENDERCACHE_H
+#define AVFILTER_RENDERCACHE_H
+
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+
+/**
+ * On-disk cache of rendered pictures, shared between processes.
+ *
+ * Each picture is stored in its own file in the cache directory, named after
+ * a hash of its key, and memory-mapped when it is found again. When storing
+ * a picture makes the directory grow over its maximum size, the least
+ * recently used pictures are removed.
+ *
+ * Filter arguments may come from untrusted users, so the cache is configured
+ * by whoever runs the process, with environment variables:
+ * FFMPEG_RENDER_CACHE_DIR enables it, FFMPEG_RENDER_CACHE_SIZE sets the
+ * maximum size in bytes, 256 MiB by default. FFMPEG_RENDER_CACHE_VERSION is
+ * added to all the keys: it should identify what the caller can not see
+ * itself, like the versions of the renderers and of the installed fonts,
+ * and be changed when they are updated.
+ */
+typedef struct FFRenderCache {
+    char *dir;
+    char *version;
+    int64_t max_size;
+
+    unsigned nb_hits;
+    unsigned nb_misses;
+} FFRenderCache;
+
+/**
+ * Set up a cache from the environment.
+ *
+ * @return 1 if the cache is enabled, 0 if not, or a negative error code
+ */
+int ff_render_cache_init(FFRenderCache *c);
+
+void ff_render_cache_uninit(FFRenderCache *c);
+
+/**
+ * Look up a picture.
+ *
+ * @param key    string identifying what was rendered and how
+ * @param format pixel format the picture must have
+ * @param frame  set to a read-only frame backed by the mapped file on hit
+ * @return 1 on hit, 0 on miss, or a negative error code
+ */
+int ff_render_cache_get(FFRenderCache *c, void *log_ctx, const char *key,
+                        enum AVPixelFormat format, AVFrame **frame);
+
+/**
+ * Store a picture of a single plane format, replacing any picture stored
+ * with the same key.
+ */
+int ff_render_cache_put(FFRenderCache *c, void *log_ctx, const char *key,
+                        const AVFrame *frame);
+
+/**
+ * Log the numbers of hits and misses of the cache.
+ */
+void ff_render_cache_log_stats(const FFRenderCache *c, void *log_ctx, int level);
+
+#endif /* AVFILTER_RENDERCACHE_H */
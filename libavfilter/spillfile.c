@@ -0,0 +1,265 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_IO_H
+#include <io.h>
+#endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/file_open.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "spillfile.h"
+
+void ff_spill_file_init(FFSpillFile *sf, const char *prefix)
+{
+    memset(sf, 0, sizeof(*sf));
+    sf->prefix = prefix;
+    sf->fd     = -1;
+}
+
+void ff_spill_file_uninit(FFSpillFile *sf)
+{
+    if (sf->fd >= 0)
+        close(sf->fd);
+    if (sf->filename)
+        unlink(sf->filename);
+    av_freep(&sf->filename);
+    av_freep(&sf->free);
+    ff_spill_file_init(sf, sf->prefix);
+}
+
+static int open_file(FFSpillFile *sf, void *log_ctx)
+{
+    int fd = avpriv_tempfile(sf->prefix, &sf->filename, 0, log_ctx);
+
+    if (fd < 0)
+        return fd;
+    sf->fd = fd;
+    /* remove the file right away where the system allows it, so that it
+     * does not outlive a killed process */
+    if (!unlink(sf->filename))
+        av_freep(&sf->filename);
+    return 0;
+}
+
+/**
+ * Shrink the file to the end of its data.
+ */
+static void truncate_file(FFSpillFile *sf)
+{
+#if HAVE_FTRUNCATE
+    /* a failure only leaves unused data at the end of the file */
+    if (ftruncate(sf->fd, sf->size) < 0)
+        av_log(NULL, AV_LOG_DEBUG, "Could not truncate the spill file\n");
+#endif
+}
+
+static int write_all(int fd, const uint8_t *buf, int64_t size)
+{
+    while (size) {
+        ssize_t ret = write(fd, buf, FFMIN(size, INT_MAX));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static int read_all(int fd, uint8_t *buf, int64_t size)
+{
+    while (size) {
+        ssize_t ret = read(fd, buf, FFMIN(size, INT_MAX));
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR)
+                continue;
+            return ret < 0 ? AVERROR(errno) : AVERROR(EIO);
+        }
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static void remove_range(FFSpillFile *sf, int idx)
+{
+    memmove(&sf->free[idx], &sf->free[idx + 1],
+            (sf->nb_free - idx - 1) * sizeof(*sf->free));
+    sf->nb_free--;
+}
+
+static const uint8_t padding[FF_SPILL_ALIGN];
+
+int ff_spill_file_write(FFSpillFile *sf, const uint8_t *buf, int64_t size,
+                        int64_t *pos, void *log_ctx)
+{
+    const int64_t aligned = FFALIGN(size, FF_SPILL_ALIGN);
+    int64_t dst = sf->size;
+    int idx, ret;
+
+    if (sf->fd < 0 && (ret = open_file(sf, log_ctx)) < 0)
+        return ret;
+
+    for (idx = 0; idx < sf->nb_free && sf->free[idx].size < aligned; idx++);
+    if (idx < sf->nb_free)
+        dst = sf->free[idx].pos;
+
+    /* the padding is written too, so that the file always ends with data */
+    if (lseek(sf->fd, dst, SEEK_SET) < 0)
+        ret = AVERROR(errno);
+    else if ((ret = write_all(sf->fd, buf, size)) >= 0)
+        ret = write_all(sf->fd, padding, aligned - size);
+    if (ret < 0) {
+        av_log(log_ctx, AV_LOG_ERROR, "Could not write to the spill file: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    if (idx < sf->nb_free) {
+        sf->free[idx].pos  += aligned;
+        sf->free[idx].size -= aligned;
+        if (!sf->free[idx].size)
+            remove_range(sf, idx);
+    } else {
+        sf->size += aligned;
+    }
+    sf->used += aligned;
+    *pos = dst;
+    return 0;
+}
+
+int ff_spill_file_read(FFSpillFile *sf, int64_t pos, uint8_t *buf, int64_t size,
+                       void *log_ctx)
+{
+    int ret;
+
+    if (lseek(sf->fd, pos, SEEK_SET) < 0)
+        ret = AVERROR(errno);
+    else
+        ret = read_all(sf->fd, buf, size);
+    if (ret < 0)
+        av_log(log_ctx, AV_LOG_ERROR, "Could not read from the spill file: %s\n",
+               av_err2str(ret));
+    return ret;
+}
+
+void ff_spill_file_release(FFSpillFile *sf, int64_t pos, int64_t size)
+{
+    FFSpillRange *r;
+    int idx;
+
+    size = FFALIGN(size, FF_SPILL_ALIGN);
+    sf->used -= size;
+    if (!sf->used) {
+        /* nothing is left, start over from an empty file */
+        sf->nb_free = 0;
+        sf->size    = 0;
+        truncate_file(sf);
+        return;
+    }
+
+    if (pos + size == sf->size) {
+        sf->size = pos;
+        /* the range before it may have been released already */
+        if (sf->nb_free && sf->free[sf->nb_free - 1].pos +
+                           sf->free[sf->nb_free - 1].size == sf->size)
+            sf->size = sf->free[--sf->nb_free].pos;
+        truncate_file(sf);
+        return;
+    }
+
+    for (idx = 0; idx < sf->nb_free && sf->free[idx].pos < pos; idx++);
+    if (idx && sf->free[idx - 1].pos + sf->free[idx - 1].size == pos) {
+        r = &sf->free[--idx];
+        r->size += size;
+    } else {
+        r = av_fast_realloc(sf->free, &sf->free_size,
+                            (sf->nb_free + 1) * sizeof(*sf->free));
+        /* without memory, the range is only reused once the file empties */
+        if (!r)
+            return;
+        sf->free = r;
+        memmove(&sf->free[idx + 1], &sf->free[idx],
+                (sf->nb_free - idx) * sizeof(*sf->free));
+        sf->nb_free++;
+        r = &sf->free[idx];
+        r->pos  = pos;
+        r->size = size;
+    }
+    if (idx + 1 < sf->nb_free && r->pos + r->size == sf->free[idx + 1].pos) {
+        r->size += sf->free[idx + 1].size;
+        remove_range(sf, idx + 1);
+    }
+}
+
+#if HAVE_MMAP
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    munmap(data, (uintptr_t)opaque);
+}
+#endif
+
+int ff_spill_file_map(FFSpillFile *sf, AVBufferRef **buf, void *log_ctx)
+{
+    const size_t size = sf->size;
+    int ret;
+
+    *buf = NULL;
+    if (sf->fd < 0 || !size || size != sf->size)
+        return AVERROR(EINVAL);
+
+#if HAVE_MMAP
+    {
+        void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, sf->fd, 0);
+
+        if (data != MAP_FAILED) {
+            *buf = av_buffer_create(data, size, unmap_file, (void *)(uintptr_t)size,
+                                    AV_BUFFER_FLAG_READONLY);
+            if (!*buf) {
+                munmap(data, size);
+                return AVERROR(ENOMEM);
+            }
+            return 0;
+        }
+        av_log(log_ctx, AV_LOG_VERBOSE, "Could not map the spill file, reading it\n");
+    }
+#endif
+
+    /* this is not meant to be efficient, only to work */
+    *buf = av_buffer_alloc(size);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    if ((ret = ff_spill_file_read(sf, 0, (*buf)->data, size, log_ctx)) < 0)
+        av_buffer_unref(buf);
+    return ret;
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_SPILLFILE_H
+#define AVFILTER_SPILLFILE_H
+
+/**
+ * FFSpillFile: temporary file holding data moved out of memory
+ *
+ * The file is created on the first write and removed right away where the
+ * system allows it, so that it does not outlive a killed process. Released
+ * ranges are reused by the next writes, and the file is truncated when its
+ * end is released.
+ *
+ * Note: this API is not thread-safe.
+ */
+
+#include <stdint.h>
+
+#include "libavutil/buffer.h"
+
+/**
+ * Alignment of the ranges of data in the file.
+ */
+#define FF_SPILL_ALIGN 64
+
+typedef struct FFSpillRange {
+    int64_t pos;
+    int64_t size;
+} FFSpillRange;
+
+typedef struct FFSpillFile {
+    const char *prefix;
+
+    int fd;
+
+    /**
+     * Name of the file, if it could not be removed while open.
+     */
+    char *filename;
+
+    /**
+     * End of the data in the file and size of the data not released.
+     */
+    int64_t size;
+    int64_t used;
+
+    /**
+     * Released ranges before the end of the data, sorted by position.
+     */
+    FFSpillRange *free;
+    int nb_free;
+    unsigned free_size;
+} FFSpillFile;
+
+/**
+ * Initialize a spill file, whose name is made from prefix when it is created.
+ */
+void ff_spill_file_init(FFSpillFile *sf, const char *prefix);
+
+/**
+ * Close and remove the file, releasing all its data.
+ */
+void ff_spill_file_uninit(FFSpillFile *sf);
+
+/**
+ * Write data to a free range of the file, or at its end.
+ *
+ * @param pos  set to the position of the data in the file
+ * @return  >=0 or an AVERROR code
+ */
+int ff_spill_file_write(FFSpillFile *sf, const uint8_t *buf, int64_t size,
+                        int64_t *pos, void *log_ctx);
+
+/**
+ * Read data back from the file.
+ * @return  >=0 or an AVERROR code
+ */
+int ff_spill_file_read(FFSpillFile *sf, int64_t pos, uint8_t *buf, int64_t size,
+                       void *log_ctx);
+
+/**
+ * Release the range of data written at pos, of the size it was written with,
+ * so that it can be reused.
+ */
+void ff_spill_file_release(FFSpillFile *sf, int64_t pos, int64_t size);
+
+/**
+ * Map the data of the file in memory, reading it all if the system can not
+ * map files. The data written at pos starts at buf->data + pos.
+ * No data may be written or released while the mapping is in use.
+ *
+ * @return  >=0 or an AVERROR code
+ */
+int ff_spill_file_map(FFSpillFile *sf, AVBufferRef **buf, void *log_ctx);
+
+#endif /* AVFILTER_SPILLFILE_H */
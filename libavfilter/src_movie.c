@@ -37,6 +37,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/internal.h"
+#include "libavutil/samplefmt.h"
 #include "libavutil/timestamp.h"
 
 #include "libavcodec/avcodec.h"
@@ -74,6 +75,18 @@ typedef struct MovieContext {
     int64_t discontinuity_threshold;
     int64_t ts_offset;
     int dec_threads;
+    int reverse;
+
+    /* reverse playback, one chunk of frames starting at a keyframe at a time */
+    AVFrame **chunk;            ///< decoded frames of the current chunk, in presentation order
+    unsigned int chunk_size;
+    int nb_chunk;
+    int64_t rev_start;          ///< timestamp at which reverse playback stops
+    int64_t rev_end;            ///< timestamp of the earliest frame sent so far
+    int64_t rev_seek;           ///< timestamp to seek to for the next chunk
+    int64_t rev_span;           ///< distance before rev_end to seek to for the next chunk
+    int64_t rev_origin;         ///< timestamp mirrored to the start of the output
+    int rev_done;               ///< the current chunk is the last one
 
     AVPacket *pkt;
     AVFormatContext *format_ctx;
@@ -102,6 +115,7 @@ static const AVOption movie_options[]= {
     { "discontinuity", "set discontinuity threshold", OFFSET(discontinuity_threshold), AV_OPT_TYPE_DURATION, {.i64 = 0}, 0, INT64_MAX, FLAGS },
     { "dec_threads",  "set the number of threads for decoding", OFFSET(dec_threads), AV_OPT_TYPE_INT, {.i64 =  0}, 0, INT_MAX, FLAGS },
     { "format_opts",  "set format options for the opened file", OFFSET(format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
+    { "reverse",      "play the stream backwards, seeking back one keyframe at a time", OFFSET(reverse), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
     { NULL },
 };
 
@@ -305,6 +319,11 @@ static av_cold int movie_common_init(AVFilterContext *ctx)
                "Loop with several streams is currently unsupported\n");
         return AVERROR_PATCHWELCOME;
     }
+    if (movie->reverse && (nb_streams != 1 || movie->loop_count != 1)) {
+        av_log(ctx, AV_LOG_ERROR,
+               "Reverse with several streams or loop is currently unsupported\n");
+        return AVERROR_PATCHWELCOME;
+    }
 
     // Try to find the movie format (container)
     iformat = movie->format_name ? av_find_input_format(movie->format_name) : NULL;
@@ -400,6 +419,30 @@ static av_cold int movie_common_init(AVFilterContext *ctx)
            movie->seek_point, movie->format_name, movie->file_name,
            movie->stream_index);
 
+    if (movie->reverse) {
+        AVStream *st = movie->st[0].st;
+        int64_t start = st->start_time, duration = st->duration;
+
+        if (start == AV_NOPTS_VALUE)
+            start = movie->format_ctx->start_time == AV_NOPTS_VALUE ? 0 :
+                    av_rescale_q(movie->format_ctx->start_time, AV_TIME_BASE_Q, st->time_base);
+        if (duration == AV_NOPTS_VALUE && movie->format_ctx->duration != AV_NOPTS_VALUE)
+            duration = av_rescale_q(movie->format_ctx->duration, AV_TIME_BASE_Q, st->time_base);
+        if (duration == AV_NOPTS_VALUE) {
+            av_log(ctx, AV_LOG_ERROR, "Cannot play a stream of unknown duration in reverse\n");
+            return AVERROR(EINVAL);
+        }
+
+        /* Video chunks start at the keyframe before the last one, audio
+         * chunks are made of a second of samples. */
+        movie->rev_span   = st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? 1 :
+                            av_rescale_q(AV_TIME_BASE, AV_TIME_BASE_Q, st->time_base);
+        movie->rev_start  = start + av_rescale_q(movie->seek_point, AV_TIME_BASE_Q, st->time_base);
+        movie->rev_end    = INT64_MAX;
+        movie->rev_seek   = start + duration - movie->rev_span;
+        movie->rev_origin = start;
+    }
+
     return 0;
 }
 
@@ -413,6 +456,9 @@ static av_cold void movie_uninit(AVFilterContext *ctx)
             avcodec_free_context(&movie->st[i].codec_ctx);
         av_frame_free(&movie->st[i].frame);
     }
+    while (movie->nb_chunk > 0)
+        av_frame_free(&movie->chunk[--movie->nb_chunk]);
+    av_freep(&movie->chunk);
     av_packet_free(&movie->pkt);
     av_freep(&movie->st);
     av_freep(&movie->out_index);
@@ -564,11 +610,208 @@ static int decode_packet(AVFilterContext *ctx, int i)
     return 0;
 }
 
+static int64_t frame_duration(const AVFrame *frame, AVRational time_base)
+{
+    /* the duration of audio frames does not account for trimmed samples */
+    if (!frame->nb_samples)
+        return frame->duration;
+    return av_rescale_q(frame->nb_samples, (AVRational){ 1, frame->sample_rate }, time_base);
+}
+
+/**
+ * Decode the frames from the current position of the file until the
+ * earliest frame already sent, keeping those from keep_from on.
+ */
+static int decode_chunk(AVFilterContext *ctx, int64_t keep_from)
+{
+    MovieContext *movie = ctx->priv;
+    MovieStream *st = &movie->st[0];
+    AVCodecContext *dec = st->codec_ctx;
+    AVPacket *pkt = movie->pkt;
+    int ret;
+
+    while (1) {
+        AVFrame **chunk;
+        int64_t pts;
+
+        ret = avcodec_receive_frame(dec, st->frame);
+        if (ret == AVERROR(EAGAIN)) {
+            ret = av_read_frame(movie->format_ctx, pkt);
+            if (ret == AVERROR_EOF) {
+                ret = avcodec_send_packet(dec, NULL);
+            } else if (ret >= 0) {
+                if (pkt->stream_index == st->st->index)
+                    ret = avcodec_send_packet(dec, pkt);
+                av_packet_unref(pkt);
+            }
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+        if (ret == AVERROR_EOF)
+            return 0;
+        if (ret < 0)
+            return ret;
+
+        pts = st->frame->best_effort_timestamp;
+        if (pts >= movie->rev_end) {
+            av_frame_unref(st->frame);
+            return 0;
+        }
+        if (pts != AV_NOPTS_VALUE && pts < keep_from && st->frame->nb_samples) {
+            /* cut the samples preceding keep_from */
+            int skip = av_rescale_q(keep_from - pts, st->st->time_base,
+                                    (AVRational){ 1, st->frame->sample_rate });
+
+            if (skip < st->frame->nb_samples) {
+                if ((ret = av_frame_make_writable(st->frame)) < 0)
+                    return ret;
+                av_samples_copy(st->frame->extended_data, st->frame->extended_data, 0, skip,
+                                st->frame->nb_samples - skip, st->frame->ch_layout.nb_channels,
+                                st->frame->format);
+                st->frame->nb_samples -= skip;
+                pts = keep_from;
+            }
+        }
+        if (pts == AV_NOPTS_VALUE || pts < keep_from) {
+            av_frame_unref(st->frame);
+            continue;
+        }
+        /* packets may be split differently after seeking, drop the samples
+         * which were already sent */
+        if (st->frame->nb_samples && movie->rev_end != INT64_MAX &&
+            pts + frame_duration(st->frame, st->st->time_base) > movie->rev_end) {
+            st->frame->nb_samples = av_rescale_q(movie->rev_end - pts, st->st->time_base,
+                                                 (AVRational){ 1, st->frame->sample_rate });
+        }
+
+        chunk = av_fast_realloc(movie->chunk, &movie->chunk_size,
+                                (movie->nb_chunk + 1) * sizeof(*movie->chunk));
+        if (!chunk)
+            return AVERROR(ENOMEM);
+        movie->chunk = chunk;
+        chunk[movie->nb_chunk] = av_frame_alloc();
+        if (!chunk[movie->nb_chunk])
+            return AVERROR(ENOMEM);
+        st->frame->pts = pts;
+        av_frame_move_ref(chunk[movie->nb_chunk++], st->frame);
+    }
+}
+
+/**
+ * Seek back to the chunk preceding the frames already sent and decode it,
+ * seeking further back if it turns out empty.
+ */
+static int read_reverse_chunk(AVFilterContext *ctx)
+{
+    MovieContext *movie = ctx->priv;
+    MovieStream *st = &movie->st[0];
+    const int audio = st->st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+    int ret;
+
+    while (!movie->nb_chunk && !movie->rev_done) {
+        int64_t target = FFMAX(movie->rev_seek, movie->rev_start), keep_from = movie->rev_start;
+
+        /* Audio decoders need some preceding packets to output the first
+         * samples properly, so decode from a bit earlier and drop them. */
+        if (audio) {
+            keep_from = target;
+            target   -= av_rescale_q(AV_TIME_BASE / 10, AV_TIME_BASE_Q, st->st->time_base);
+        }
+        movie->rev_done = movie->rev_seek <= movie->rev_start;
+
+        ret = av_seek_frame(movie->format_ctx, st->st->index, target, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Could not seek to %"PRId64" for reverse playback: %s\n",
+                   target, av_err2str(ret));
+            return ret;
+        }
+        avcodec_flush_buffers(st->codec_ctx);
+
+        ret = decode_chunk(ctx, keep_from);
+        if (ret < 0)
+            return ret;
+
+        /* Seeking landed on the chunk already sent, go further back */
+        if (!movie->nb_chunk && movie->rev_span < INT64_MAX / 2)
+            movie->rev_span *= 2;
+        movie->rev_seek = (movie->nb_chunk ? movie->chunk[0]->pts : movie->rev_seek) - movie->rev_span;
+    }
+
+    if (movie->nb_chunk) {
+        AVFrame *last = movie->chunk[movie->nb_chunk - 1];
+
+        if (movie->rev_end == INT64_MAX)
+            movie->rev_origin += last->pts + frame_duration(last, st->st->time_base);
+        movie->rev_end = movie->chunk[0]->pts;
+    }
+
+    return 0;
+}
+
+static void reverse_samples(AVFrame *frame)
+{
+    const int planar   = av_sample_fmt_is_planar(frame->format);
+    const int nb_planes = planar ? frame->ch_layout.nb_channels : 1;
+    const int size     = av_get_bytes_per_sample(frame->format) *
+                         (planar ? 1 : frame->ch_layout.nb_channels);
+
+    for (int p = 0; p < nb_planes; p++) {
+        uint8_t *data = frame->extended_data[p];
+
+        for (int i = 0, j = frame->nb_samples - 1; i < j; i++, j--)
+            for (int k = 0; k < size; k++)
+                FFSWAP(uint8_t, data[i * size + k], data[j * size + k]);
+    }
+}
+
+static int activate_reverse(AVFilterContext *ctx)
+{
+    MovieContext *movie = ctx->priv;
+    MovieStream *st = &movie->st[0];
+    AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *frame;
+    int ret;
+
+    if (!ff_outlink_frame_wanted(outlink))
+        return FFERROR_NOT_READY;
+
+    if (!movie->nb_chunk) {
+        ret = read_reverse_chunk(ctx);
+        if (ret < 0)
+            return ret;
+        if (!movie->nb_chunk) {
+            ff_outlink_set_status(outlink, AVERROR_EOF, st->last_pts);
+            return 0;
+        }
+    }
+
+    frame = movie->chunk[--movie->nb_chunk];
+    movie->chunk[movie->nb_chunk] = NULL;
+
+    /* mirror the frame around the middle of the stream */
+    frame->pts = movie->rev_origin - frame->pts - frame_duration(frame, outlink->time_base);
+    if (frame->nb_samples) {
+        if ((ret = av_frame_make_writable(frame)) < 0) {
+            av_frame_free(&frame);
+            return ret;
+        }
+        reverse_samples(frame);
+    }
+    st->last_pts = frame->pts;
+
+    ff_filter_set_ready(ctx, 100);
+    return ff_filter_frame(outlink, frame);
+}
+
 static int activate(AVFilterContext *ctx)
 {
     MovieContext *movie = ctx->priv;
     int wanted = 0, ret;
 
+    if (movie->reverse)
+        return activate_reverse(ctx);
+
     for (int i = 0; i < ctx->nb_outputs; i++) {
         if (ff_outlink_frame_wanted(ctx->outputs[i]))
             wanted++;
@@ -648,6 +891,8 @@ static int process_command(AVFilterContext *ctx, const char *cmd, const char *ar
 
         if (sscanf(args, "%i|%"SCNi64"|%i %1s", &idx, &ts, &flags, tail) != 3)
             return AVERROR(EINVAL);
+        if (movie->reverse)
+            return AVERROR(ENOSYS);
 
         ret = av_seek_frame(movie->format_ctx, idx, ts, flags);
         if (ret < 0)
@@ -0,0 +1,108 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Checks the table based sRGB to OkLab conversions against the reference
+ * one doing the cube roots with Halley iterations. Pass any argument to also
+ * benchmark them.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/time.h"
+
+#include "libavfilter/palette.c"
+
+#define NB_COLORS 4096
+
+/* the conversion before the cube root table */
+static struct Lab ref_srgb_u8_to_oklab_int(uint32_t srgb)
+{
+    const int32_t r = (int32_t)srgb2linear[srgb >> 16 & 0xff];
+    const int32_t g = (int32_t)srgb2linear[srgb >>  8 & 0xff];
+    const int32_t b = (int32_t)srgb2linear[srgb       & 0xff];
+
+    const int32_t l = (27015LL*r + 35149LL*g +  3372LL*b + K/2) / K;
+    const int32_t m = (13887LL*r + 44610LL*g +  7038LL*b + K/2) / K;
+    const int32_t s = ( 5787LL*r + 18462LL*g + 41286LL*b + K/2) / K;
+
+    const int32_t l_ = cbrt01_int(l);
+    const int32_t m_ = cbrt01_int(m);
+    const int32_t s_ = cbrt01_int(s);
+
+    const struct Lab ret = {
+        .L = div_round64( 13792LL*l_ +  52010LL*m_ -   267LL*s_, K),
+        .a = div_round64(129628LL*l_ - 159158LL*m_ + 29530LL*s_, K),
+        .b = div_round64(  1698LL*l_ +  51299LL*m_ - 52997LL*s_, K),
+    };
+
+    return ret;
+}
+
+static int lab_equal(struct Lab a, struct Lab b)
+{
+    return a.L == b.L && a.a == b.a && a.b == b.b;
+}
+
+int main(int argc, char **argv)
+{
+    static uint32_t srgb[NB_COLORS];
+    static struct Lab lab[NB_COLORS];
+    int bench = argc > 1, ret = 0;
+
+    /* all the colors, in batches, with a stride to keep the test short */
+    for (uint32_t start = 0; start < 1 << 24; start += NB_COLORS * 7) {
+        for (int i = 0; i < NB_COLORS; i++)
+            srgb[i] = (start + i * 7) & 0xffffff;
+        ff_srgb_u8_to_oklab_int_array(lab, srgb, NB_COLORS);
+
+        for (int i = 0; i < NB_COLORS; i++) {
+            const struct Lab ref = ref_srgb_u8_to_oklab_int(srgb[i]);
+
+            if (!lab_equal(lab[i], ref) || !lab_equal(ff_srgb_u8_to_oklab_int(srgb[i]), ref)) {
+                printf("mismatch for %06"PRIX32": %d %d %d != %d %d %d\n", srgb[i],
+                       lab[i].L, lab[i].a, lab[i].b, ref.L, ref.a, ref.b);
+                ret = 1;
+            }
+        }
+    }
+
+    if (bench) {
+        int64_t t0, t1;
+
+        for (int i = 0; i < NB_COLORS; i++)
+            srgb[i] = i * 0x9e3779b1U >> 8;
+
+        t0 = av_gettime_relative();
+        for (int n = 0; n < 1000; n++)
+            for (int i = 0; i < NB_COLORS; i++)
+                lab[i] = ref_srgb_u8_to_oklab_int(srgb[i]);
+        t0 = av_gettime_relative() - t0;
+
+        t1 = av_gettime_relative();
+        for (int n = 0; n < 1000; n++)
+            ff_srgb_u8_to_oklab_int_array(lab, srgb, NB_COLORS);
+        t1 = av_gettime_relative() - t1;
+
+        printf("sRGB to OkLab: reference %.1f Mcolors/s, table %.1f Mcolors/s\n",
+               1000.0 * NB_COLORS / t0, 1000.0 * NB_COLORS / t1);
+    }
+
+    return ret;
+}
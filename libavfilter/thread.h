@@ -25,4 +25,10 @@ int ff_graph_thread_init(AVFilterGraph *graph);
 
 void ff_graph_thread_free(AVFilterGraph *graph);
 
+/**
+ * Check whether the threads of the graph are running jobs, in which case
+ * the jobs executed from them are run one after the other.
+ */
+int ff_graph_thread_busy(AVFilterGraph *graph);
+
 #endif /* AVFILTER_THREAD_H */
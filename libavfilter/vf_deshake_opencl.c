@@ -1119,7 +1119,6 @@ static int deshake_opencl_init(AVFilterContext *avctx)
     cl_int cle;
     int err;
     cl_ulong8 zeroed_ulong8;
-    FFFrameQueueGlobal fqg;
     cl_image_format grayscale_format;
     cl_image_desc grayscale_desc;
     cl_command_queue_properties queue_props;
@@ -1153,8 +1152,7 @@ static int deshake_opencl_init(AVFilterContext *avctx)
     av_assert0(hw_frames_ctx);
     av_assert0(desc);
 
-    ff_framequeue_global_init(&fqg);
-    ff_framequeue_init(&ctx->fq, &fqg);
+    ff_framequeue_init(&ctx->fq, NULL);
     ctx->eof = 0;
     ctx->smooth_window = (int)(av_q2d(avctx->inputs[0]->frame_rate) * ctx->smooth_window_multiplier);
     ctx->curr_frame = 0;
@@ -0,0 +1,408 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Process video frames with a libvips operation, several frames at a time.
+ *
+ * Operations on small pictures, like the frames of most GIFs, hardly keep the
+ * libvips thread pool busy, so frames are gathered in batches which are
+ * processed in parallel with the filter threads.
+ */
+
+#include <string.h>
+
+#include <vips/vips.h>
+
+#include "libavutil/imgutils.h"
+#include "libavutil/opt.h"
+#include "avfilter.h"
+#include "filters.h"
+#include "internal.h"
+#include "video.h"
+#include "vipsutils.h"
+
+typedef struct EBVipsContext {
+    const AVClass *class;
+
+    char *op_name;
+    char *args;
+    int max_frames;
+
+    int nb_slots;               ///< number of frames processed at once
+    AVFrame **in;               ///< frames of the current batch
+    AVFrame **out;
+    int *rets;
+    int nb_in;
+
+    int eof;                    ///< status of the input once it has ended
+    int64_t eof_pts;
+} EBVipsContext;
+
+#define OFFSET(x) offsetof(EBVipsContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption ebvips_options[] = {
+    { "op",     "set the libvips operation",               OFFSET(op_name),    AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0,    FLAGS },
+    { "args",   "set the operation arguments",             OFFSET(args),       AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0,    FLAGS },
+    { "frames", "set the number of frames processed at once, 0 for the number of threads",
+                                                           OFFSET(max_frames), AV_OPT_TYPE_INT,    {.i64 = 0},    0, 1024, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(ebvips);
+
+/* Operations mapping an "in" image to an "out" one, which neither access
+ * files nor run programs: the filter arguments may come from anyone. */
+static const char *const allowed_ops[] = {
+    "embed",
+    "flip",
+    "gamma",
+    "gaussblur",
+    "invert",
+    "rank",
+    "resize",
+    "rot",
+    "sharpen",
+};
+
+/* Bounds on the arguments whose cost grows with their value, the size of
+ * the output being checked separately. */
+#define MAX_SIGMA       100.0
+#define MAX_RANK_WINDOW 64
+#define MAX_PIXELS      (4096 * 4096)
+
+static const struct {
+    const char *op;
+    const char *arg;
+    double max;
+} bounded_args[] = {
+    { "gaussblur", "sigma",  MAX_SIGMA       },
+    { "sharpen",   "sigma",  MAX_SIGMA       },
+    { "rank",      "width",  MAX_RANK_WINDOW },
+    { "rank",      "height", MAX_RANK_WINDOW },
+};
+
+static const enum AVPixelFormat pix_fmts[] = {
+    AV_PIX_FMT_GRAY8, AV_PIX_FMT_YA8, AV_PIX_FMT_RGB24, AV_PIX_FMT_RGBA,
+    AV_PIX_FMT_NONE
+};
+
+/**
+ * Check that the arguments are valid for the operation and within bounds.
+ */
+static int check_args(AVFilterContext *ctx)
+{
+    EBVipsContext *s = ctx->priv;
+    VipsOperation *op;
+    int ret = 0;
+
+    if (!s->args)
+        return 0;
+
+    op = vips_operation_new(s->op_name);
+    if (!op || vips_object_set_from_string(VIPS_OBJECT(op), s->args)) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid arguments '%s' for the operation '%s': %s\n",
+               s->args, s->op_name, vips_error_buffer());
+        vips_error_clear();
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bounded_args); i++) {
+        GValue value = G_VALUE_INIT;
+        double v;
+
+        if (strcmp(s->op_name, bounded_args[i].op))
+            continue;
+        g_value_init(&value, G_TYPE_DOUBLE);
+        g_object_get_property(G_OBJECT(op), bounded_args[i].arg, &value);
+        v = g_value_get_double(&value);
+        g_value_unset(&value);
+        if (v > bounded_args[i].max) {
+            av_log(ctx, AV_LOG_ERROR, "The argument '%s' of the operation '%s' is limited to %g.\n",
+                   bounded_args[i].arg, s->op_name, bounded_args[i].max);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+    }
+
+end:
+    if (op)
+        g_object_unref(op);
+    return ret;
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    EBVipsContext *s = ctx->priv;
+
+    if (VIPS_INIT("ffmpeg")) {
+        av_log(ctx, AV_LOG_ERROR, "Could not initialize libvips: %s\n", vips_error_buffer());
+        vips_error_clear();
+        return AVERROR_EXTERNAL;
+    }
+
+    if (!s->op_name) {
+        av_log(ctx, AV_LOG_ERROR, "No operation provided!\n");
+        return AVERROR(EINVAL);
+    }
+    for (int i = 0; i < FF_ARRAY_ELEMS(allowed_ops); i++)
+        if (!strcmp(s->op_name, allowed_ops[i]))
+            return check_args(ctx);
+
+    av_log(ctx, AV_LOG_ERROR, "The operation '%s' is not available for use with esmBot.\n",
+           s->op_name);
+    return AVERROR(EINVAL);
+}
+
+/**
+ * Run the operation on an image, which is freed, and cast the result back to 8 bits.
+ */
+static int run_operation(AVFilterContext *ctx, VipsImage *in, VipsImage **out)
+{
+    EBVipsContext *s = ctx->priv;
+    VipsOperation *op = vips_operation_new(s->op_name);
+    VipsImage *result = NULL, *cast;
+
+    *out = NULL;
+    if (!op) {
+        g_object_unref(in);
+        goto fail;
+    }
+
+    g_object_set(op, "in", in, NULL);
+    g_object_unref(in);
+    /* Not built through the operation cache: every frame makes a new input,
+     * so nothing would be reused, and the cached operations would keep the
+     * frames they wrap alive. */
+    if ((s->args && vips_object_set_from_string(VIPS_OBJECT(op), s->args)) ||
+        vips_object_build(VIPS_OBJECT(op))) {
+        vips_object_unref_outputs(VIPS_OBJECT(op));
+        g_object_unref(op);
+        goto fail;
+    }
+    g_object_get(op, "out", &result, NULL);
+    vips_object_unref_outputs(VIPS_OBJECT(op));
+    g_object_unref(op);
+
+    if (vips_image_get_format(result) != VIPS_FORMAT_UCHAR) {
+        int err = vips_cast_uchar(result, &cast, NULL);
+        g_object_unref(result);
+        if (err)
+            goto fail;
+        result = cast;
+    }
+
+    *out = result;
+    return 0;
+
+fail:
+    av_log(ctx, AV_LOG_ERROR, "The operation '%s' failed: %s\n", s->op_name, vips_error_buffer());
+    vips_error_clear();
+    return AVERROR_EXTERNAL;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    EBVipsContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    AVFrame *blank = ff_get_video_buffer(inlink, inlink->w, inlink->h);
+    VipsImage *image;
+    int bands, ret;
+
+    if (!blank)
+        return AVERROR(ENOMEM);
+    for (int y = 0; y < blank->height; y++)
+        memset(blank->data[0] + y * blank->linesize[0], 0, blank->width * ff_vips_bands(blank->format));
+
+    // Run the operation on a blank picture to learn the output dimensions
+    if ((ret = ff_frame_to_vipsimage(&image, blank)) < 0 ||
+        (ret = run_operation(ctx, image, &image)) < 0)
+        return ret;
+    outlink->w = vips_image_get_width(image);
+    outlink->h = vips_image_get_height(image);
+    bands = vips_image_get_bands(image);
+    g_object_unref(image);
+
+    if ((ret = av_image_check_size(outlink->w, outlink->h, 0, ctx)) < 0)
+        return ret;
+    if ((int64_t)outlink->w * outlink->h > MAX_PIXELS) {
+        av_log(ctx, AV_LOG_ERROR, "The operation '%s' makes %dx%d frames, larger than the "
+               "limit of %d pixels.\n", s->op_name, outlink->w, outlink->h, MAX_PIXELS);
+        return AVERROR(EINVAL);
+    }
+
+    if (bands != ff_vips_bands(inlink->format)) {
+        av_log(ctx, AV_LOG_ERROR, "The operation '%s' changes the number of bands.\n", s->op_name);
+        return AVERROR(EINVAL);
+    }
+
+    s->nb_slots = s->max_frames ? s->max_frames : ff_filter_get_nb_threads(ctx);
+    s->in   = av_calloc(s->nb_slots, sizeof(*s->in));
+    s->out  = av_calloc(s->nb_slots, sizeof(*s->out));
+    s->rets = av_calloc(s->nb_slots, sizeof(*s->rets));
+    if (!s->in || !s->out || !s->rets)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int process_frame(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    EBVipsContext *s = ctx->priv;
+    AVFrame *in = s->in[jobnr];
+    VipsImage *image;
+    int ret;
+
+    s->in[jobnr] = NULL;
+    if ((ret = ff_frame_to_vipsimage(&image, in)) < 0 ||
+        (ret = run_operation(ctx, image, &image)) < 0)
+        return ret;
+
+    ret = ff_vipsimage_write_frame(s->out[jobnr], image);
+    g_object_unref(image);
+    return ret;
+}
+
+/**
+ * Process the frames of the current batch in parallel and send them in order.
+ */
+static int process_batch(AVFilterContext *ctx)
+{
+    EBVipsContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    const int nb_frames = s->nb_in;
+    int ret = 0;
+
+    s->nb_in = 0;
+
+    // Output frames are allocated here, as the link frame pool is not meant to be used
+    // from several threads
+    for (int i = 0; i < nb_frames; i++) {
+        s->out[i] = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!s->out[i]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        if ((ret = av_frame_copy_props(s->out[i], s->in[i])) < 0)
+            goto fail;
+    }
+
+    ff_filter_execute(ctx, process_frame, NULL, s->rets, nb_frames);
+
+    for (int i = 0; i < nb_frames; i++) {
+        if (ret >= 0)
+            ret = s->rets[i];
+        if (ret >= 0)
+            ret = ff_filter_frame(outlink, s->out[i]);
+        else
+            av_frame_free(&s->out[i]);
+        s->out[i] = NULL;
+    }
+    return ret;
+
+fail:
+    for (int i = 0; i < nb_frames; i++) {
+        av_frame_free(&s->in[i]);
+        av_frame_free(&s->out[i]);
+    }
+    return ret;
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    EBVipsContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *frame;
+    int ret, status;
+
+    FF_FILTER_FORWARD_STATUS_BACK(outlink, inlink);
+
+    while (!s->eof && s->nb_in < s->nb_slots) {
+        ret = ff_inlink_consume_frame(inlink, &frame);
+        if (ret < 0)
+            return ret;
+        if (!ret)
+            break;
+        s->in[s->nb_in++] = frame;
+    }
+    if (!s->eof && s->nb_in < s->nb_slots &&
+        ff_inlink_acknowledge_status(inlink, &status, &s->eof_pts))
+        s->eof = status;
+
+    if (s->nb_in == s->nb_slots || (s->eof && s->nb_in)) {
+        ret = process_batch(ctx);
+        if (ret < 0)
+            return ret;
+        if (s->eof || ff_inlink_queued_frames(inlink))
+            ff_filter_set_ready(ctx, 100);
+        return 0;
+    }
+
+    if (s->eof) {
+        ff_outlink_set_status(outlink, s->eof, s->eof_pts);
+        return 0;
+    }
+
+    FF_FILTER_FORWARD_WANTED(outlink, inlink);
+
+    return FFERROR_NOT_READY;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    EBVipsContext *s = ctx->priv;
+
+    for (int i = 0; i < s->nb_slots && s->in; i++)
+        av_frame_free(&s->in[i]);
+    av_freep(&s->in);
+    av_freep(&s->out);
+    av_freep(&s->rets);
+}
+
+static const AVFilterPad inputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+    },
+};
+
+static const AVFilterPad outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+};
+
+const AVFilter ff_vf_ebvips = {
+    .name            = "ebvips",
+    .description     = NULL_IF_CONFIG_SMALL("Process frames with a libvips operation, several at a time."),
+    .priv_class      = &ebvips_class,
+    .priv_size       = sizeof(EBVipsContext),
+    .init            = init,
+    .uninit          = uninit,
+    .activate        = activate,
+    FILTER_INPUTS(inputs),
+    FILTER_OUTPUTS(outputs),
+    FILTER_PIXFMTS_ARRAY(pix_fmts),
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
+};
@@ -37,6 +37,7 @@
 #include "libavutil/timestamp.h"
 #include "internal.h"
 #include "drawutils.h"
+#include "filters.h"
 #include "framesync.h"
 #include "video.h"
 #include "vf_overlay.h"
@@ -87,6 +88,13 @@ static av_cold void uninit(AVFilterContext *ctx)
     ff_framesync_uninit(&s->fs);
     av_expr_free(s->x_pexpr); s->x_pexpr = NULL;
     av_expr_free(s->y_pexpr); s->y_pexpr = NULL;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(s->span_index); i++) {
+        av_freep(&s->span_index[i].spans);
+        av_freep(&s->span_index[i].row_spans);
+    }
+    av_frame_free(&s->last_overlay);
+    ff_frame_cache_reset(&s->cache);
 }
 
 static inline int normalize_xy(double d, int chroma_sub)
@@ -346,6 +354,25 @@ static int config_output(AVFilterLink *outlink)
 // ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)) is a faster version of: 255 * (x + y)
 #define UNPREMULTIPLY_ALPHA(x, y) ((((x) << 16) - ((x) << 9) + (x)) / ((((x) + (y)) << 8) - ((x) + (y)) - (y) * (x)))
 
+static const OverlaySpan full_row = { 0, INT_MAX, 0 };
+
+/**
+ * Get the spans of row y of the overlay which have to be blended, in the
+ * full resolution or chroma planes.
+ */
+static av_always_inline const OverlaySpan *get_row_spans(const OverlayContext *s, int chroma,
+                                                         int y, const OverlaySpan **end)
+{
+    const OverlaySpanIndex *idx = &s->span_index[chroma];
+
+    if (!s->span_index_valid) {
+        *end = &full_row + 1;
+        return &full_row;
+    }
+    *end = idx->spans + idx->row_spans[y + 1];
+    return idx->spans + idx->row_spans[y];
+}
+
 /**
  * Blend image in src to destination buffer dst at position (x, y).
  */
@@ -385,52 +412,57 @@ static av_always_inline void blend_slice_packed_rgb(AVFilterContext *ctx,
     dp = dst->data[0] + (y + slice_start) * dst->linesize[0];
 
     for (i = slice_start; i < slice_end; i++) {
-        j = FFMAX(-x, 0);
-        S = sp + j     * sstep;
-        d = dp + (x+j) * dstep;
-
-        for (jmax = FFMIN(-x + dst_w, src_w); j < jmax; j++) {
-            alpha = S[sa];
-
-            // if the main channel has an alpha channel, alpha has to be calculated
-            // to create an un-premultiplied (straight) alpha value
-            if (main_has_alpha && alpha != 0 && alpha != 255) {
-                uint8_t alpha_d = d[da];
-                alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);
-            }
+        const OverlaySpan *span_end, *span = get_row_spans(s, 0, i, &span_end);
+
+        for (; span < span_end; span++) {
+            j    = FFMAX(FFMAX(-x, 0), span->start);
+            jmax = FFMIN(FFMIN(-x + dst_w, src_w), span->end);
+            S = sp + j     * sstep;
+            d = dp + (x+j) * dstep;
+
+            for (; j < jmax; j++) {
+                alpha = S[sa];
+
+                // if the main channel has an alpha channel, alpha has to be calculated
+                // to create an un-premultiplied (straight) alpha value
+                if (main_has_alpha && alpha != 0 && alpha != 255) {
+                    uint8_t alpha_d = d[da];
+                    alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);
+                }
 
-            switch (alpha) {
-            case 0:
-                break;
-            case 255:
-                d[dr] = S[sr];
-                d[dg] = S[sg];
-                d[db] = S[sb];
-                break;
-            default:
-                // main_value = main_value * (1 - alpha) + overlay_value * alpha
-                // since alpha is in the range 0-255, the result must divided by 255
-                d[dr] = is_straight ? FAST_DIV255(d[dr] * (255 - alpha) + S[sr] * alpha) :
-                        FFMIN(FAST_DIV255(d[dr] * (255 - alpha)) + S[sr], 255);
-                d[dg] = is_straight ? FAST_DIV255(d[dg] * (255 - alpha) + S[sg] * alpha) :
-                        FFMIN(FAST_DIV255(d[dg] * (255 - alpha)) + S[sg], 255);
-                d[db] = is_straight ? FAST_DIV255(d[db] * (255 - alpha) + S[sb] * alpha) :
-                        FFMIN(FAST_DIV255(d[db] * (255 - alpha)) + S[sb], 255);
-            }
-            if (main_has_alpha) {
                 switch (alpha) {
                 case 0:
                     break;
                 case 255:
-                    d[da] = S[sa];
+                    d[dr] = S[sr];
+                    d[dg] = S[sg];
+                    d[db] = S[sb];
                     break;
                 default:
-                    // apply alpha compositing: main_alpha += (1-main_alpha) * overlay_alpha
-                    d[da] += FAST_DIV255((255 - d[da]) * S[sa]);
+                    // main_value = main_value * (1 - alpha) + overlay_value * alpha
+                    // since alpha is in the range 0-255, the result must divided by 255
+                    d[dr] = is_straight ? FAST_DIV255(d[dr] * (255 - alpha) + S[sr] * alpha) :
+                            FFMIN(FAST_DIV255(d[dr] * (255 - alpha)) + S[sr], 255);
+                    d[dg] = is_straight ? FAST_DIV255(d[dg] * (255 - alpha) + S[sg] * alpha) :
+                            FFMIN(FAST_DIV255(d[dg] * (255 - alpha)) + S[sg], 255);
+                    d[db] = is_straight ? FAST_DIV255(d[db] * (255 - alpha) + S[sb] * alpha) :
+                            FFMIN(FAST_DIV255(d[db] * (255 - alpha)) + S[sb], 255);
+                }
+                if (main_has_alpha) {
+                    switch (alpha) {
+                    case 0:
+                        break;
+                    case 255:
+                        d[da] = S[sa];
+                        break;
+                    default:
+                        // apply alpha compositing: main_alpha += (1-main_alpha) * overlay_alpha
+                        d[da] += FAST_DIV255((255 - d[da]) * S[sa]);
+                    }
                 }
+                d += dstep;
+                S += sstep;
             }
-            d += dstep;
-            S += sstep;
         }
         dp += dst->linesize[0];
         sp += src->linesize[0];
@@ -482,79 +514,94 @@ static av_always_inline void blend_plane_##depth##_##nbits##bits(AVFilterContext
     dap = (uint##depth##_t *)(dst->data[3] + ((yp + slice_start) << vsub) * dst->linesize[3]);             \
                                                                                                            \
     for (j = slice_start; j < slice_end; j++) {                                                            \
-        k = FFMAX(-xp, 0);                                                                                 \
-        d = dp + (xp+k) * dst_step;                                                                        \
-        s = sp + k;                                                                                        \
-        a = ap + (k<<hsub);                                                                                \
-        da = dap + ((xp+k) << hsub);                                                                       \
-        kmax = FFMIN(-xp + dst_wp, src_wp);                                                                \
+        const OverlaySpan *span_end, *span = get_row_spans(octx, hsub || vsub, j, &span_end);              \
                                                                                                            \
-        if (nbits == 8 && ((vsub && j+1 < src_hp) || !vsub) && octx->blend_row[i]) {                       \
-            int c = octx->blend_row[i]((uint8_t*)d, (uint8_t*)da, (uint8_t*)s,                             \
-                    (uint8_t*)a, kmax - k, src->linesize[3]);                                              \
+        for (; span < span_end; span++) {                                                                  \
+            k = FFMAX(FFMAX(-xp, 0), span->start);                                                         \
+            kmax = FFMIN(FFMIN(-xp + dst_wp, src_wp), span->end);                                          \
+            if (k >= kmax)                                                                                 \
+                continue;                                                                                  \
+            d = dp + (xp+k) * dst_step;                                                                    \
+            s = sp + k;                                                                                    \
+            a = ap + (k<<hsub);                                                                            \
+            da = dap + ((xp+k) << hsub);                                                                   \
                                                                                                            \
-            s += c;                                                                                        \
-            d += dst_step * c;                                                                             \
-            da += (1 << hsub) * c;                                                                         \
-            a += (1 << hsub) * c;                                                                          \
-            k += c;                                                                                        \
-        }                                                                                                  \
-        for (; k < kmax; k++) {                                                                            \
-            int alpha_v, alpha_h, alpha;                                                                   \
+            if (span->opaque) {                                                                            \
+                /* straight alpha at its maximum replaces the main picture */                              \
+                for (; k < kmax; k++) {                                                                    \
+                    *d = *s++;                                                                             \
+                    d += dst_step;                                                                         \
+                }                                                                                          \
+                continue;                                                                                  \
+            }                                                                                              \
+                                                                                                           \
+            if (nbits == 8 && ((vsub && j+1 < src_hp) || !vsub) && octx->blend_row[i]) {                   \
+                int c = octx->blend_row[i]((uint8_t*)d, (uint8_t*)da, (uint8_t*)s,                         \
+                        (uint8_t*)a, kmax - k, src->linesize[3]);                                          \
+                                                                                                           \
+                s += c;                                                                                    \
+                d += dst_step * c;                                                                         \
+                da += (1 << hsub) * c;                                                                     \
+                a += (1 << hsub) * c;                                                                      \
+                k += c;                                                                                    \
+            }                                                                                              \
+            for (; k < kmax; k++) {                                                                        \
+                int alpha_v, alpha_h, alpha;                                                               \
                                                                                                            \
-            /* average alpha for color components, improve quality */                                      \
-            if (hsub && vsub && j+1 < src_hp && k+1 < src_wp) {                                            \
-                alpha = (a[0] + a[src->linesize[3]] +                                                      \
-                         a[1] + a[src->linesize[3]+1]) >> 2;                                               \
-            } else if (hsub || vsub) {                                                                     \
-                alpha_h = hsub && k+1 < src_wp ?                                                           \
-                    (a[0] + a[1]) >> 1 : a[0];                                                             \
-                alpha_v = vsub && j+1 < src_hp ?                                                           \
-                    (a[0] + a[src->linesize[3]]) >> 1 : a[0];                                              \
-                alpha = (alpha_v + alpha_h) >> 1;                                                          \
-            } else                                                                                         \
-                alpha = a[0];                                                                              \
-            /* if the main channel has an alpha channel, alpha has to be calculated */                     \
-            /* to create an un-premultiplied (straight) alpha value */                                     \
-            if (main_has_alpha && alpha != 0 && alpha != max) {                                            \
                 /* average alpha for color components, improve quality */                                  \
-                uint8_t alpha_d;                                                                           \
                 if (hsub && vsub && j+1 < src_hp && k+1 < src_wp) {                                        \
-                    alpha_d = (da[0] + da[dst->linesize[3]] +                                              \
-                               da[1] + da[dst->linesize[3]+1]) >> 2;                                       \
+                    alpha = (a[0] + a[src->linesize[3]] +                                                  \
+                             a[1] + a[src->linesize[3]+1]) >> 2;                                           \
                 } else if (hsub || vsub) {                                                                 \
                     alpha_h = hsub && k+1 < src_wp ?                                                       \
-                        (da[0] + da[1]) >> 1 : da[0];                                                      \
+                        (a[0] + a[1]) >> 1 : a[0];                                                         \
                     alpha_v = vsub && j+1 < src_hp ?                                                       \
-                        (da[0] + da[dst->linesize[3]]) >> 1 : da[0];                                       \
-                    alpha_d = (alpha_v + alpha_h) >> 1;                                                    \
+                        (a[0] + a[src->linesize[3]]) >> 1 : a[0];                                          \
+                    alpha = (alpha_v + alpha_h) >> 1;                                                      \
                 } else                                                                                     \
-                    alpha_d = da[0];                                                                       \
-                alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);                                               \
-            }                                                                                              \
-            if (straight) {                                                                                \
-                if (nbits > 8)                                                                             \
-                   *d = (*d * (max - alpha) + *s * alpha) / max;                                           \
-                else                                                                                       \
-                    *d = FAST_DIV255(*d * (255 - alpha) + *s * alpha);                                     \
-            } else {                                                                                       \
-                if (nbits > 8) {                                                                           \
-                    if (i && yuv)                                                                          \
-                        *d = av_clip((*d * (max - alpha) + *s * alpha) / max + *s - mid, -mid, mid) + mid; \
+                    alpha = a[0];                                                                          \
+                /* if the main channel has an alpha channel, alpha has to be calculated */                 \
+                /* to create an un-premultiplied (straight) alpha value */                                 \
+                if (main_has_alpha && alpha != 0 && alpha != max) {                                        \
+                    /* average alpha for color components, improve quality */                              \
+                    uint8_t alpha_d;                                                                       \
+                    if (hsub && vsub && j+1 < src_hp && k+1 < src_wp) {                                    \
+                        alpha_d = (da[0] + da[dst->linesize[3]] +                                          \
+                                   da[1] + da[dst->linesize[3]+1]) >> 2;                                   \
+                    } else if (hsub || vsub) {                                                             \
+                        alpha_h = hsub && k+1 < src_wp ?                                                   \
+                            (da[0] + da[1]) >> 1 : da[0];                                                  \
+                        alpha_v = vsub && j+1 < src_hp ?                                                   \
+                            (da[0] + da[dst->linesize[3]]) >> 1 : da[0];                                   \
+                        alpha_d = (alpha_v + alpha_h) >> 1;                                                \
+                    } else                                                                                 \
+                        alpha_d = da[0];                                                                   \
+                    alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);                                           \
+                }                                                                                          \
+                if (straight) {                                                                            \
+                    if (nbits > 8)                                                                         \
+                       *d = (*d * (max - alpha) + *s * alpha) / max;                                       \
                     else                                                                                   \
-                        *d = av_clip_uintp2((*d * (max - alpha) + *s * alpha) / max + *s - (16<<(nbits-8)),\
-                                                                                                    nbits);\
+                        *d = FAST_DIV255(*d * (255 - alpha) + *s * alpha);                                 \
                 } else {                                                                                   \
-                    if (i && yuv)                                                                          \
-                        *d = av_clip(FAST_DIV255((*d - mid) * (max - alpha)) + *s - mid, -mid, mid) + mid; \
-                    else                                                                                   \
-                        *d = av_clip_uint8(FAST_DIV255(*d * (255 - alpha)) + *s - 16);                     \
+                    if (nbits > 8) {                                                                       \
+                        if (i && yuv)                                                                      \
+                            *d = av_clip((*d * (max - alpha) + *s * alpha) / max + *s - mid, -mid, mid) + mid;\
+                        else                                                                               \
+                            *d = av_clip_uintp2((*d * (max - alpha) + *s * alpha) / max + *s - (16<<(nbits-8)),\
+                                                                                                        nbits);\
+                    } else {                                                                               \
+                        if (i && yuv)                                                                      \
+                            *d = av_clip(FAST_DIV255((*d - mid) * (max - alpha)) + *s - mid, -mid, mid) + mid;\
+                        else                                                                               \
+                            *d = av_clip_uint8(FAST_DIV255(*d * (255 - alpha)) + *s - 16);                 \
+                    }                                                                                      \
                 }                                                                                          \
+                s++;                                                                                       \
+                d += dst_step;                                                                             \
+                da += 1 << hsub;                                                                           \
+                a += 1 << hsub;                                                                            \
             }                                                                                              \
-            s++;                                                                                           \
-            d += dst_step;                                                                                 \
-            da += 1 << hsub;                                                                               \
-            a += 1 << hsub;                                                                                \
         }                                                                                                  \
         dp += dst->linesize[dst_plane] / bytes;                                                            \
         sp += src->linesize[i] / bytes;                                                                    \
@@ -566,7 +613,8 @@ DEFINE_BLEND_PLANE(8, 8)
 DEFINE_BLEND_PLANE(16, 10)
 
 #define DEFINE_ALPHA_COMPOSITE(depth, nbits)                                                               \
-static inline void alpha_composite_##depth##_##nbits##bits(const AVFrame *src, const AVFrame *dst,         \
+static inline void alpha_composite_##depth##_##nbits##bits(const OverlayContext *octx,                     \
+                                   const AVFrame *src, const AVFrame *dst,                                 \
                                    int src_w, int src_h,                                                   \
                                    int dst_w, int dst_h,                                                   \
                                    int x, int y,                                                           \
@@ -589,27 +637,32 @@ static inline void alpha_composite_##depth##_##nbits##bits(const AVFrame *src, c
     da = (uint##depth##_t *)(dst->data[3] + (y + slice_start) * dst->linesize[3]);                         \
                                                                                                            \
     for (i = slice_start; i < slice_end; i++) {                                                            \
-        j = FFMAX(-x, 0);                                                                                  \
-        s = sa + j;                                                                                        \
-        d = da + x+j;                                                                                      \
+        const OverlaySpan *span_end, *span = get_row_spans(octx, 0, i, &span_end);                         \
                                                                                                            \
-        for (jmax = FFMIN(-x + dst_w, src_w); j < jmax; j++) {                                             \
-            alpha = *s;                                                                                    \
-            if (alpha != 0 && alpha != max) {                                                              \
-                uint8_t alpha_d = *d;                                                                      \
-                alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);                                               \
-            }                                                                                              \
-            if (alpha == max)                                                                              \
-                *d = *s;                                                                                   \
-            else if (alpha > 0) {                                                                          \
-                /* apply alpha compositing: main_alpha += (1-main_alpha) * overlay_alpha */                \
-                if (nbits > 8)                                                                             \
-                    *d += (max - *d) * *s / max;                                                           \
-                else                                                                                       \
-                    *d += FAST_DIV255((max - *d) * *s);                                                    \
+        for (; span < span_end; span++) {                                                                  \
+            j    = FFMAX(FFMAX(-x, 0), span->start);                                                       \
+            jmax = FFMIN(FFMIN(-x + dst_w, src_w), span->end);                                             \
+            s = sa + j;                                                                                    \
+            d = da + x+j;                                                                                  \
+                                                                                                           \
+            for (; j < jmax; j++) {                                                                        \
+                alpha = *s;                                                                                \
+                if (alpha != 0 && alpha != max) {                                                          \
+                    uint8_t alpha_d = *d;                                                                  \
+                    alpha = UNPREMULTIPLY_ALPHA(alpha, alpha_d);                                           \
+                }                                                                                          \
+                if (alpha == max)                                                                          \
+                    *d = *s;                                                                               \
+                else if (alpha > 0) {                                                                      \
+                    /* apply alpha compositing: main_alpha += (1-main_alpha) * overlay_alpha */            \
+                    if (nbits > 8)                                                                         \
+                        *d += (max - *d) * *s / max;                                                       \
+                    else                                                                                   \
+                        *d += FAST_DIV255((max - *d) * *s);                                                \
+                }                                                                                          \
+                d += 1;                                                                                    \
+                s += 1;                                                                                    \
             }                                                                                              \
-            d += 1;                                                                                        \
-            s += 1;                                                                                        \
         }                                                                                                  \
         da += dst->linesize[3] / bytes;                                                                    \
         sa += src->linesize[3] / bytes;                                                                    \
@@ -644,7 +697,7 @@ static av_always_inline void blend_slice_yuv_##depth##_##nbits##bits(AVFilterCon
                 s->main_desc->comp[2].step, is_straight, 1, jobnr, nb_jobs);                               \
                                                                                                            \
     if (main_has_alpha)                                                                                    \
-        alpha_composite_##depth##_##nbits##bits(src, dst, src_w, src_h, dst_w, dst_h, x, y,                \
+        alpha_composite_##depth##_##nbits##bits(s, src, dst, src_w, src_h, dst_w, dst_h, x, y,             \
                                                 jobnr, nb_jobs);                                           \
 }
 DEFINE_BLEND_SLICE_YUV(8, 8)
@@ -676,7 +729,7 @@ static av_always_inline void blend_slice_planar_rgb(AVFilterContext *ctx,
                 jobnr, nb_jobs);
 
     if (main_has_alpha)
-        alpha_composite_8_8bits(src, dst, src_w, src_h, dst_w, dst_h, x, y, jobnr, nb_jobs);
+        alpha_composite_8_8bits(s, src, dst, src_w, src_h, dst_w, dst_h, x, y, jobnr, nb_jobs);
 }
 
 static int blend_slice_yuv420(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
@@ -996,15 +1049,123 @@ end:
     return 0;
 }
 
+/**
+ * Index the spans of each row of a plane of the overlay which are not
+ * fully transparent, subsampled the same way the chroma blending averages
+ * the alpha.
+ */
+static int build_span_index(OverlaySpanIndex *idx, const uint8_t *alpha, ptrdiff_t linesize,
+                            int step, int depth, int w, int h, int hsub, int vsub)
+{
+    const int wp = AV_CEIL_RSHIFT(w, hsub);
+    const int hp = AV_CEIL_RSHIFT(h, vsub);
+    const int max = (1 << depth) - 1;
+    int *row_spans, nb_spans = 0;
+
+#define ALPHA(x, y) (depth > 8 ? ((const uint16_t *)(alpha + (y) * linesize))[(x) * step] \
+                               : alpha[(y) * linesize + (x) * step])
+
+    row_spans = av_fast_realloc(idx->row_spans, &idx->row_spans_size,
+                                (hp + 1) * sizeof(*row_spans));
+    if (!row_spans)
+        return AVERROR(ENOMEM);
+    idx->row_spans = row_spans;
+
+    for (int j = 0; j < hp; j++) {
+        const int y0 = j << vsub;
+        /* the 16 bit chroma blending takes the vertical neighbour linesize
+         * samples below, which is two lines down */
+        const int y1 = vsub && j + 1 < hp ? y0 + 1 + (depth > 8) : y0;
+        OverlaySpan *spans = av_fast_realloc(idx->spans, &idx->spans_size,
+                                             (nb_spans + wp) * sizeof(*spans));
+        if (!spans)
+            return AVERROR(ENOMEM);
+        idx->spans = spans;
+        row_spans[j] = nb_spans;
+
+        for (int k = 0; k < wp; k++) {
+            const int x0 = k << hsub;
+            const int x1 = hsub && k + 1 < wp ? x0 + 1 : x0;
+            const int a00 = ALPHA(x0, y0), a01 = ALPHA(x1, y0);
+            const int a10 = ALPHA(x0, y1), a11 = ALPHA(x1, y1);
+            int opaque;
+
+            if (!(a00 | a01 | a10 | a11))
+                continue;
+            opaque = FFMIN(FFMIN(a00, a01), FFMIN(a10, a11)) == max;
+            if (nb_spans > row_spans[j] && spans[nb_spans - 1].end == k &&
+                spans[nb_spans - 1].opaque == opaque) {
+                spans[nb_spans - 1].end++;
+            } else {
+                spans[nb_spans].start  = k;
+                spans[nb_spans].end    = k + 1;
+                spans[nb_spans].opaque = opaque;
+                nb_spans++;
+            }
+        }
+    }
+    row_spans[hp] = nb_spans;
+
+#undef ALPHA
+    return 0;
+}
+
+/**
+ * Keep a reference to the overlay frame.
+ *
+ * @return 1 if the overlay repeats the previous one, as it does when
+ *         framesync repeats the last overlay frame, 0 if not, or a negative
+ *         error code
+ */
+static int track_overlay(OverlayContext *s, const AVFrame *overlay)
+{
+    if (s->last_overlay && ff_frame_is_repeat(s->last_overlay, overlay))
+        return 1;
+
+    s->span_index_valid = 0;
+    av_frame_free(&s->last_overlay);
+    s->last_overlay = av_frame_clone(overlay);
+    return s->last_overlay ? 0 : AVERROR(ENOMEM);
+}
+
+/**
+ * Index the transparent and opaque parts of a repeated overlay.
+ */
+static int update_span_index(OverlayContext *s, const AVFrame *overlay)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(overlay->format);
+    const AVComponentDescriptor *comp = &desc->comp[3];
+    const int plane = comp->plane;
+    const uint8_t *alpha = overlay->data[plane] + comp->offset;
+    const int step = comp->step / ((comp->depth + 7) / 8);
+    int ret;
+
+    /* transparent overlay pixels leave the main picture intact only with
+     * straight alpha */
+    if (s->alpha_format || s->span_index_valid)
+        return 0;
+
+    ret = build_span_index(&s->span_index[0], alpha, overlay->linesize[plane],
+                           step, comp->depth, overlay->width, overlay->height, 0, 0);
+    if (ret >= 0 && (desc->log2_chroma_w || desc->log2_chroma_h))
+        ret = build_span_index(&s->span_index[1], alpha, overlay->linesize[plane],
+                               step, comp->depth, overlay->width, overlay->height,
+                               desc->log2_chroma_w, desc->log2_chroma_h);
+    if (ret < 0)
+        return ret;
+    s->span_index_valid = 1;
+    return 0;
+}
+
 static int do_blend(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
-    AVFrame *mainpic, *second;
+    AVFrame *mainpic, *second, *out;
     OverlayContext *s = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
-    int ret;
+    int repeat, ret;
 
-    ret = ff_framesync_dualinput_get_writable(fs, &mainpic, &second);
+    ret = ff_framesync_dualinput_get(fs, &mainpic, &second);
     if (ret < 0)
         return ret;
     if (!second)
@@ -1036,16 +1197,51 @@ FF_ENABLE_DEPRECATION_WARNINGS
                s->var_values[VAR_Y], s->y);
     }
 
+    ret = repeat = track_overlay(s, second);
+    if (ret < 0)
+        goto fail;
+
+    if (!repeat || s->x != s->cache_x || s->y != s->cache_y) {
+        ff_frame_cache_reset(&s->cache);
+        s->cache_x = s->x;
+        s->cache_y = s->y;
+    }
+    ret = ff_frame_cache_get(&s->cache, mainpic, &out);
+    if (ret < 0)
+        goto fail;
+    if (ret > 0) {
+        av_frame_free(&mainpic);
+        return ff_filter_frame(ctx->outputs[0], out);
+    }
+
+    ret = ff_inlink_make_frame_writable(inlink, &mainpic);
+    if (ret < 0)
+        goto fail;
+
     if (s->x < mainpic->width  && s->x + second->width  >= 0 &&
         s->y < mainpic->height && s->y + second->height >= 0) {
         ThreadData td;
 
+        if (repeat) {
+            ret = update_span_index(s, second);
+            if (ret < 0)
+                goto fail;
+        }
+
         td.dst = mainpic;
         td.src = second;
         ff_filter_execute(ctx, s->blend_slice, &td, NULL, FFMIN(FFMAX(1, FFMIN3(s->y + second->height, FFMIN(second->height, mainpic->height), mainpic->height - s->y)),
                                                                 ff_filter_get_nb_threads(ctx)));
     }
+
+    ret = ff_frame_cache_put(&s->cache, mainpic);
+    if (ret < 0)
+        goto fail;
     return ff_filter_frame(ctx->outputs[0], mainpic);
+
+fail:
+    av_frame_free(&mainpic);
+    return ret;
 }
 
 static av_cold int init(AVFilterContext *ctx)
@@ -21,6 +21,7 @@
 
 #include "libavutil/eval.h"
 #include "libavutil/pixdesc.h"
+#include "framecache.h"
 #include "framesync.h"
 #include "avfilter.h"
 
@@ -53,6 +54,22 @@ enum OverlayFormat {
     OVERLAY_FORMAT_NB
 };
 
+typedef struct OverlaySpan {
+    int start, end;             ///< first and past the last column of the span
+    int opaque;                 ///< 1 if the overlay is fully opaque over the span
+} OverlaySpan;
+
+/**
+ * Spans of the overlay which are not fully transparent, for each row of
+ * a plane.
+ */
+typedef struct OverlaySpanIndex {
+    OverlaySpan *spans;
+    unsigned int spans_size;
+    int *row_spans;             ///< index of the first span of each row, plus the end of the last one
+    unsigned int row_spans_size;
+} OverlaySpanIndex;
+
 typedef struct OverlayContext {
     const AVClass *class;
     int x, y;                   ///< position of overlaid picture
@@ -82,6 +99,23 @@ typedef struct OverlayContext {
     int (*blend_row[4])(uint8_t *d, uint8_t *da, uint8_t *s, uint8_t *a, int w,
                         ptrdiff_t alinesize);
     int (*blend_slice)(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs);
+
+    AVFrame *last_overlay;      ///< last overlay frame, to detect repeats
+
+    /**
+     * Span indexes of a static overlay, for the full resolution and the
+     * chroma planes. They are built when the same overlay frame is blended
+     * twice in a row.
+     */
+    OverlaySpanIndex span_index[2];
+    int span_index_valid;
+
+    /**
+     * Output for a repeated main frame, valid while the overlay also repeats
+     * at the same position.
+     */
+    FFFrameCache cache;
+    int cache_x, cache_y;
 } OverlayContext;
 
 void ff_overlay_init_x86(OverlayContext *s, int format, int pix_format,
@@ -29,6 +29,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/intreadwrite.h"
 #include "avfilter.h"
+#include "filters.h"
 #include "internal.h"
 #include "palette.h"
 
@@ -71,9 +72,16 @@ typedef struct PaletteGenContext {
     int max_colors;
     int reserve_transparent;
     int stats_mode;
+    int sample_frames;                      // number of frames to build the palette from before pushing it, 0 for all
+    int sample_stride;                      // use one frame out of this many for the sample
+    int64_t nb_frames;                      // number of input frames seen
+    int nb_sampled;                         // number of frames added to the histogram
 
     AVFrame *prev_frame;                    // previous frame used for the diff stats_mode
     struct hist_node histogram[HIST_SIZE];  // histogram/hashtable of the colors
+    struct hist_node *slice_histograms;     // HIST_SIZE nodes per job, merged into histogram after each frame
+    int *job_rets;                          // return values of the jobs
+    int nb_jobs;                            // number of slice jobs, 1 without slice threading
     struct color_ref **refs;                // references of all the colors used in the stream
     int nb_refs;                            // number of color references (or number of different colors)
     struct range_box boxes[256];            // define the segmentation of the colorspace (the final palette)
@@ -92,6 +100,8 @@ static const AVOption palettegen_options[] = {
         { "full", "compute full frame histograms", 0, AV_OPT_TYPE_CONST, {.i64=STATS_MODE_ALL_FRAMES}, INT_MIN, INT_MAX, FLAGS, "mode" },
         { "diff", "compute histograms only for the part that differs from previous frame", 0, AV_OPT_TYPE_CONST, {.i64=STATS_MODE_DIFF_FRAMES}, INT_MIN, INT_MAX, FLAGS, "mode" },
         { "single", "compute new histogram for each frame", 0, AV_OPT_TYPE_CONST, {.i64=STATS_MODE_SINGLE_FRAMES}, INT_MIN, INT_MAX, FLAGS, "mode" },
+    { "sample_frames", "push the palette once this many frames are sampled", OFFSET(sample_frames), AV_OPT_TYPE_INT, {.i64=0}, 0, INT_MAX, FLAGS },
+    { "sample_stride", "sample one frame out of this many", OFFSET(sample_stride), AV_OPT_TYPE_INT, {.i64=1}, 1, INT_MAX, FLAGS },
     { NULL }
 };
 
@@ -387,9 +397,12 @@ static AVFrame *get_palette_frame(AVFilterContext *ctx)
 }
 
 /**
- * Locate the color in the hash table and increment its counter.
+ * Locate the color in the hash table and increase its counter. The OkLab
+ * value of a new color is only computed if with_lab is set, the slice
+ * histograms leave it to the merge.
  */
-static int color_inc(struct hist_node *hist, uint32_t color)
+static av_always_inline int color_inc(struct hist_node *hist, uint32_t color,
+                                      int64_t count, int with_lab)
 {
     const uint32_t hash = ff_lowbias32(color) & (HIST_SIZE - 1);
     struct hist_node *node = &hist[hash];
@@ -398,7 +411,7 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     for (int i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color) {
-            e->count++;
+            e->count += count;
             return 0;
         }
     }
@@ -408,27 +421,29 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     if (!e)
         return AVERROR(ENOMEM);
     e->color = color;
-    e->lab = ff_srgb_u8_to_oklab_int(color);
-    e->count = 1;
+    if (with_lab)
+        e->lab = ff_srgb_u8_to_oklab_int(color);
+    e->count = count;
     return 1;
 }
 
 /**
  * Update histogram when pixels differ from previous frame.
  */
-static int update_histogram_diff(struct hist_node *hist,
-                                 const AVFrame *f1, const AVFrame *f2)
+static av_always_inline int update_histogram_diff(struct hist_node *hist,
+                                                  const AVFrame *f1, const AVFrame *f2,
+                                                  int y_start, int y_end, int with_lab)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f1->height; y++) {
+    for (y = y_start; y < y_end; y++) {
         const uint32_t *p = (const uint32_t *)(f1->data[0] + y*f1->linesize[0]);
         const uint32_t *q = (const uint32_t *)(f2->data[0] + y*f2->linesize[0]);
 
         for (x = 0; x < f1->width; x++) {
             if (p[x] == q[x])
                 continue;
-            ret = color_inc(hist, p[x]);
+            ret = color_inc(hist, p[x], 1, with_lab);
             if (ret < 0)
                 return ret;
             nb_diff_colors += ret;
@@ -440,15 +455,16 @@ static int update_histogram_diff(struct hist_node *hist,
 /**
  * Simple histogram of the frame.
  */
-static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
+static av_always_inline int update_histogram_frame(struct hist_node *hist, const AVFrame *f,
+                                                   int y_start, int y_end, int with_lab)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f->height; y++) {
+    for (y = y_start; y < y_end; y++) {
         const uint32_t *p = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
 
         for (x = 0; x < f->width; x++) {
-            ret = color_inc(hist, p[x]);
+            ret = color_inc(hist, p[x], 1, with_lab);
             if (ret < 0)
                 return ret;
             nb_diff_colors += ret;
@@ -457,6 +473,77 @@ static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
     return nb_diff_colors;
 }
 
+typedef struct ThreadData {
+    const AVFrame *in, *prev;
+} ThreadData;
+
+static int histogram_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    struct hist_node *hist = s->slice_histograms + jobnr * HIST_SIZE;
+    const int slice_start = (td->in->height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (td->in->height * (jobnr + 1)) / nb_jobs;
+    const int ret = td->prev ? update_histogram_diff(hist, td->prev, td->in, slice_start, slice_end, 0)
+                             : update_histogram_frame(hist, td->in, slice_start, slice_end, 0);
+
+    return FFMIN(ret, 0);
+}
+
+/**
+ * Merge a range of buckets of the slice histograms into the main one, and
+ * return the number of new colors. The slice histograms are visited in order
+ * so the colors end up in the same order as if the frame had been scanned
+ * by a single thread.
+ */
+static int merge_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const int start = (HIST_SIZE *  jobnr     ) / nb_jobs;
+    const int end   = (HIST_SIZE * (jobnr + 1)) / nb_jobs;
+    int nb_new_colors = 0;
+
+    for (int i = start; i < end; i++) {
+        for (int j = 0; j < s->nb_jobs; j++) {
+            struct hist_node *node = &s->slice_histograms[j * HIST_SIZE + i];
+
+            for (int k = 0; k < node->nb_entries; k++) {
+                const struct color_ref *e = &node->entries[k];
+                const int ret = color_inc(s->histogram, e->color, e->count, 1);
+                if (ret < 0)
+                    return ret;
+                nb_new_colors += ret;
+            }
+            node->nb_entries = 0;
+        }
+    }
+    return nb_new_colors;
+}
+
+static int update_histogram(AVFilterContext *ctx, const AVFrame *in, const AVFrame *prev)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData td = { .in = in, .prev = prev };
+    int nb_new_colors = 0;
+
+    if (s->nb_jobs == 1)
+        return prev ? update_histogram_diff(s->histogram, prev, in, 0, in->height, 1)
+                    : update_histogram_frame(s->histogram, in, 0, in->height, 1);
+
+    ff_filter_execute(ctx, histogram_slice, &td, s->job_rets, s->nb_jobs);
+    for (int i = 0; i < s->nb_jobs; i++)
+        if (s->job_rets[i] < 0)
+            return s->job_rets[i];
+
+    ff_filter_execute(ctx, merge_slice, NULL, s->job_rets, s->nb_jobs);
+    for (int i = 0; i < s->nb_jobs; i++) {
+        if (s->job_rets[i] < 0)
+            return s->job_rets[i];
+        nb_new_colors += s->job_rets[i];
+    }
+    return nb_new_colors;
+}
+
 /**
  * Update the histogram for each passing frame. No frame will be pushed here.
  */
@@ -464,13 +551,19 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     PaletteGenContext *s = ctx->priv;
+    const int64_t pts = in->pts;
     int ret;
 
     if (in->color_trc != AVCOL_TRC_UNSPECIFIED && in->color_trc != AVCOL_TRC_IEC61966_2_1)
         av_log(ctx, AV_LOG_WARNING, "The input frame is not in sRGB, colors may be off\n");
 
-    ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
-                        : update_histogram_frame(s->histogram, in);
+    /* skip the frames out of the sample */
+    if (s->nb_frames++ % s->sample_stride) {
+        av_frame_free(&in);
+        return 0;
+    }
+
+    ret = update_histogram(ctx, in, s->prev_frame);
     if (ret > 0)
         s->nb_refs += ret;
 
@@ -496,6 +589,23 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_free(&in);
     }
 
+    if (s->sample_frames && ++s->nb_sampled >= s->sample_frames && s->nb_refs) {
+        AVFrame *out = get_palette_frame(ctx);
+
+        if (!out)
+            return AVERROR(ENOMEM);
+        s->palette_pushed = 1;
+        ret = ff_filter_frame(ctx->outputs[0], out);
+        if (ret < 0)
+            return ret;
+
+        /* nothing else will be output: let paletteuse go on without waiting
+         * for the end of the stream, and stop receiving frames */
+        ff_outlink_set_status(ctx->outputs[0], AVERROR_EOF, pts);
+        ff_inlink_set_status(inlink, AVERROR_EOF);
+        return 0;
+    }
+
     return ret;
 }
 
@@ -537,6 +647,20 @@ static int init(AVFilterContext *ctx)
         return AVERROR(EINVAL);
     }
 
+    if (s->stats_mode == STATS_MODE_SINGLE_FRAMES &&
+        (s->sample_frames || s->sample_stride > 1)) {
+        av_log(ctx, AV_LOG_ERROR, "sample_frames and sample_stride can not be used with stats_mode=single\n");
+        return AVERROR(EINVAL);
+    }
+
+    s->nb_jobs = ctx->thread_type & AVFILTER_THREAD_SLICE ? ff_filter_get_nb_threads(ctx) : 1;
+    if (s->nb_jobs > 1) {
+        s->slice_histograms = av_calloc(s->nb_jobs, HIST_SIZE * sizeof(*s->slice_histograms));
+        s->job_rets         = av_calloc(s->nb_jobs, sizeof(*s->job_rets));
+        if (!s->slice_histograms || !s->job_rets)
+            return AVERROR(ENOMEM);
+    }
+
     return 0;
 }
 
@@ -547,6 +671,12 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     for (i = 0; i < HIST_SIZE; i++)
         av_freep(&s->histogram[i].entries);
+    if (s->slice_histograms) {
+        for (i = 0; i < s->nb_jobs * HIST_SIZE; i++)
+            av_freep(&s->slice_histograms[i].entries);
+        av_freep(&s->slice_histograms);
+    }
+    av_freep(&s->job_rets);
     av_freep(&s->refs);
     av_frame_free(&s->prev_frame);
 }
@@ -578,4 +708,5 @@ const AVFilter ff_vf_palettegen = {
     FILTER_OUTPUTS(palettegen_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .priv_class    = &palettegen_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -24,11 +24,16 @@
  * Use a palette to downsample an input video stream.
  */
 
+#include <stdatomic.h>
+
 #include "libavutil/bprint.h"
 #include "libavutil/file_open.h"
+#include "libavutil/imgutils_internal.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
 #include "libavutil/qsort.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "framesync.h"
@@ -78,15 +83,44 @@ struct cache_node {
     int nb_entries;
 };
 
+/* nearest color lookup table, indexed by the LUT_BITS most significant bits
+ * of each RGB component */
+#define LUT_BITS 6
+#define LUT_MASK ((1 << LUT_BITS) - 1)
+#define LUT_SIZE (1 << (3 * LUT_BITS))
+#define LUT_GRID ((1 << LUT_BITS) + 1) /* lattice points along each axis */
+
+/* error diffusion rows are processed in steps of WAVEFRONT_STEP pixels, and a
+ * row may only process a step once the row above is done WAVEFRONT_LAG pixels
+ * past it; the lag covers the widest kernel reach (2 pixels left on the rows
+ * below plus 2 pixels right on the current one) */
+#define WAVEFRONT_STEP 16
+#define WAVEFRONT_LAG  4
+
+/* progress of the rows handled by one job, see wait_row() */
+struct row_sync {
+    atomic_int progress;
+    atomic_int waiting;
+#if HAVE_THREADS
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+#endif
+};
+
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                              int x_start, int y_start, int width, int height);
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in,
+                              int x_start, int y_start, int width, int height,
+                              int jobnr, int nb_jobs);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup cache, CACHE_SIZE nodes per job */
+    struct row_sync *sync;                  /* one per job, for the error diffusion wavefront */
+    int *job_rets;
+    int nb_jobs;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -98,6 +132,9 @@ typedef struct PaletteUseContext {
     int bayer_scale;
     int ordered_dither[8*8];
     int diff_mode;
+    int use_lut;
+    int16_t *lut;           /* palette index for each LUT cell, -1 if the cell needs an exact lookup */
+    uint8_t *lut_grid;      /* nearest palette index at each lattice point, only used while building */
     AVFrame *last_in;
     AVFrame *last_out;
 
@@ -124,6 +161,7 @@ static const AVOption paletteuse_options[] = {
         { "rectangle", "process smallest different rectangle", 0, AV_OPT_TYPE_CONST, {.i64=DIFF_MODE_RECTANGLE}, INT_MIN, INT_MAX, FLAGS, "diff_mode" },
     { "new", "take new palette for each output frame", OFFSET(new), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     { "alpha_threshold", "set the alpha threshold for transparency", OFFSET(trans_thresh), AV_OPT_TYPE_INT, {.i64=128}, 0, 255, FLAGS },
+    { "lut", "use a precomputed, approximate nearest color table for a fixed palette", OFFSET(use_lut), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
 
     /* following are the debug options, not part of the official API */
     { "debug_kdtree", "save Graphviz graph of the kdtree in specified file", OFFSET(dot_filename), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, FLAGS },
@@ -231,15 +269,23 @@ struct stack_node {
     int dx2;
 };
 
+static av_always_inline int lut_index(uint32_t color)
+{
+    return (color >> (24 - LUT_BITS) & LUT_MASK) << (2 * LUT_BITS)
+         | (color >> (16 - LUT_BITS) & LUT_MASK) <<      LUT_BITS
+         | (color >> ( 8 - LUT_BITS) & LUT_MASK);
+}
+
 /**
  * Check if the requested color is in the cache already. If not, find it in the
  * color tree and cache it.
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color)
 {
     struct color_info clrinfo;
-    const uint32_t hash = ff_lowbias32(color) & (CACHE_SIZE - 1);
-    struct cache_node *node = &s->cache[hash];
+    uint32_t hash;
+    struct cache_node *node;
     struct cached_color *e;
 
     // first, check for transparency
@@ -247,6 +293,15 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
         return s->transparency_index;
     }
 
+    if (s->lut && color>>24 >= s->trans_thresh) {
+        const int pal_entry = s->lut[lut_index(color)];
+        if (pal_entry >= 0)
+            return pal_entry;
+    }
+
+    hash = ff_lowbias32(color) & (CACHE_SIZE - 1);
+    node = &cache[hash];
+
     for (int i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color)
@@ -264,11 +319,11 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb)
 {
     uint32_t dstc;
-    const int dstx = color_get(s, c);
+    const int dstx = color_get(s, cache, c);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -285,174 +340,264 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
-                                      int x_start, int y_start, int w, int h,
-                                      enum dithering_mode dither)
+/**
+ * Map the pixels x0 to x1 of the row y. The processing window spans x_start
+ * to w and up to h, these bound the error diffusion.
+ */
+static av_always_inline int set_row(PaletteUseContext *s, struct cache_node *cache,
+                                    uint32_t *src, int src_linesize, uint8_t *dst,
+                                    int x0, int x1, int y,
+                                    int x_start, int w, int h,
+                                    enum dithering_mode dither)
 {
-    const int src_linesize = in ->linesize[0] >> 2;
-    const int dst_linesize = out->linesize[0];
-    uint32_t *src = ((uint32_t *)in ->data[0]) + y_start*src_linesize;
-    uint8_t  *dst =              out->data[0]  + y_start*dst_linesize;
-
-    w += x_start;
-    h += y_start;
-
-    for (int y = y_start; y < h; y++) {
-        for (int x = x_start; x < w; x++) {
-            int er, eg, eb;
-
-            if (dither == DITHERING_BAYER) {
-                const int d = s->ordered_dither[(y & 7)<<3 | (x & 7)];
-                const uint8_t a8 = src[x] >> 24;
-                const uint8_t r8 = src[x] >> 16 & 0xff;
-                const uint8_t g8 = src[x] >>  8 & 0xff;
-                const uint8_t b8 = src[x]       & 0xff;
-                const uint8_t r = av_clip_uint8(r8 + d);
-                const uint8_t g = av_clip_uint8(g8 + d);
-                const uint8_t b = av_clip_uint8(b8 + d);
-                const uint32_t color_new = (unsigned)(a8) << 24 | r << 16 | g << 8 | b;
-                const int color = color_get(s, color_new);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-            } else if (dither == DITHERING_HECKBERT) {
-                const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 3, 3);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 3, 3);
-                if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 2, 3);
-
-            } else if (dither == DITHERING_FLOYD_STEINBERG) {
-                const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 7, 4);
-                if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 3, 4);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 5, 4);
-                if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 1, 4);
-
-            } else if (dither == DITHERING_SIERRA2) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)          src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 4, 4);
-                if (right2)         src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 4);
-
-                if (down) {
-                    if (left2)      src[  src_linesize + x - 2] = dither_color(src[  src_linesize + x - 2], er, eg, eb, 1, 4);
-                    if (left)       src[  src_linesize + x - 1] = dither_color(src[  src_linesize + x - 1], er, eg, eb, 2, 4);
-                    if (1)          src[  src_linesize + x    ] = dither_color(src[  src_linesize + x    ], er, eg, eb, 3, 4);
-                    if (right)      src[  src_linesize + x + 1] = dither_color(src[  src_linesize + x + 1], er, eg, eb, 2, 4);
-                    if (right2)     src[  src_linesize + x + 2] = dither_color(src[  src_linesize + x + 2], er, eg, eb, 1, 4);
-                }
+    for (int x = x0; x < x1; x++) {
+        int er, eg, eb;
+
+        if (dither == DITHERING_BAYER) {
+            const int d = s->ordered_dither[(y & 7)<<3 | (x & 7)];
+            const uint8_t a8 = src[x] >> 24;
+            const uint8_t r8 = src[x] >> 16 & 0xff;
+            const uint8_t g8 = src[x] >>  8 & 0xff;
+            const uint8_t b8 = src[x]       & 0xff;
+            const uint8_t r = av_clip_uint8(r8 + d);
+            const uint8_t g = av_clip_uint8(g8 + d);
+            const uint8_t b = av_clip_uint8(b8 + d);
+            const uint32_t color_new = (unsigned)(a8) << 24 | r << 16 | g << 8 | b;
+            const int color = color_get(s, cache, color_new);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+        } else if (dither == DITHERING_HECKBERT) {
+            const int right = x < w - 1, down = y < h - 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 3, 3);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 3, 3);
+            if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 2, 3);
+
+        } else if (dither == DITHERING_FLOYD_STEINBERG) {
+            const int right = x < w - 1, down = y < h - 1, left = x > x_start;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 7, 4);
+            if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 3, 4);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 5, 4);
+            if (right && down) src[src_linesize + x + 1] = dither_color(src[src_linesize + x + 1], er, eg, eb, 1, 4);
+
+        } else if (dither == DITHERING_SIERRA2) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2,                    left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)          src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 4, 4);
+            if (right2)         src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 4);
+
+            if (down) {
+                if (left2)      src[  src_linesize + x - 2] = dither_color(src[  src_linesize + x - 2], er, eg, eb, 1, 4);
+                if (left)       src[  src_linesize + x - 1] = dither_color(src[  src_linesize + x - 1], er, eg, eb, 2, 4);
+                if (1)          src[  src_linesize + x    ] = dither_color(src[  src_linesize + x    ], er, eg, eb, 3, 4);
+                if (right)      src[  src_linesize + x + 1] = dither_color(src[  src_linesize + x + 1], er, eg, eb, 2, 4);
+                if (right2)     src[  src_linesize + x + 2] = dither_color(src[  src_linesize + x + 2], er, eg, eb, 1, 4);
+            }
 
-            } else if (dither == DITHERING_SIERRA2_4A) {
-                const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 2, 2);
-                if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 1, 2);
-                if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 1, 2);
-
-            } else if (dither == DITHERING_SIERRA3) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2, down2 = y < h - 2, left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
-
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-
-                if (right)         src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 5, 5);
-                if (right2)        src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 5);
-
-                if (down) {
-                    if (left2)     src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
-                    if (left)      src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
-                    if (1)         src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 5, 5);
-                    if (right)     src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
-                    if (right2)    src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
-
-                    if (down2) {
-                        if (left)  src[src_linesize*2 + x - 1] = dither_color(src[src_linesize*2 + x - 1], er, eg, eb, 2, 5);
-                        if (1)     src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 3, 5);
-                        if (right) src[src_linesize*2 + x + 1] = dither_color(src[src_linesize*2 + x + 1], er, eg, eb, 2, 5);
-                    }
+        } else if (dither == DITHERING_SIERRA2_4A) {
+            const int right = x < w - 1, down = y < h - 1, left = x > x_start;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[               x + 1] = dither_color(src[               x + 1], er, eg, eb, 2, 2);
+            if (left  && down) src[src_linesize + x - 1] = dither_color(src[src_linesize + x - 1], er, eg, eb, 1, 2);
+            if (         down) src[src_linesize + x    ] = dither_color(src[src_linesize + x    ], er, eg, eb, 1, 2);
+
+        } else if (dither == DITHERING_SIERRA3) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2, down2 = y < h - 2, left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
+
+            if (color < 0)
+                return color;
+            dst[x] = color;
+
+            if (right)         src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 5, 5);
+            if (right2)        src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 3, 5);
+
+            if (down) {
+                if (left2)     src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
+                if (left)      src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
+                if (1)         src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 5, 5);
+                if (right)     src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
+                if (right2)    src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
+
+                if (down2) {
+                    if (left)  src[src_linesize*2 + x - 1] = dither_color(src[src_linesize*2 + x - 1], er, eg, eb, 2, 5);
+                    if (1)     src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 3, 5);
+                    if (right) src[src_linesize*2 + x + 1] = dither_color(src[src_linesize*2 + x + 1], er, eg, eb, 2, 5);
                 }
+            }
 
-            } else if (dither == DITHERING_BURKES) {
-                const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
-                const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+        } else if (dither == DITHERING_BURKES) {
+            const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
+            const int right2 = x < w - 2,                    left2 = x > x_start + 1;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
+            if (color < 0)
+                return color;
+            dst[x] = color;
 
-                if (right)      src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 8, 5);
-                if (right2)     src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 4, 5);
+            if (right)      src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 8, 5);
+            if (right2)     src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 4, 5);
 
-                if (down) {
-                    if (left2)  src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
-                    if (left)   src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
-                    if (1)      src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 8, 5);
-                    if (right)  src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
-                    if (right2) src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
-                }
+            if (down) {
+                if (left2)  src[src_linesize   + x - 2] = dither_color(src[src_linesize   + x - 2], er, eg, eb, 2, 5);
+                if (left)   src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 4, 5);
+                if (1)      src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 8, 5);
+                if (right)  src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 4, 5);
+                if (right2) src[src_linesize   + x + 2] = dither_color(src[src_linesize   + x + 2], er, eg, eb, 2, 5);
+            }
 
-            } else if (dither == DITHERING_ATKINSON) {
-                const int right  = x < w - 1, down  = y < h - 1, left = x > x_start;
-                const int right2 = x < w - 2, down2 = y < h - 2;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+        } else if (dither == DITHERING_ATKINSON) {
+            const int right  = x < w - 1, down  = y < h - 1, left = x > x_start;
+            const int right2 = x < w - 2, down2 = y < h - 2;
+            const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
+            if (color < 0)
+                return color;
+            dst[x] = color;
 
-                if (right)     src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 1, 3);
-                if (right2)    src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 1, 3);
+            if (right)     src[                 x + 1] = dither_color(src[                 x + 1], er, eg, eb, 1, 3);
+            if (right2)    src[                 x + 2] = dither_color(src[                 x + 2], er, eg, eb, 1, 3);
 
-                if (down) {
-                    if (left)  src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 1, 3);
-                    if (1)     src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 1, 3);
-                    if (right) src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 1, 3);
-                    if (down2) src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 1, 3);
-                }
+            if (down) {
+                if (left)  src[src_linesize   + x - 1] = dither_color(src[src_linesize   + x - 1], er, eg, eb, 1, 3);
+                if (1)     src[src_linesize   + x    ] = dither_color(src[src_linesize   + x    ], er, eg, eb, 1, 3);
+                if (right) src[src_linesize   + x + 1] = dither_color(src[src_linesize   + x + 1], er, eg, eb, 1, 3);
+                if (down2) src[src_linesize*2 + x    ] = dither_color(src[src_linesize*2 + x    ], er, eg, eb, 1, 3);
+            }
 
-            } else {
-                const int color = color_get(s, src[x]);
+        } else {
+            const int color = color_get(s, cache, src[x]);
 
-                if (color < 0)
-                    return color;
-                dst[x] = color;
-            }
+            if (color < 0)
+                return color;
+            dst[x] = color;
         }
-        src += src_linesize;
-        dst += dst_linesize;
     }
     return 0;
 }
 
+#if HAVE_THREADS
+/**
+ * Wait until the job owning the row above has made the given progress. The
+ * progress of a job only grows, it counts the pixels done over all its rows.
+ */
+static void wait_row(struct row_sync *sync, int progress)
+{
+    if (atomic_load(&sync->progress) >= progress)
+        return;
+
+    pthread_mutex_lock(&sync->mutex);
+    atomic_store(&sync->waiting, 1);
+    while (atomic_load(&sync->progress) < progress)
+        pthread_cond_wait(&sync->cond, &sync->mutex);
+    atomic_store(&sync->waiting, 0);
+    pthread_mutex_unlock(&sync->mutex);
+}
+
+static void report_row(struct row_sync *sync, int progress)
+{
+    atomic_store(&sync->progress, progress);
+    if (atomic_load(&sync->waiting)) {
+        pthread_mutex_lock(&sync->mutex);
+        pthread_cond_broadcast(&sync->cond);
+        pthread_mutex_unlock(&sync->mutex);
+    }
+}
+#else
+static void wait_row(struct row_sync *sync, int progress) {}
+static void report_row(struct row_sync *sync, int progress) {}
+#endif
+
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
+                                      int x_start, int y_start, int w, int h,
+                                      int jobnr, int nb_jobs,
+                                      enum dithering_mode dither)
+{
+    const int src_linesize = in ->linesize[0] >> 2;
+    const int dst_linesize = out->linesize[0];
+    uint32_t *src = (uint32_t *)in->data[0];
+    uint8_t  *dst = out->data[0];
+    const int width = w;
+    int ret = 0;
+
+    w += x_start;
+    h += y_start;
+
+    if (dither == DITHERING_NONE || dither == DITHERING_BAYER) {
+        /* no dependency between the pixels, every job gets a band of rows */
+        const int slice_start = y_start + ((h - y_start) *  jobnr     ) / nb_jobs;
+        const int slice_end   = y_start + ((h - y_start) * (jobnr + 1)) / nb_jobs;
+
+        for (int y = slice_start; y < slice_end; y++) {
+            ret = set_row(s, cache, src + y*src_linesize, src_linesize, dst + y*dst_linesize,
+                          x_start, w, y, x_start, w, h, dither);
+            if (ret < 0)
+                return ret;
+        }
+        return 0;
+    }
+
+    if (nb_jobs == 1) {
+        for (int y = y_start; y < h; y++) {
+            ret = set_row(s, cache, src + y*src_linesize, src_linesize, dst + y*dst_linesize,
+                          x_start, w, y, x_start, w, h, dither);
+            if (ret < 0)
+                return ret;
+        }
+        return 0;
+    }
+
+    /* Error diffusion: the rows are dealt to the jobs in turn and every row
+     * trails the one above it, so each pixel receives its error contributions
+     * in the same order as with a single job. The progress is still reported
+     * after an error, to not leave the other jobs waiting. */
+    for (int y = y_start + jobnr, k = 0; y < h; y += nb_jobs, k++) {
+        struct row_sync *prev = &s->sync[(jobnr + nb_jobs - 1) % nb_jobs];
+        /* the row above belongs to the previous job, as its k-th row, or as
+         * its row before that for the first job */
+        const int prev_base = (k - !jobnr) * width;
+
+        for (int x = x_start; x < w; x += WAVEFRONT_STEP) {
+            const int x_end = FFMIN(x + WAVEFRONT_STEP, w);
+
+            if (y > y_start)
+                wait_row(prev, prev_base + FFMIN(x_end + WAVEFRONT_LAG, w) - x_start);
+            if (ret >= 0)
+                ret = set_row(s, cache, src + y*src_linesize, src_linesize, dst + y*dst_linesize,
+                              x, x_end, y, x_start, w, h, dither);
+            report_row(&s->sync[jobnr], k * width + x_end - x_start);
+        }
+    }
+    return ret;
+}
+
 #define INDENT 4
 static void disp_node(AVBPrint *buf,
                       const struct color_node *map,
@@ -674,6 +819,105 @@ static void load_colormap(PaletteUseContext *s)
         disp_tree(s->map, s->dot_filename);
 }
 
+static int lut_grid_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const int start = (LUT_GRID *  jobnr     ) / nb_jobs;
+    const int end   = (LUT_GRID * (jobnr + 1)) / nb_jobs;
+
+    for (int r = start; r < end; r++) {
+        for (int g = 0; g < LUT_GRID; g++) {
+            uint32_t srgb[LUT_GRID];
+            struct Lab lab[LUT_GRID];
+
+            for (int b = 0; b < LUT_GRID; b++)
+                srgb[b] = 0xffU << 24
+                        | FFMIN(r << (8 - LUT_BITS), 255) << 16
+                        | FFMIN(g << (8 - LUT_BITS), 255) <<  8
+                        | FFMIN(b << (8 - LUT_BITS), 255);
+            ff_srgb_u8_to_oklab_int_array(lab, srgb, LUT_GRID);
+
+            for (int b = 0; b < LUT_GRID; b++) {
+                const struct color_info clrinfo = {
+                    .srgb = srgb[b], .lab = { lab[b].L, lab[b].a, lab[b].b },
+                };
+
+                s->lut_grid[(r * LUT_GRID + g) * LUT_GRID + b] =
+                    colormap_nearest(s->map, &clrinfo, s->trans_thresh);
+            }
+        }
+    }
+    return 0;
+}
+
+static int lut_cells_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const int start = ((1 << LUT_BITS) *  jobnr     ) / nb_jobs;
+    const int end   = ((1 << LUT_BITS) * (jobnr + 1)) / nb_jobs;
+    const uint8_t *grid = s->lut_grid;
+    const int gs = LUT_GRID, ps = LUT_GRID * LUT_GRID;
+    int *nb_ambiguous = arg;
+    int count = 0;
+
+    for (int r = start; r < end; r++) {
+        for (int g = 0; g < 1 << LUT_BITS; g++) {
+            for (int b = 0; b < 1 << LUT_BITS; b++) {
+                const uint8_t *p = grid + (r * LUT_GRID + g) * LUT_GRID + b;
+                const int c = p[0];
+                int16_t *dst = &s->lut[(r << (2 * LUT_BITS)) | (g << LUT_BITS) | b];
+
+                /* if all the corners of the cell share their nearest color,
+                 * assume the whole cell does; this is not guaranteed, the
+                 * region of another entry may lie inside the cell without
+                 * reaching its corners */
+                if (p[         1] == c && p[     gs    ] == c && p[     gs + 1] == c &&
+                    p[ps        ] == c && p[ps      + 1] == c &&
+                    p[ps + gs   ] == c && p[ps + gs + 1] == c) {
+                    *dst = c;
+                } else {
+                    *dst = -1;
+                    count++;
+                }
+            }
+        }
+    }
+    nb_ambiguous[jobnr] = count;
+    return 0;
+}
+
+static int build_lut(AVFilterContext *ctx)
+{
+    PaletteUseContext *s = ctx->priv;
+    const int nb_jobs = FFMIN(ff_filter_get_nb_threads(ctx), 1 << LUT_BITS);
+    const int64_t start = av_gettime_relative();
+    int nb_ambiguous[1 << LUT_BITS] = {0};
+    int total = 0;
+
+    if (!s->lut) {
+        s->lut = av_malloc_array(LUT_SIZE, sizeof(*s->lut));
+        if (!s->lut)
+            return AVERROR(ENOMEM);
+    }
+    s->lut_grid = av_malloc(LUT_GRID * LUT_GRID * LUT_GRID);
+    if (!s->lut_grid) {
+        av_freep(&s->lut);
+        return AVERROR(ENOMEM);
+    }
+
+    ff_filter_execute(ctx, lut_grid_slice,  NULL,         NULL, FFMIN(nb_jobs, LUT_GRID));
+    ff_filter_execute(ctx, lut_cells_slice, nb_ambiguous, NULL, nb_jobs);
+    av_freep(&s->lut_grid);
+
+    for (int i = 0; i < nb_jobs; i++)
+        total += nb_ambiguous[i];
+
+    av_log(ctx, AV_LOG_VERBOSE, "Built %d bits per component color table in %.3f ms, "
+           "%.1f%% of the cells need an exact lookup\n", LUT_BITS,
+           (av_gettime_relative() - start) / 1000., total * 100. / LUT_SIZE);
+    return 0;
+}
+
 static void set_processing_window(enum diff_mode diff_mode,
                                   const AVFrame *prv_src, const AVFrame *cur_src,
                                   const AVFrame *prv_dst,       AVFrame *cur_dst,
@@ -684,77 +928,33 @@ static void set_processing_window(enum diff_mode diff_mode,
     int height = cur_src->height;
 
     if (prv_src->data[0] && diff_mode == DIFF_MODE_RECTANGLE) {
-        int y;
-        int x_end = cur_src->width  - 1,
-            y_end = cur_src->height - 1;
-        const uint32_t *prv_srcp = (const uint32_t *)prv_src->data[0];
-        const uint32_t *cur_srcp = (const uint32_t *)cur_src->data[0];
-        const uint8_t  *prv_dstp = prv_dst->data[0];
-        uint8_t        *cur_dstp = cur_dst->data[0];
-
-        const int prv_src_linesize = prv_src->linesize[0] >> 2;
-        const int cur_src_linesize = cur_src->linesize[0] >> 2;
+        const uint8_t *prv_dstp = prv_dst->data[0];
+        uint8_t       *cur_dstp = cur_dst->data[0];
         const int prv_dst_linesize = prv_dst->linesize[0];
         const int cur_dst_linesize = cur_dst->linesize[0];
-
-        /* skip common lines */
-        while (y_start < y_end && !memcmp(prv_srcp + y_start*prv_src_linesize,
-                                          cur_srcp + y_start*cur_src_linesize,
-                                          cur_src->width * 4)) {
-            memcpy(cur_dstp + y_start*cur_dst_linesize,
-                   prv_dstp + y_start*prv_dst_linesize,
-                   cur_dst->width);
-            y_start++;
-        }
-        while (y_end > y_start && !memcmp(prv_srcp + y_end*prv_src_linesize,
-                                          cur_srcp + y_end*cur_src_linesize,
-                                          cur_src->width * 4)) {
-            memcpy(cur_dstp + y_end*cur_dst_linesize,
-                   prv_dstp + y_end*prv_dst_linesize,
-                   cur_dst->width);
-            y_end--;
-        }
-
-        height = y_end + 1 - y_start;
-
-        /* skip common columns */
-        while (x_start < x_end) {
-            int same_column = 1;
-            for (y = y_start; y <= y_end; y++) {
-                if (prv_srcp[y*prv_src_linesize + x_start] != cur_srcp[y*cur_src_linesize + x_start]) {
-                    same_column = 0;
-                    break;
-                }
-            }
-            if (!same_column)
-                break;
-            x_start++;
-        }
-        while (x_end > x_start) {
-            int same_column = 1;
-            for (y = y_start; y <= y_end; y++) {
-                if (prv_srcp[y*prv_src_linesize + x_end] != cur_srcp[y*cur_src_linesize + x_end]) {
-                    same_column = 0;
-                    break;
-                }
+        const int x_end = cur_src->width - 1;
+        int y_end;
+
+        avpriv_image_diff_rect(prv_src->data[0], prv_src->linesize[0],
+                               cur_src->data[0], cur_src->linesize[0],
+                               4, cur_src->width, cur_src->height,
+                               &x_start, &y_start, &width, &height);
+        y_end = y_start + height - 1;
+
+        /* reuse the output of the previous frame outside of the window */
+        for (int y = 0; y < cur_dst->height; y++) {
+            if (y < y_start || y > y_end) {
+                memcpy(cur_dstp + y*cur_dst_linesize,
+                       prv_dstp + y*prv_dst_linesize, cur_dst->width);
+                continue;
             }
-            if (!same_column)
-                break;
-            x_end--;
-        }
-        width = x_end + 1 - x_start;
-
-        if (x_start) {
-            for (y = y_start; y <= y_end; y++)
+            if (x_start)
                 memcpy(cur_dstp + y*cur_dst_linesize,
                        prv_dstp + y*prv_dst_linesize, x_start);
-        }
-        if (x_end != cur_src->width - 1) {
-            const int copy_len = cur_src->width - 1 - x_end;
-            for (y = y_start; y <= y_end; y++)
-                memcpy(cur_dstp + y*cur_dst_linesize + x_end + 1,
-                       prv_dstp + y*prv_dst_linesize + x_end + 1,
-                       copy_len);
+            if (x_start + width - 1 != x_end)
+                memcpy(cur_dstp + y*cur_dst_linesize + x_start + width,
+                       prv_dstp + y*prv_dst_linesize + x_start + width,
+                       x_end + 1 - x_start - width);
         }
     }
     *xp = x_start;
@@ -763,9 +963,24 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+
+    return s->set_frame(s, s->cache + jobnr * CACHE_SIZE, td->out, td->in,
+                        td->x, td->y, td->w, td->h, jobnr, nb_jobs);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
-    int x, y, w, h, ret;
+    int x, y, w, h, nb_jobs, ret;
+    ThreadData td;
     AVFilterContext *ctx = inlink->dst;
     PaletteUseContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
@@ -792,7 +1007,18 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    nb_jobs = av_clip(h, 1, s->nb_jobs);
+    if (s->dither != DITHERING_NONE && s->dither != DITHERING_BAYER &&
+        ff_filter_execute_serial(ctx))
+        nb_jobs = 1;
+    for (int i = 0; i < nb_jobs; i++)
+        atomic_store(&s->sync[i].progress, 0);
+
+    td = (ThreadData){ .in = in, .out = out, .x = x, .y = y, .w = w, .h = h };
+    ff_filter_execute(ctx, set_frame_slice, &td, s->job_rets, nb_jobs);
+    ret = 0;
+    for (int i = 0; i < nb_jobs; i++)
+        ret = FFMIN(ret, s->job_rets[i]);
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -840,8 +1066,9 @@ static int config_input_palette(AVFilterLink *inlink)
     return 0;
 }
 
-static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
+static int load_palette(AVFilterContext *ctx, const AVFrame *palette_frame)
 {
+    PaletteUseContext *s = ctx->priv;
     int i, x, y;
     const uint32_t *p = (const uint32_t *)palette_frame->data[0];
     const int p_linesize = palette_frame->linesize[0] >> 2;
@@ -851,9 +1078,9 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
+        for (i = 0; i < s->nb_jobs * CACHE_SIZE; i++)
             av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        memset(s->cache, 0, s->nb_jobs * CACHE_SIZE * sizeof(*s->cache));
     }
 
     i = 0;
@@ -870,8 +1097,12 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
 
     load_colormap(s);
 
-    if (!s->new)
+    if (!s->new) {
         s->palette_loaded = 1;
+        if (s->use_lut)
+            return build_lut(ctx);
+    }
+    return 0;
 }
 
 static int load_apply_palette(FFFrameSync *fs)
@@ -891,7 +1122,11 @@ static int load_apply_palette(FFFrameSync *fs)
         return AVERROR_BUG;
     }
     if (!s->palette_loaded) {
-        load_palette(s, second);
+        ret = load_palette(ctx, second);
+        if (ret < 0) {
+            av_frame_free(&master);
+            return ret;
+        }
     }
     ret = apply_palette(inlink, master, &out);
     av_frame_free(&master);
@@ -901,10 +1136,13 @@ static int load_apply_palette(FFFrameSync *fs)
 }
 
 #define DEFINE_SET_FRAME(name, value)                                           \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
-                            int x_start, int y_start, int w, int h)             \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in,                          \
+                            int x_start, int y_start, int w, int h,             \
+                            int jobnr, int nb_jobs)                             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value);                \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h,                 \
+                     jobnr, nb_jobs, value);                                    \
 }
 
 DEFINE_SET_FRAME(none,            DITHERING_NONE)
@@ -948,6 +1186,33 @@ static av_cold int init(AVFilterContext *ctx)
 
     s->set_frame = set_frame_lut[s->dither];
 
+    /* the error diffusion jobs wait on each other, which is only possible if
+     * they all run concurrently; a user provided execute callback may run
+     * them one after the other, as does graph threading while the filter is
+     * activated along with others, which is checked for every frame */
+    s->nb_jobs = 1;
+    if (ctx->thread_type & AVFILTER_THREAD_SLICE &&
+        (s->dither == DITHERING_NONE || s->dither == DITHERING_BAYER || !ctx->graph->execute))
+        s->nb_jobs = ff_filter_get_nb_threads(ctx);
+
+    s->cache    = av_calloc(s->nb_jobs, CACHE_SIZE * sizeof(*s->cache));
+    s->job_rets = av_calloc(s->nb_jobs, sizeof(*s->job_rets));
+    if (!s->cache || !s->job_rets)
+        return AVERROR(ENOMEM);
+    s->sync = av_calloc(s->nb_jobs, sizeof(*s->sync));
+    if (!s->sync)
+        return AVERROR(ENOMEM);
+#if HAVE_THREADS
+    for (int i = 0; i < s->nb_jobs; i++) {
+        pthread_mutex_init(&s->sync[i].mutex, NULL);
+        pthread_cond_init(&s->sync[i].cond, NULL);
+    }
+#endif
+
+    if (s->use_lut && s->new)
+        av_log(ctx, AV_LOG_WARNING, "The color table is only used with a fixed palette, "
+               "ignoring lut because new is set\n");
+
     if (s->dither == DITHERING_BAYER) {
         const int delta = 1 << (5 - s->bayer_scale); // to avoid too much luma
 
@@ -969,8 +1234,23 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (int i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    if (s->cache) {
+        for (int i = 0; i < s->nb_jobs * CACHE_SIZE; i++)
+            av_freep(&s->cache[i].entries);
+        av_freep(&s->cache);
+    }
+#if HAVE_THREADS
+    if (s->sync) {
+        for (int i = 0; i < s->nb_jobs; i++) {
+            pthread_mutex_destroy(&s->sync[i].mutex);
+            pthread_cond_destroy(&s->sync[i].cond);
+        }
+    }
+#endif
+    av_freep(&s->sync);
+    av_freep(&s->job_rets);
+    av_freep(&s->lut);
+    av_freep(&s->lut_grid);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1005,4 +1285,5 @@ const AVFilter ff_vf_paletteuse = {
     FILTER_OUTPUTS(paletteuse_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
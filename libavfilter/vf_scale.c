@@ -29,6 +29,7 @@
 
 #include "avfilter.h"
 #include "formats.h"
+#include "framecache.h"
 #include "internal.h"
 #include "scale_eval.h"
 #include "video.h"
@@ -156,6 +157,7 @@ typedef struct ScaleContext {
 
     int eval_mode;              ///< expression evaluation mode
 
+    FFFrameCache cache;         ///< output for a repeated input frame
 } ScaleContext;
 
 const AVFilter ff_vf_scale2ref;
@@ -372,6 +374,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     sws_freeContext(scale->isws[0]);
     sws_freeContext(scale->isws[1]);
     scale->sws = NULL;
+    ff_frame_cache_reset(&scale->cache);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -902,13 +905,29 @@ scale:
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
     AVFilterContext *ctx = link->dst;
+    ScaleContext *scale = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     int ret;
 
+    /* the output size may change with each frame otherwise */
+    if (scale->eval_mode == EVAL_MODE_INIT && ctx->filter != &ff_vf_scale2ref) {
+        ret = ff_frame_cache_get(&scale->cache, in, &out);
+        if (ret) {
+            av_frame_free(&in);
+            return ret < 0 ? ret : ff_filter_frame(outlink, out);
+        }
+    }
+
     ret = scale_frame(link, in, &out);
-    if (out)
+    if (out) {
+        ret = ff_frame_cache_put(&scale->cache, out);
+        if (ret < 0) {
+            av_frame_free(&out);
+            return ret;
+        }
         return ff_filter_frame(outlink, out);
+    }
 
     return ret;
 }
@@ -964,6 +983,7 @@ static int process_command(AVFilterContext *ctx, const char *cmd, const char *ar
         pexpr_ptr = w ? &scale->w_pexpr : &scale->h_pexpr;
 
         ret = scale_parse_expr(ctx, str_expr, pexpr_ptr, cmd, args);
+        ff_frame_cache_reset(&scale->cache);
     } else
         ret = AVERROR(ENOSYS);
 
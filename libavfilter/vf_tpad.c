@@ -99,6 +99,9 @@ static int activate(AVFilterContext *ctx)
             }
             s->eof = 1;
             s->pts += pts;
+        } else {
+            ff_outlink_set_status(outlink, status, AV_NOPTS_VALUE);
+            return 0;
         }
     }
 
@@ -123,6 +126,10 @@ static int activate(AVFilterContext *ctx)
             return 0;
         } else if (!s->cache_start && ff_inlink_queued_frames(inlink)) {
             s->cache_start = ff_inlink_peek_frame(inlink, 0);
+            if (!s->cache_start) {
+                ff_filter_set_ready(ctx, 100);
+                return 0;
+            }
         } else if (!s->cache_start) {
             FF_FILTER_FORWARD_WANTED(outlink, inlink);
         }
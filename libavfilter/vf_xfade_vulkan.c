@@ -424,6 +424,11 @@ static int activate(AVFilterContext *avctx)
     // did not end either, so check if there are more frames to consume.
     if (ff_inlink_check_available_frame(in_a)) {
         AVFrame *peeked_frame = ff_inlink_peek_frame(in_a, 0);
+
+        if (!peeked_frame) {
+            ff_filter_set_ready(avctx, 100);
+            return 0;
+        }
         s->pts = peeked_frame->pts;
 
         if (s->start_pts == AV_NOPTS_VALUE)
@@ -7,78 +7,149 @@
 #include <vips/vips.h>
 #include <glib-object.h>
 
-static void free_buffer_handler(VipsImage *image, uint8_t *buffer)
+static void free_avframe_handler(VipsImage *image, AVFrame *frame)
 {
-    av_free(buffer);
+    av_frame_free(&frame);
 }
 
-static void free_avframe_handler(VipsImage *image, AVFrame *frame)
+int ff_vips_bands(enum AVPixelFormat format)
 {
-    av_frame_free(&frame);
+    switch (format) {
+    case AV_PIX_FMT_GRAY8: return 1;
+    case AV_PIX_FMT_YA8:   return 2;
+    case AV_PIX_FMT_RGB24: return 3;
+    case AV_PIX_FMT_RGBA:  return 4;
+    default:               return 0;
+    }
 }
 
-int ff_frame_to_vipsimage(VipsImage **image, AVFrame *frame)
+/**
+ * Fill a region of an image wrapping a frame, reading the rows at the frame's linesize.
+ */
+static int frame_generate(VipsRegion *out, void *seq, void *a, void *b, gboolean *stop)
 {
-    size_t bytes_per_line = 3*frame->width;
-    size_t buffer_size = bytes_per_line*frame->height;
-    uint8_t *buffer;
-    int direct;
-
-    // TODO: Transparency support?
-    av_assert1(frame->format == AV_PIX_FMT_RGB24);
-
-    if (av_frame_is_writable(frame) && frame->linesize[0] == bytes_per_line) {
-        direct = 1;
-        buffer = frame->data[0];
-
-    } else {
-        direct = 0;
-
-        // Copy the lines to a contiguous memory region
-        buffer = av_malloc(buffer_size);
-        if (!buffer) {
-            return AVERROR(ENOMEM);
-        } else {
-            uint8_t *dst = buffer;
-            uint8_t *src = frame->data[0];
-            uint8_t *src_end = src + frame->height * frame->linesize[0];
-            for (; src < src_end; dst += bytes_per_line, src += frame->linesize[0]) {
-                memcpy(dst, src, bytes_per_line);
-            }
-        }
+    const AVFrame *frame = a;
+    const VipsRect *r = &out->valid;
+    const size_t pel_size = VIPS_IMAGE_SIZEOF_PEL(out->im);
+
+    for (int y = r->top; y < VIPS_RECT_BOTTOM(r); y++)
+        memcpy(VIPS_REGION_ADDR(out, r->left, y),
+               frame->data[0] + y * frame->linesize[0] + r->left * pel_size,
+               r->width * pel_size);
+
+    return 0;
+}
+
+/**
+ * Wrap the memory of a frame in an image. The rows may be padded as long as the linesize is a
+ * multiple of the pixel size: the image is then cropped out of a wider one.
+ */
+static VipsImage *frame_to_memory_image(AVFrame *frame, int bands)
+{
+    VipsImage *padded, *image;
+    int padded_width = frame->linesize[0] / bands;
+
+    padded = vips_image_new_from_memory(frame->data[0], (size_t)frame->linesize[0] * frame->height,
+                                        padded_width, frame->height, bands, VIPS_FORMAT_UCHAR);
+    if (!padded) {
+        av_frame_free(&frame);
+        return NULL;
     }
 
-    *image = vips_image_new_from_memory(buffer, buffer_size, frame->width, frame->height, 3, VIPS_FORMAT_UCHAR);
+    // Free the frame when the image is freed
+    g_signal_connect(G_OBJECT(padded), "close", G_CALLBACK(free_avframe_handler), (gpointer) frame);
+
+    if (padded_width == frame->width)
+        return padded;
+
+    // The cropped image keeps a reference to the padded one
+    if (vips_extract_area(padded, &image, 0, 0, frame->width, frame->height, NULL))
+        image = NULL;
+    g_object_unref(padded);
+    return image;
+}
+
+/**
+ * Make an image which reads the pixels from the frame when it is evaluated, so that frames
+ * which can not be wrapped directly do not need to be copied to a contiguous buffer first.
+ */
+static VipsImage *frame_to_generated_image(AVFrame *frame, int bands)
+{
+    VipsImage *image = vips_image_new();
+
+    vips_image_init_fields(image, frame->width, frame->height, bands, VIPS_FORMAT_UCHAR,
+                           VIPS_CODING_NONE,
+                           bands < 3 ? VIPS_INTERPRETATION_B_W : VIPS_INTERPRETATION_sRGB,
+                           1.0, 1.0);
+
+    // Free the frame when the image is freed
+    g_signal_connect(G_OBJECT(image), "close", G_CALLBACK(free_avframe_handler), (gpointer) frame);
 
-    if (direct) {
-        // Free the frame when the image is freed
-        g_signal_connect(G_OBJECT(*image), "close", G_CALLBACK(free_avframe_handler), (gpointer) frame);
-    } else {
-        // Free the created buffer when the image is freed
-        av_frame_unref(frame);
-        g_signal_connect(G_OBJECT(*image), "close", G_CALLBACK(free_buffer_handler), (gpointer) buffer);
+    if (vips_image_pipelinev(image, VIPS_DEMAND_STYLE_THINSTRIP, NULL) ||
+        vips_image_generate(image, NULL, frame_generate, NULL, frame, NULL)) {
+        g_object_unref(image);
+        return NULL;
     }
 
+    return image;
+}
+
+int ff_frame_to_vipsimage(VipsImage **image, AVFrame *frame)
+{
+    const int bands = ff_vips_bands(frame->format);
+    const AVBufferRef *buf = frame->buf[0];
+
+    av_assert1(bands);
+
+    // Operations like vips_draw_*() write to memory images in place, so only writable frames
+    // are handed to libvips directly.
+    if (av_frame_is_writable(frame) && frame->linesize[0] > 0 && frame->linesize[0] % bands == 0 &&
+        buf && frame->data[0] >= buf->data &&
+        frame->data[0] + (size_t)frame->linesize[0] * frame->height <= buf->data + buf->size)
+        *image = frame_to_memory_image(frame, bands);
+    else
+        *image = frame_to_generated_image(frame, bands);
+
+    // The frame is freed along with the image, even if it could not be created
+    return *image ? 0 : AVERROR_EXTERNAL;
+}
+
+/**
+ * Copy the rows computed by libvips to the frame, as they come.
+ */
+static int write_rows(VipsRegion *region, VipsRect *area, void *a)
+{
+    AVFrame *frame = a;
+    const size_t pel_size = VIPS_IMAGE_SIZEOF_PEL(region->im);
+
+    for (int y = area->top; y < VIPS_RECT_BOTTOM(area); y++)
+        memcpy(frame->data[0] + y * frame->linesize[0] + area->left * pel_size,
+               VIPS_REGION_ADDR(region, area->left, y), area->width * pel_size);
+
     return 0;
 }
 
+int ff_vipsimage_write_frame(AVFrame *frame, VipsImage *image)
+{
+    av_assert1(frame->width == vips_image_get_width(image) &&
+               frame->height == vips_image_get_height(image));
+    av_assert1(vips_image_get_format(image) == VIPS_FORMAT_UCHAR);
+    av_assert1(vips_image_get_bands(image) == ff_vips_bands(frame->format));
+
+    // Evaluate the image with the libvips thread pool, writing the rows straight to the frame
+    // whatever its linesize
+    return vips_sink_disc(image, write_rows, frame) ? AVERROR_EXTERNAL : 0;
+}
+
 int ff_vipsimage_to_frame(AVFrame **frame, VipsImage *image, AVFilterLink *outlink)
 {
     int width;
     int height;
-    int bands;
-    VipsImage *new_image;
-    uint8_t *out;
-    size_t out_size;
-    int direct;
+    int ret;
 
     width = vips_image_get_width(image);
     height = vips_image_get_height(image);
     av_assert1(outlink->w == width && outlink->h == height);
-    av_assert1(vips_image_get_format(image) == VIPS_FORMAT_UCHAR);
-    bands = vips_image_get_bands(image);
-    av_assert1((bands == 3 && outlink->format == AV_PIX_FMT_RGB24) || (bands == 4 && outlink->format == AV_PIX_FMT_RGBA));
-    out_size = bands*width*height;
 
     *frame = ff_get_video_buffer(outlink, width, height);
     if (!*frame) {
@@ -86,41 +157,10 @@ int ff_vipsimage_to_frame(AVFrame **frame, VipsImage *image, AVFilterLink *outli
         return AVERROR(ENOMEM);
     }
 
-    // Copy the image data to the frame's buffer
-    if ((*frame)->linesize[0] == bands*width) {
-        out = (*frame)->data[0];
-        direct = 1;
-    } else {
-        // Unfortunately, libvips does not provide a way to access the image data directly, so it
-        // needs to be copied to a temporary buffer.
-        out = av_malloc(out_size);
-        direct = 0;
-        if (!out) {
-            g_object_unref(image);
-            return AVERROR(ENOMEM);
-        }
-    }
-
-    new_image = vips_image_new_from_memory(out, out_size, width, height, bands, VIPS_FORMAT_UCHAR);
-    if (vips_image_write(image, new_image)) {
-        g_object_unref(image);
-        g_object_unref(new_image);
+    ret = ff_vipsimage_write_frame(*frame, image);
+    if (ret < 0)
         av_frame_free(frame);
-        return AVERROR_EXTERNAL;
-    }
     g_object_unref(image);
-    g_object_unref(new_image);
-
-    if (!direct) {
-        uint8_t *dst = (*frame)->data[0];
-        uint8_t *src = out;
-        uint8_t *src_end = src + out_size;
-        size_t bytes_per_line = bands*width;
-        for (; src < src_end; dst += (*frame)->linesize[0], src += bytes_per_line) {
-            memcpy(dst, src, bytes_per_line);
-        }
-        av_free(out);
-    }
 
-    return 0;
+    return ret;
 }
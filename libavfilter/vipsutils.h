@@ -6,7 +6,19 @@
 #include <vips/vips.h>
 
 /**
- * Creates a new VipsImage using the data in an AVFrame with the AV_PIX_FMT_RGB24 pixel format and frees the AVFrame once it's not needed.
+ * Returns the number of VipsImage bands matching a pixel format.
+ *
+ * @param[in] format AV_PIX_FMT_GRAY8, AV_PIX_FMT_YA8, AV_PIX_FMT_RGB24 or AV_PIX_FMT_RGBA
+ * @return the number of bands, or 0 if the format is not supported
+ */
+int ff_vips_bands(enum AVPixelFormat format);
+
+/**
+ * Creates a new VipsImage using the data in an AVFrame with a pixel format supported by
+ * ff_vips_bands() and frees the AVFrame once it's not needed.
+ *
+ * The frame data is not copied: writable frames are wrapped directly, and the rows of the
+ * others are read at the frame's linesize when the image is evaluated.
  * 
  * @param[out] image A pointer to where the pointer to the VipsImage should be stored
  * @param[in] frame A pointer to the AVFrame
@@ -14,6 +26,18 @@
  */
 int ff_frame_to_vipsimage(VipsImage **image, AVFrame *frame);
 
+/**
+ * Writes the data from the image to an allocated frame of the same dimensions, without freeing
+ * the VipsImage.
+ *
+ * The rows are written to the frame as libvips computes them, whatever its linesize.
+ *
+ * @param[in] frame A pointer to the AVFrame, with a pixel format matching the image bands
+ * @param[in] image A pointer to the VipsImage
+ * @return 0 on success, otherwise a negative error code
+ */
+int ff_vipsimage_write_frame(AVFrame *frame, VipsImage *image);
+
 /**
  * Allocates a new AVFrame with buffer, writes the data from the image to it and frees the VipsImage.
  * 
@@ -5,11 +5,13 @@
 #include <vips/vips.h>
 #include "../../natives/c-bindings/image.h"
 
+#include "libavutil/avstring.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixfmt.h"
 #include "avfilter.h"
 #include "filters.h"
 #include "internal.h"
+#include "rendercache.h"
 #include "vipsutils.h"
 
 typedef struct EBImageSourceContext {
@@ -18,15 +20,20 @@ typedef struct EBImageSourceContext {
     // Filter-specific constants
     VipsImage* (*generate_image)(struct EBImageSourceContext *imgsrc);
     enum AVPixelFormat output_format;
+    const char *cache_name;
+    int uses_height;
 
     int width, height;
+    AVRational frame_rate;
 
-    int pts;
+    int64_t pts;
 
     char *text0, *text1;
     char *font;
 
     AVFrame *frame;
+
+    FFRenderCache cache;
 } EBImageSourceContext;
 
 #define OFFSET(x) offsetof(EBImageSourceContext, x)
@@ -34,13 +41,19 @@ typedef struct EBImageSourceContext {
 
 #define WIDTH_OPTION { "width", "set output width", OFFSET(width), AV_OPT_TYPE_INT, {.i64 = 100}, 0, INT_MAX, FLAGS }
 #define SIZE_OPTION { "size", "set output dimensions", OFFSET(width), AV_OPT_TYPE_IMAGE_SIZE, {.str = "hd720"}, 0, 0, FLAGS }
+#define RATE_OPTION { "rate", "set video rate", OFFSET(frame_rate), AV_OPT_TYPE_VIDEO_RATE, {.str = "25"}, 0, INT_MAX, FLAGS },\
+                    { "r",    "set video rate", OFFSET(frame_rate), AV_OPT_TYPE_VIDEO_RATE, {.str = "25"}, 0, INT_MAX, FLAGS }
 
 static av_cold int init(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
+    int ret;
+
     imgsrc->pts = 0;
     imgsrc->frame = NULL;
-    return 0;
+
+    ret = ff_render_cache_init(&imgsrc->cache);
+    return FFMIN(ret, 0);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -73,30 +86,107 @@ static int config_ref_input_props(AVFilterLink *inlink)
     return 0;
 }
 
-static int config_output_props(AVFilterLink *outlink)
+/**
+ * Render the image to imgsrc->frame, or map it from the render cache if the same one was
+ * rendered before, possibly by another process.
+ */
+static int render_image(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
     EBImageSourceContext *imgsrc = ctx->priv;
+    char *key = NULL;
     int ret;
     VipsImage *img;
 
+    if (imgsrc->cache.dir) {
+        // Everything the generate_image() callbacks depend on. The fonts are only known by
+        // name here, the files they resolve to and the renderer version are covered by the
+        // version the cache is configured with.
+        key = av_asprintf("%s\n%s\n%d\n%d\n%s\n%s\n%s", imgsrc->cache_name,
+                          vips_version_string(), imgsrc->width,
+                          imgsrc->uses_height ? imgsrc->height : 0, imgsrc->text0 ? imgsrc->text0 : "",
+                          imgsrc->text1 ? imgsrc->text1 : "", imgsrc->font ? imgsrc->font : "");
+        if (!key)
+            return AVERROR(ENOMEM);
+
+        ret = ff_render_cache_get(&imgsrc->cache, ctx, key, imgsrc->output_format, &imgsrc->frame);
+        if (ret != 0) {
+            av_free(key);
+            return ret;
+        }
+    }
+
     img = imgsrc->generate_image(imgsrc);
 
     outlink->w = vips_image_get_width(img);
     outlink->h = vips_image_get_height(img);
-    outlink->sample_aspect_ratio = (AVRational) { 1, 1 };
-    // Setting time_base to and/or incementing pts by a high value causes the filter to output
-    // frames less often, reducing the amount of pixel format conversions performed, as every
-    // frame is converted if pixel conversion is necessary.
-    outlink->frame_rate = (AVRational) { 1, INT_MAX/256 };
-    outlink->time_base = (AVRational) { INT_MAX/256, 1 };
 
-    if ((ret = ff_vipsimage_to_frame(&imgsrc->frame, img, outlink)) < 0)
+    ret = ff_vipsimage_to_frame(&imgsrc->frame, img, outlink);
+    if (ret >= 0 && key) {
+        // A failure only costs rendering the image again next time
+        if ((ret = ff_render_cache_put(&imgsrc->cache, ctx, key, imgsrc->frame)) < 0)
+            av_log(ctx, AV_LOG_WARNING, "Could not store the image in the render cache: %s\n",
+                   av_err2str(ret));
+        ret = 0;
+    }
+    av_free(key);
+
+    return ret;
+}
+
+static int config_output_props(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    EBImageSourceContext *imgsrc = ctx->priv;
+    int ret;
+
+    if ((ret = render_image(outlink)) < 0)
         return ret;
 
+    outlink->w = imgsrc->frame->width;
+    outlink->h = imgsrc->frame->height;
+    outlink->sample_aspect_ratio = (AVRational) { 1, 1 };
+    // Every output frame references the same picture, so the filters converting or blending
+    // it downstream only do so for the first one and send their previous output again for
+    // the others. There is thus no need to output frames less often than the other streams.
+    if (ctx->nb_inputs > 0) {
+        outlink->frame_rate = ctx->inputs[0]->frame_rate;
+        outlink->time_base = ctx->inputs[0]->time_base;
+    } else {
+        outlink->frame_rate = imgsrc->frame_rate;
+        outlink->time_base = av_inv_q(imgsrc->frame_rate);
+    }
+
     return 0;
 }
 
+static int output_frame(AVFilterContext *ctx, int64_t pts, int64_t duration)
+{
+    EBImageSourceContext *imgsrc = ctx->priv;
+    AVFrame *frame = av_frame_clone(imgsrc->frame);
+
+    if (!frame)
+        return AVERROR(ENOMEM);
+    frame->pts = pts;
+    frame->duration = duration;
+#if FF_API_PKT_DURATION
+FF_DISABLE_DEPRECATION_WARNINGS
+    frame->key_frame = 1;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+    frame->flags |= AV_FRAME_FLAG_KEY;
+#if FF_API_INTERLACED_FRAME
+FF_DISABLE_DEPRECATION_WARNINGS
+    frame->interlaced_frame = 0;
+FF_ENABLE_DEPRECATION_WARNINGS
+#endif
+    frame->flags &= ~AV_FRAME_FLAG_INTERLACED;
+    frame->pict_type = AV_PICTURE_TYPE_I;
+    frame->sample_aspect_ratio = (AVRational) { 1, 1 };
+
+    return ff_filter_frame(ctx->outputs[0], frame);
+}
+
 static int activate(AVFilterContext *ctx)
 {
     AVFilterLink *outlink = ctx->outputs[0];
@@ -105,48 +195,32 @@ static int activate(AVFilterContext *ctx)
     int ret;
 
     if (ctx->nb_inputs > 0) {
-        // Code for ebcaptionref
+        // Code for ebcaptionref: output one frame for each reference frame, with its timing
 
         AVFilterLink *inlink = ctx->inputs[0];
+        int64_t pts, duration;
 
         FF_FILTER_FORWARD_STATUS_BACK(outlink, inlink);
 
-        // Consume and ignore all input frames
         ret = ff_inlink_consume_frame(inlink, &frame);
         if (ret < 0) {
             return ret;
         } else if (ret > 0) {
+            pts = frame->pts;
+            duration = frame->duration;
             av_frame_free(&frame);
+            return output_frame(ctx, pts, duration);
         }
 
         FF_FILTER_FORWARD_STATUS(inlink, outlink);
-    }
+        FF_FILTER_FORWARD_WANTED(outlink, inlink);
 
-    if (ff_outlink_frame_wanted(outlink)) {
-        frame = av_frame_clone(imgsrc->frame);
-        if (!frame)
-            return AVERROR(ENOMEM);
-        frame->pts = imgsrc->pts;
-#if FF_API_PKT_DURATION
-FF_DISABLE_DEPRECATION_WARNINGS
-        frame->key_frame = 1;
-FF_ENABLE_DEPRECATION_WARNINGS
-#endif
-        frame->flags |= AV_FRAME_FLAG_KEY;
-#if FF_API_INTERLACED_FRAME
-FF_DISABLE_DEPRECATION_WARNINGS
-        frame->interlaced_frame = 0;
-FF_ENABLE_DEPRECATION_WARNINGS
-#endif
-        frame->flags &= ~AV_FRAME_FLAG_INTERLACED;
-        frame->pict_type = AV_PICTURE_TYPE_I;
-        frame->sample_aspect_ratio = (AVRational) { 1, 1 };
-
-        imgsrc->pts++;
-
-        return ff_filter_frame(outlink, frame);
+        return FFERROR_NOT_READY;
     }
 
+    if (ff_outlink_frame_wanted(outlink))
+        return output_frame(ctx, imgsrc->pts++, 1);
+
     return FFERROR_NOT_READY;
 }
 
@@ -154,6 +228,9 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
     av_frame_free(&imgsrc->frame);
+    if (imgsrc->cache.dir)
+        ff_render_cache_log_stats(&imgsrc->cache, ctx, AV_LOG_VERBOSE);
+    ff_render_cache_uninit(&imgsrc->cache);
 }
 
 static const AVFilterPad ref_inputs[] = {
@@ -181,6 +258,7 @@ static const AVFilterPad outputs[] = {
 static const AVOption ebcaption_options[] = {
     EBCAPTIONREF_OPTIONS,
     WIDTH_OPTION,
+    RATE_OPTION,
     { NULL }
 };
 static const AVOption ebcaptionref_options[] = {
@@ -199,6 +277,7 @@ static av_cold int caption_init(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
     imgsrc->generate_image = caption_generate_image;
+    imgsrc->cache_name = "caption";
     imgsrc->output_format = AV_PIX_FMT_RGB24;
     return init(ctx);
 }
@@ -239,6 +318,7 @@ const AVFilter ff_vsrc_ebcaptionref = {
 static const AVOption ebcaptiontwo_options[] = {
     EBCAPTIONTWOREF_OPTIONS,
     WIDTH_OPTION,
+    RATE_OPTION,
     { NULL }
 };
 static const AVOption ebcaptiontworef_options[] = {
@@ -257,6 +337,7 @@ static av_cold int caption_two_init(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
     imgsrc->generate_image = caption_two_generate_image;
+    imgsrc->cache_name = "captiontwo";
     imgsrc->output_format = AV_PIX_FMT_RGB24;
     return init(ctx);
 }
@@ -297,6 +378,7 @@ const AVFilter ff_vsrc_ebcaptiontworef = {
 static const AVOption ebsnapchat_options[] = {
     EBSNAPCHATREF_OPTIONS,
     SIZE_OPTION,
+    RATE_OPTION,
     { NULL }
 };
 static const AVOption ebsnapchatref_options[] = {
@@ -315,6 +397,7 @@ static av_cold int snapchat_init(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
     imgsrc->generate_image = snapchat_generate_image;
+    imgsrc->cache_name = "snapchat";
     imgsrc->output_format = AV_PIX_FMT_RGBA;
     return init(ctx);
 }
@@ -356,6 +439,7 @@ const AVFilter ff_vsrc_ebsnapchatref = {
 static const AVOption ebmeme_options[] = {
     EBMEMEREF_OPTIONS,
     SIZE_OPTION,
+    RATE_OPTION,
     { NULL }
 };
 static const AVOption ebmemeref_options[] = {
@@ -374,6 +458,8 @@ static av_cold int meme_init(AVFilterContext *ctx)
 {
     EBImageSourceContext *imgsrc = ctx->priv;
     imgsrc->generate_image = meme_generate_image;
+    imgsrc->cache_name = "meme";
+    imgsrc->uses_height = 1;
     imgsrc->output_format = AV_PIX_FMT_RGBA;
     return init(ctx);
 }
@@ -29,6 +29,7 @@
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "avio_internal.h"
+#include "demux.h"
 #include "internal.h"
 #include "libavcodec/gif.h"
 
@@ -56,6 +57,23 @@ typedef struct GIFDemuxContext {
     int total_iter;
     int iter_count;
     int ignore_loop;
+
+    int64_t scan_size;      ///< maximum number of bytes scanned when opening the file
+
+    int width, height;
+    uint8_t header[13 + 3 * 256]; ///< signature, screen descriptor and global palette
+    int header_size;
+    int64_t header_pos;
+    int send_header;
+
+    /**
+     * Frame index state: position of the next frame to be indexed, or -1
+     * once the whole file is indexed, number of frames and sum of their
+     * delays so far.
+     */
+    int64_t scan_pos;
+    int64_t nb_frames;
+    int64_t duration;
 } GIFDemuxContext;
 
 /**
@@ -107,37 +125,23 @@ static int gif_skip_subblocks(AVIOContext *pb)
     return ret;
 }
 
-static int gif_read_header(AVFormatContext *s)
+/**
+ * Walk the blocks of the file from scan_pos, adding an index entry for
+ * each frame and summing the frame delays.
+ * The scan stops at the first frame boundary after max_pos or once the
+ * frames span more than max_ts, and scan_pos is set to -1 once the whole
+ * file has been scanned.
+ */
+static int gif_scan(AVFormatContext *s, int64_t max_pos, int64_t max_ts)
 {
     GIFDemuxContext *gdc = s->priv_data;
     AVIOContext     *pb  = s->pb;
-    AVStream        *st;
-    int type, width, height, ret, n, flags;
-    int64_t nb_frames = 0, duration = 0, pos;
-
-    if ((ret = resync(pb)) < 0)
-        return ret;
-
-    pos = avio_tell(pb);
-    gdc->delay  = gdc->default_delay;
-    width  = avio_rl16(pb);
-    height = avio_rl16(pb);
-    flags = avio_r8(pb);
-    avio_skip(pb, 1);
-    n      = avio_r8(pb);
+    AVStream        *st  = s->streams[0];
+    int type, ret, delay = gdc->default_delay, opaque = 1;
+    int64_t frame_pos = gdc->scan_pos;
 
-    if (width == 0 || height == 0)
-        return AVERROR_INVALIDDATA;
-
-    st = avformat_new_stream(s, NULL);
-    if (!st)
-        return AVERROR(ENOMEM);
-
-    if (!(pb->seekable & AVIO_SEEKABLE_NORMAL))
-        goto skip;
-
-    if (flags & 0x80)
-        avio_skip(pb, 3 * (1 << ((flags & 0x07) + 1)));
+    if (avio_seek(pb, gdc->scan_pos, SEEK_SET) != gdc->scan_pos)
+        return AVERROR(EIO);
 
     while ((type = avio_r8(pb)) != GIF_TRAILER) {
         if (avio_feof(pb))
@@ -158,12 +162,9 @@ static int gif_read_header(AVFormatContext *s)
                 int block_size = avio_r8(pb);
 
                 if (block_size == 4) {
-                    int delay;
-
-                    avio_skip(pb, 1);
-                    delay = avio_rl16(pb);
-                    delay = delay ? delay : gdc->default_delay;
-                    duration += delay;
+                    opaque = !(avio_r8(pb) & 0x01);
+                    delay  = avio_rl16(pb);
+                    delay  = delay ? delay : gdc->default_delay;
                     avio_skip(pb, 1);
                 } else {
                     avio_skip(pb, block_size);
@@ -197,21 +198,110 @@ static int gif_read_header(AVFormatContext *s)
                 gif_skip_subblocks(pb);
             }
         } else if (type == GIF_IMAGE_SEPARATOR) {
-            avio_skip(pb, 8);
-            flags = avio_r8(pb);
+            int left, top, width, height, flags, key;
+
+            left   = avio_rl16(pb);
+            top    = avio_rl16(pb);
+            width  = avio_rl16(pb);
+            height = avio_rl16(pb);
+            flags  = avio_r8(pb);
             if (flags & 0x80)
                 avio_skip(pb, 3 * (1 << ((flags & 0x07) + 1)));
             avio_skip(pb, 1);
             gif_skip_subblocks(pb);
-            nb_frames++;
+
+            /* an opaque image covering the whole screen does not depend on
+             * the previous frames, so decoding can start from it */
+            key = !gdc->nb_frames ||
+                  (opaque && !left && !top &&
+                   width >= gdc->width && height >= gdc->height);
+            /* the first frame is read along with the header */
+            if (!gdc->nb_frames)
+                frame_pos = gdc->header_pos;
+            if ((ret = av_add_index_entry(st, frame_pos, gdc->duration, 0, 0,
+                                          key ? AVINDEX_KEYFRAME : 0)) < 0)
+                return ret;
+
+            gdc->duration += delay;
+            gdc->nb_frames++;
+            delay  = gdc->default_delay;
+            opaque = 1;
+
+            frame_pos = gdc->scan_pos = avio_tell(pb);
+            if (frame_pos >= max_pos || gdc->duration > max_ts)
+                return 0;
         } else {
             break;
         }
     }
 
+    gdc->scan_pos = -1;
+    st->duration  = gdc->duration;
+    st->nb_frames = gdc->nb_frames;
+
+    return 0;
+}
+
+static int gif_read_header(AVFormatContext *s)
+{
+    GIFDemuxContext *gdc = s->priv_data;
+    AVIOContext     *pb  = s->pb;
+    AVStream        *st;
+    int ret, n, flags;
+
+    if ((ret = resync(pb)) < 0)
+        return ret;
+
+    gdc->header_pos = avio_tell(pb) - 6;
+    gdc->delay  = gdc->default_delay;
+    gdc->width  = avio_rl16(pb);
+    gdc->height = avio_rl16(pb);
+    flags = avio_r8(pb);
+    avio_skip(pb, 1);
+    n      = avio_r8(pb);
+
+    if (gdc->width == 0 || gdc->height == 0)
+        return AVERROR_INVALIDDATA;
+
+    st = avformat_new_stream(s, NULL);
+    if (!st)
+        return AVERROR(ENOMEM);
+
+    gdc->scan_pos = -1;
+    if (!(pb->seekable & AVIO_SEEKABLE_NORMAL))
+        goto skip;
+
+    /* keep the header, it is sent again before the first frame after a seek */
+    gdc->header_size = 13;
+    if (flags & 0x80)
+        gdc->header_size += 3 * (1 << ((flags & 0x07) + 1));
+    if (avio_seek(pb, gdc->header_pos, SEEK_SET) != gdc->header_pos)
+        return AVERROR(EIO);
+    if ((ret = ffio_read_size(pb, gdc->header, gdc->header_size)) < 0)
+        return ret;
+
+    gdc->scan_pos = avio_tell(pb);
+    ret = gif_scan(s, gdc->scan_size ? gdc->header_pos + gdc->scan_size : INT64_MAX,
+                   INT64_MAX);
+    if (ret < 0)
+        return ret;
+
+    if (gdc->scan_pos >= 0) {
+        /* the rest of the file is scanned when seeking, estimate the
+         * duration from the frames scanned so far */
+        int64_t size = avio_size(pb);
+
+        if (size > gdc->scan_pos)
+            st->duration = av_rescale(gdc->duration, size - gdc->header_pos,
+                                      gdc->scan_pos - gdc->header_pos);
+        av_log(s, AV_LOG_DEBUG, "Scanned %"PRId64" frames in %"PRId64" bytes, "
+               "estimated duration %"PRId64"\n", gdc->nb_frames,
+               gdc->scan_pos - gdc->header_pos, st->duration);
+    }
+
 skip:
     /* jump to start because gif decoder needs header data too */
-    if (avio_seek(pb, pos - 6, SEEK_SET) != pos - 6)
+    if (avio_seek(pb, gdc->header_pos, SEEK_SET) != gdc->header_pos)
         return AVERROR(EIO);
 
     /* GIF format operates with time in "hundredths of second",
@@ -220,17 +310,19 @@ skip:
     ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL_RAW;
     st->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
     st->codecpar->codec_id   = AV_CODEC_ID_GIF;
-    st->codecpar->width      = width;
-    st->codecpar->height     = height;
-    if (nb_frames > 1) {
+    st->codecpar->width      = gdc->width;
+    st->codecpar->height     = gdc->height;
+    if (gdc->nb_frames > 1) {
         av_reduce(&st->avg_frame_rate.num, &st->avg_frame_rate.den,
-                  100, duration / nb_frames, INT_MAX);
-    } else if (duration) {
-        st->avg_frame_rate   = (AVRational) { 100, duration };
+                  100, gdc->duration / gdc->nb_frames, INT_MAX);
+    } else if (gdc->duration) {
+        st->avg_frame_rate   = (AVRational) { 100, gdc->duration };
     }
     st->start_time           = 0;
-    st->duration             = duration;
-    st->nb_frames            = nb_frames;
+    if (gdc->scan_pos < 0) {
+        st->duration         = gdc->duration;
+        st->nb_frames        = gdc->nb_frames;
+    }
     if (n)
         st->codecpar->sample_aspect_ratio = av_make_q(n + 15, 64);
 
@@ -243,6 +335,17 @@ static int gif_read_packet(AVFormatContext *s, AVPacket *pkt)
     AVIOContext *pb = s->pb;
     int ret;
 
+    if (gdc->send_header) {
+        gdc->send_header = 0;
+        if ((ret = av_new_packet(pkt, gdc->header_size)) < 0)
+            return ret;
+        memcpy(pkt->data, gdc->header, gdc->header_size);
+        /* the parser counts frame positions from the start of this packet */
+        pkt->pos = avio_tell(pb) - gdc->header_size;
+        pkt->stream_index = 0;
+        return 0;
+    }
+
     if ((pb->seekable & AVIO_SEEKABLE_NORMAL) &&
         !gdc->ignore_loop && avio_feof(pb) &&
         (gdc->total_iter < 0 || (++gdc->iter_count < gdc->total_iter))) {
@@ -262,11 +365,46 @@ static int gif_read_packet(AVFormatContext *s, AVPacket *pkt)
     return ret;
 }
 
+static int gif_read_seek(AVFormatContext *s, int stream_index,
+                         int64_t timestamp, int flags)
+{
+    GIFDemuxContext *gdc = s->priv_data;
+    AVStream *st = s->streams[0];
+    const AVIndexEntry *e;
+    int index, ret;
+
+    if (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL))
+        return AVERROR(ENOSYS);
+
+    /* index the file up to the requested time */
+    if (gdc->scan_pos >= 0 && (ret = gif_scan(s, INT64_MAX, timestamp)) < 0)
+        return ret;
+    index = av_index_search_timestamp(st, timestamp, flags);
+    /* the next keyframe may not be indexed yet */
+    while (index < 0 && gdc->scan_pos >= 0 && !(flags & AVSEEK_FLAG_BACKWARD)) {
+        if ((ret = gif_scan(s, INT64_MAX, gdc->duration)) < 0)
+            return ret;
+        index = av_index_search_timestamp(st, timestamp, flags);
+    }
+    if (index < 0)
+        return -1;
+
+    e = avformat_index_get_entry(st, index);
+    if (avio_seek(s->pb, e->pos, SEEK_SET) != e->pos)
+        return AVERROR(EIO);
+    /* the decoder needs the header before any other frame */
+    gdc->send_header = e->pos != gdc->header_pos;
+    avpriv_update_cur_dts(s, st, e->timestamp);
+
+    return 0;
+}
+
 static const AVOption options[] = {
     { "min_delay"    , "minimum valid delay between frames (in hundredths of second)", offsetof(GIFDemuxContext, min_delay)    , AV_OPT_TYPE_INT, {.i64 = GIF_MIN_DELAY}    , 0, 100 * 60, AV_OPT_FLAG_DECODING_PARAM },
     { "max_gif_delay", "maximum valid delay between frames (in hundredths of seconds)", offsetof(GIFDemuxContext, max_delay)   , AV_OPT_TYPE_INT, {.i64 = 65535}            , 0, 65535   , AV_OPT_FLAG_DECODING_PARAM },
     { "default_delay", "default delay between frames (in hundredths of second)"      , offsetof(GIFDemuxContext, default_delay), AV_OPT_TYPE_INT, {.i64 = GIF_DEFAULT_DELAY}, 0, 100 * 60, AV_OPT_FLAG_DECODING_PARAM },
     { "ignore_loop"  , "ignore loop setting (netscape extension)"                    , offsetof(GIFDemuxContext, ignore_loop)  , AV_OPT_TYPE_BOOL,{.i64 = 1}                , 0,        1, AV_OPT_FLAG_DECODING_PARAM },
+    { "scan_size"    , "maximum number of bytes scanned for the duration, 0 for all" , offsetof(GIFDemuxContext, scan_size)    , AV_OPT_TYPE_INT64,{.i64 = 1 << 20}         , 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM },
     { NULL },
 };
 
@@ -285,7 +423,8 @@ const AVInputFormat ff_gif_demuxer = {
     .read_probe     = gif_probe,
     .read_header    = gif_read_header,
     .read_packet    = gif_read_packet,
-    .flags          = AVFMT_GENERIC_INDEX | AVFMT_NOTIMESTAMPS,
+    .read_seek      = gif_read_seek,
+    .flags          = AVFMT_NOTIMESTAMPS | AVFMT_NOGENSEARCH,
     .extensions     = "gif",
     .priv_class     = &demuxer_class,
 };
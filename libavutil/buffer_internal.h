@@ -85,10 +85,24 @@ typedef struct BufferPoolEntry {
     AVBuffer buffer;
 } BufferPoolEntry;
 
+/**
+ * Number of released buffers an AVBufferPool keeps in its lock-free cache.
+ */
+#define BUFFER_POOL_CACHE_SIZE 16
+
 struct AVBufferPool {
     AVMutex mutex;
     BufferPoolEntry *pool;
 
+    /*
+     * Lock-free cache in front of the list above: released buffers are
+     * stored in the first free slot, and taken from the first used one,
+     * without taking the mutex. Each slot holds a BufferPoolEntry pointer,
+     * or 0, and is only ever swapped as a whole, so there is no ABA issue.
+     * The list is only used when the cache is empty or full.
+     */
+    atomic_uintptr_t cache[BUFFER_POOL_CACHE_SIZE];
+
     /*
      * This is used to track when the pool is to be freed.
      * The pointer to the pool itself held by the caller is considered to
@@ -378,6 +378,68 @@ void av_image_copy_plane(uint8_t       *dst, int dst_linesize,
     image_copy_plane(dst, dst_linesize, src, src_linesize, bytewidth, height);
 }
 
+/* index of the first byte differing between a and b in [0;n), n if none */
+static int first_diff(const uint8_t *a, const uint8_t *b, int n)
+{
+    int i = 0;
+
+    while (i + 8 <= n && AV_RN64(a + i) == AV_RN64(b + i))
+        i += 8;
+    while (i < n && a[i] == b[i])
+        i++;
+    return i;
+}
+
+/* index of the last byte differing between a and b in [0;n), -1 if none */
+static int last_diff(const uint8_t *a, const uint8_t *b, int n)
+{
+    int i = n;
+
+    while (i >= 8 && AV_RN64(a + i - 8) == AV_RN64(b + i - 8))
+        i -= 8;
+    while (i > 0 && a[i - 1] == b[i - 1])
+        i--;
+    return i - 1;
+}
+
+void avpriv_image_diff_rect(const uint8_t *src1, ptrdiff_t linesize1,
+                            const uint8_t *src2, ptrdiff_t linesize2,
+                            int bytes_per_pixel, int w, int h,
+                            int *x, int *y, int *width, int *height)
+{
+    const int bytewidth = w * bytes_per_pixel;
+    int y_start = 0, y_end = h - 1;
+    int x_start = bytewidth, x_end = -1; /* in bytes */
+
+    while (y_start < y_end && !memcmp(src1 + y_start * linesize1,
+                                      src2 + y_start * linesize2, bytewidth))
+        y_start++;
+    while (y_end > y_start && !memcmp(src1 + y_end * linesize1,
+                                      src2 + y_end * linesize2, bytewidth))
+        y_end--;
+
+    /* only look for differences out of the columns found so far */
+    for (int j = y_start; j <= y_end && (x_start || x_end < bytewidth - 1); j++) {
+        const uint8_t *a = src1 + j * linesize1;
+        const uint8_t *b = src2 + j * linesize2;
+        const int last = last_diff(a + x_end + 1, b + x_end + 1, bytewidth - x_end - 1);
+
+        x_start = first_diff(a, b, x_start);
+        if (last >= 0)
+            x_end += 1 + last;
+    }
+
+    if (x_end < 0) {
+        *x     = w - 1;
+        *width = 1;
+    } else {
+        *x     = x_start / bytes_per_pixel;
+        *width = x_end / bytes_per_pixel + 1 - *x;
+    }
+    *y      = y_start;
+    *height = y_end + 1 - y_start;
+}
+
 static void image_copy(uint8_t *dst_data[4], const ptrdiff_t dst_linesizes[4],
                        const uint8_t *src_data[4], const ptrdiff_t src_linesizes[4],
                        enum AVPixelFormat pix_fmt, int width, int height,
@@ -26,5 +26,22 @@ int ff_image_copy_plane_uc_from_x86(uint8_t       *dst, ptrdiff_t dst_linesize,
                                     const uint8_t *src, ptrdiff_t src_linesize,
                                     ptrdiff_t bytewidth, int height);
 
+/**
+ * Find the smallest rectangle containing all the pixels that differ between
+ * two images.
+ *
+ * If the images are identical, the rectangle is their bottom right pixel.
+ *
+ * @param linesize2       linesize of src2, may be 0 to compare all the rows
+ *                        of src1 to the same row
+ * @param bytes_per_pixel size of a pixel, pixels are compared as a whole
+ * @param w               width of the images in pixels
+ * @param h               height of the images
+ */
+void avpriv_image_diff_rect(const uint8_t *src1, ptrdiff_t linesize1,
+                            const uint8_t *src2, ptrdiff_t linesize2,
+                            int bytes_per_pixel, int w, int h,
+                            int *x, int *y, int *width, int *height);
+
 
 #endif /* AVUTIL_IMGUTILS_INTERNAL_H */
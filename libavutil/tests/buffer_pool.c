@@ -0,0 +1,122 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * This test program hammers a buffer pool from several threads, checking
+ * that no buffer is handed out twice at the same time, and reports the
+ * number of get/release pairs per second.
+ *
+ * Usage: buffer_pool [<threads> [<operations per thread>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/macros.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 64
+#define HELD_BUFFERS 4      ///< buffers held by each thread at a time
+
+typedef struct ThreadData {
+    AVBufferPool *pool;
+    int index;
+    int nb_ops;
+    int errors;
+} ThreadData;
+
+static void *thread_main(void *arg)
+{
+    ThreadData *td = arg;
+    AVBufferRef *held[HELD_BUFFERS] = { NULL };
+
+    for (int i = 0; i < td->nb_ops; i++) {
+        AVBufferRef **buf = &held[i % HELD_BUFFERS];
+
+        if (*buf) {
+            if (AV_RN32((*buf)->data) != td->index ||
+                AV_RN32((*buf)->data + 4) != i - HELD_BUFFERS)
+                td->errors++;
+            av_buffer_unref(buf);
+        }
+
+        *buf = av_buffer_pool_get(td->pool);
+        if (!*buf) {
+            td->errors++;
+            break;
+        }
+        AV_WN32((*buf)->data,     td->index);
+        AV_WN32((*buf)->data + 4, i);
+    }
+
+    for (int i = 0; i < HELD_BUFFERS; i++)
+        av_buffer_unref(&held[i]);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    ThreadData td[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    AVBufferPool *pool;
+    int nb_threads = 4, nb_ops = 100000, errors = 0;
+    int64_t t;
+
+    if (argc > 1)
+        nb_threads = av_clip(atoi(argv[1]), 1, MAX_THREADS);
+    if (argc > 2)
+        nb_ops = FFMAX(atoi(argv[2]), 1);
+
+    pool = av_buffer_pool_init(64, NULL);
+    if (!pool)
+        return 1;
+
+    t = av_gettime_relative();
+    for (int i = 0; i < nb_threads; i++) {
+        int ret;
+
+        td[i] = (ThreadData){ .pool = pool, .index = i, .nb_ops = nb_ops };
+        if ((ret = pthread_create(&threads[i], NULL, thread_main, &td[i]))) {
+            fprintf(stderr, "pthread_create failed: %s.\n", strerror(ret));
+            return 1;
+        }
+    }
+    for (int i = 0; i < nb_threads; i++) {
+        pthread_join(threads[i], NULL);
+        errors += td[i].errors;
+    }
+    t = FFMAX(av_gettime_relative() - t, 1);
+
+    av_buffer_pool_uninit(&pool);
+
+    printf("%d threads: %.0f ops/s\n", nb_threads,
+           (double)nb_threads * nb_ops * 1000000 / t);
+
+    if (errors) {
+        fprintf(stderr, "%d buffers were corrupted or could not be allocated\n", errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -17,13 +17,48 @@
  */
 
 #include "libavutil/imgutils.c"
+#include "libavutil/lfg.h"
 
 #undef printf
 
+/* check avpriv_image_diff_rect() against a plain search over all pixels */
+static int check_diff_rect(AVLFG *lfg)
+{
+    static uint8_t img1[40 * 4 * 30], img2[40 * 4 * 30];
+    const int w = 1 + av_lfg_get(lfg) % 40, h = 1 + av_lfg_get(lfg) % 30;
+    const int bpp = av_lfg_get(lfg) & 1 ? 4 : 1, linesize = 40 * 4;
+    const int nb_changes = av_lfg_get(lfg) % 4;
+    int x0 = w, y0 = h, x1 = -1, y1 = -1, x, y, rw, rh;
+
+    memset(img1, 0, sizeof(img1));
+    memset(img2, 0, sizeof(img2));
+    for (int i = 0; i < nb_changes; i++) {
+        const int px = av_lfg_get(lfg) % w, py = av_lfg_get(lfg) % h;
+        img2[py * linesize + px * bpp + av_lfg_get(lfg) % bpp] = 1;
+        x0 = FFMIN(x0, px); x1 = FFMAX(x1, px);
+        y0 = FFMIN(y0, py); y1 = FFMAX(y1, py);
+    }
+    if (x1 < 0) {
+        /* identical images give the bottom right pixel */
+        x0 = x1 = w - 1;
+        y0 = y1 = h - 1;
+    }
+
+    avpriv_image_diff_rect(img1, linesize, img2, linesize, bpp, w, h, &x, &y, &rw, &rh);
+    if (x != x0 || y != y0 || rw != x1 + 1 - x0 || rh != y1 + 1 - y0) {
+        printf("diff rect mismatch for %dx%d bpp %d: %dx%d at (%d;%d), expected %dx%d at (%d;%d)\n",
+               w, h, bpp, rw, rh, x, y, x1 + 1 - x0, y1 + 1 - y0, x0, y0);
+        return 1;
+    }
+    return 0;
+}
+
 int main(void)
 {
     const AVPixFmtDescriptor *desc = NULL;
     int64_t x, y;
+    AVLFG lfg;
+    int ret = 0;
 
     for (y = -1; y<UINT_MAX; y+= y/2 + 1) {
         for (x = -1; x<UINT_MAX; x+= x/2 + 1) {
@@ -70,5 +105,9 @@ int main(void)
         printf(", total_size: %d\n", total_size);
     }
 
-    return 0;
+    av_lfg_init(&lfg, 1);
+    for (int i = 0; i < 10000; i++)
+        ret |= check_diff_rect(&lfg);
+
+    return ret;
 }
@@ -27,6 +27,7 @@
 #include "libavutil/adler32.h"
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
+#include "libavutil/dict.h"
 #include "libavutil/imgutils.h"
 
 int64_t *pts_array;
@@ -182,8 +183,10 @@ static long int read_seek_range(const char *string_with_number)
     return number;
 }
 
-static int seek_test(const char *input_filename, const char *start, const char *end)
+static int seek_test(const char *input_filename, const char *start, const char *end,
+                     const char *step, const char *decoder_opts)
 {
+    AVDictionary *opts = NULL;
     const AVCodec *codec = NULL;
     AVCodecContext *ctx= NULL;
     AVCodecParameters *origin_par = NULL;
@@ -193,7 +196,7 @@ static int seek_test(const char *input_filename, const char *start, const char *
     int video_stream;
     int result;
     int i, j;
-    long int start_ts, end_ts;
+    long int start_ts, end_ts, step_ts;
 
     size_of_array = 0;
     number_of_elements = 0;
@@ -214,7 +217,8 @@ static int seek_test(const char *input_filename, const char *start, const char *
 
     start_ts = read_seek_range(start);
     end_ts = read_seek_range(end);
-    if ((start_ts < 0) || (end_ts < 0)) {
+    step_ts = step ? read_seek_range(step) : 100;
+    if ((start_ts < 0) || (end_ts < 0) || (step_ts <= 0)) {
         result = -1;
         goto end;
     }
@@ -249,7 +253,15 @@ static int seek_test(const char *input_filename, const char *start, const char *
         goto end;
     }
 
-    result = avcodec_open2(ctx, codec, NULL);
+    if (decoder_opts) {
+        result = av_dict_parse_string(&opts, decoder_opts, "=", ":", 0);
+        if (result < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Can't parse decoder options\n");
+            goto end;
+        }
+    }
+
+    result = avcodec_open2(ctx, codec, &opts);
     if (result < 0) {
         av_log(ctx, AV_LOG_ERROR, "Can't open decoder\n");
         goto end;
@@ -273,8 +285,8 @@ static int seek_test(const char *input_filename, const char *start, const char *
     if (result != 0)
         goto end;
 
-    for (i = start_ts; i < end_ts; i += 100) {
-        for (j = i + 100; j < end_ts; j += 100) {
+    for (i = start_ts; i < end_ts; i += step_ts) {
+        for (j = i + step_ts; j < end_ts; j += step_ts) {
             result = compute_crc_of_packets(fmt_ctx, video_stream, ctx, pkt, fr, i, j, 0);
             if (result != 0)
                 break;
@@ -282,6 +294,7 @@ static int seek_test(const char *input_filename, const char *start, const char *
     }
 
 end:
+    av_dict_free(&opts);
     av_freep(&crc_array);
     av_freep(&pts_array);
     av_packet_free(&pkt);
@@ -298,7 +311,8 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    if (seek_test(argv[1], argv[2], argv[3]) != 0)
+    if (seek_test(argv[1], argv[2], argv[3], argc > 4 ? argv[4] : NULL,
+                  argc > 5 ? argv[5] : NULL) != 0)
         return 1;
 
     return 0;
@@ -157,6 +157,11 @@ framecrc(){
     ffmpeg "$@" -bitexact -f framecrc -
 }
 
+# the movie sources only open files below assets/ in the working directory
+framecrc_assets(){
+    (cd $target_path/tests/data && framecrc "$@")
+}
+
 ffmetadata(){
     ffmpeg "$@" -bitexact -f ffmetadata -
 }
@@ -22,6 +22,17 @@ fate-lavf-flv: KEEP_FILES ?= 1
 fate-api-seek: CMD = run $(APITESTSDIR)/api-seek-test$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.flv 0 720
 fate-api-seek: CMP = null
 
+tests/data/api-seek.gif: TAG = GEN
+tests/data/api-seek.gif: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc=s=64x48:r=25:d=2 -sws_flags +accurate_rnd+bitexact -pix_fmt rgb8 \
+        -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+# seek to every other frame of a GIF whose frames only update a part of the screen
+FATE_API_LIBAVFORMAT-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SCALE_FILTER GIF_ENCODER GIF_MUXER GIF_DEMUXER GIF_DECODER) += fate-api-seek-gif
+fate-api-seek-gif: $(APITESTSDIR)/api-seek-test$(EXESUF) tests/data/api-seek.gif
+fate-api-seek-gif: CMD = run $(APITESTSDIR)/api-seek-test$(EXESUF) $(TARGET_PATH)/tests/data/api-seek.gif 0 200 8 checkpoint_interval=16
+
 FATE_API-$(HAVE_THREADS) += fate-api-threadmessage
 fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test$(EXESUF) 3 10 30 50 2 20 40
@@ -183,6 +183,23 @@ fate-filter-pan-downmix2: tests/data/asynth-44100-11.wav
 fate-filter-pan-downmix2: SRC = $(TARGET_PATH)/tests/data/asynth-44100-11.wav
 fate-filter-pan-downmix2: CMD = framecrc -ss 3.14 -i $(SRC) -frames:a 20 -filter:a "pan=5C|c0=0.7*c0+0.7*c10|c1=c9|c2=c8|c3=c7|c4=c6"
 
+FATE_AFILTER-$(call ALLYES, LAVFI_INDEV AEVALSRC_FILTER AREVERSE_FILTER) += fate-filter-areverse fate-filter-areverse-spill
+fate-filter-areverse:       CMD = framecrc -f lavfi -i "aevalsrc=sin(2*PI*(440+4*t)*t):d=1:n=1024,areverse" -c:a pcm_f64le
+fate-filter-areverse-spill: CMD = framecrc -f lavfi -i "aevalsrc=sin(2*PI*(440+4*t)*t):d=1:n=1024,areverse=max_memory=1" -c:a pcm_f64le
+fate-filter-areverse-spill: REF = $(SRC_PATH)/tests/ref/fate/filter-areverse
+
+tests/data/assets/amovie-reverse.nut: TAG = GEN
+tests/data/assets/amovie-reverse.nut: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data/assets
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "aevalsrc=sin(2*PI*(440+40*t)*t):d=4:s=16000" -c:a mp2fixed \
+        -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_AMOVIE_REVERSE = fate-filter-amovie-reverse fate-filter-amovie-reverse-seek
+FATE_AFILTER-$(call FILTERFRAMECRC, AEVALSRC AMOVIE ARESAMPLE, LAVFI_INDEV NUT_MUXER NUT_DEMUXER MP2FIXED_ENCODER MP2_DECODER) += $(FATE_AMOVIE_REVERSE)
+$(FATE_AMOVIE_REVERSE): tests/data/assets/amovie-reverse.nut
+fate-filter-amovie-reverse:      CMD = framecrc_assets -auto_conversion_filters -lavfi amovie=assets/amovie-reverse.nut:reverse=1
+fate-filter-amovie-reverse-seek: CMD = framecrc_assets -auto_conversion_filters -lavfi amovie=assets/amovie-reverse.nut:reverse=1:seek_point=1.5
+
 FATE_AFILTER-$(call ALLYES, LAVFI_INDEV, AEVALSRC_FILTER SILENCEREMOVE_FILTER) += fate-filter-silenceremove
 fate-filter-silenceremove: CMD = framecrc -auto_conversion_filters -f lavfi -i "aevalsrc=between(t\,1\,2)+between(t\,4\,5)+between(t\,7\,9):d=10:n=8192,silenceremove=start_periods=0:start_duration=0:start_threshold=0:stop_periods=-1:stop_duration=0:stop_threshold=-90dB:window=0:detection=avg"
 
@@ -52,6 +52,11 @@ fate-filter-codecview-mvs: CMD = framecrc -flags2 +export_mvs -i $(TARGET_SAMPLE
 FATE_FILTER_SAMPLES-$(call FILTERDEMDEC, SHOWPALETTE SCALE, FLIC, FLIC) += fate-filter-showpalette
 fate-filter-showpalette: CMD = framecrc -i $(TARGET_SAMPLES)/fli/fli-engines.fli -vf showpalette=3,scale -pix_fmt bgra
 
+FATE_FILTER-yes += fate-filter-palette
+fate-filter-palette: libavfilter/tests/palette$(EXESUF)
+fate-filter-palette: CMD = run libavfilter/tests/palette$(EXESUF)
+fate-filter-palette: CMP = null
+
 FATE_FILTER_PALETTEGEN-$(call FILTERDEMDEC, SCALE PALETTEGEN, MATROSKA, H264) += fate-filter-palettegen-1 fate-filter-palettegen-2
 fate-filter-palettegen-1: CMD = framecrc -i $(TARGET_SAMPLES)/filter/anim.mkv -vf scale,palettegen,scale -pix_fmt bgra
 fate-filter-palettegen-2: CMD = framecrc -i $(TARGET_SAMPLES)/filter/anim.mkv -vf scale,palettegen=max_colors=128:reserve_transparent=0:stats_mode=diff,scale -pix_fmt bgra
@@ -59,6 +64,10 @@ fate-filter-palettegen-2: CMD = framecrc -i $(TARGET_SAMPLES)/filter/anim.mkv -v
 fate-filter-palettegen: $(FATE_FILTER_PALETTEGEN-yes)
 FATE_FILTER_SAMPLES-yes += $(FATE_FILTER_PALETTEGEN-yes)
 
+FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 FORMAT SPLIT PALETTEGEN PALETTEUSE) += fate-filter-queue-spill
+fate-filter-queue-spill: tests/data/filtergraphs/queue-spill
+fate-filter-queue-spill: CMD = framecrc -filter_graph_opts max_link_bytes=1:spill=1 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/queue-spill
+
 FATE_FILTER_PALETTEUSE += fate-filter-paletteuse-nodither
 fate-filter-paletteuse-nodither: CMD = framecrc -auto_conversion_filters -i $(TARGET_SAMPLES)/filter/anim.mkv -i $(TARGET_SAMPLES)/filter/anim-palette.png -lavfi paletteuse=none -pix_fmt bgra
 
@@ -246,8 +255,16 @@ fate-filter-overlay_yuva444_yuva444: FILTER = "scale,format=yuva444p[over];color
 fate-filter-overlay_rgba_rgba:       FILTER = "format=rgba[over];color=black:128x128,format=rgba[main];[main][over]overlay=format=rgb"
 fate-filter-overlay_gbrap_gbrap:     FILTER = "scale,format=gbrap[over];color=black:128x128,format=gbrap[main];[main][over]overlay=format=gbrp"
 
+FATE_FILTER-$(call FILTERFRAMECRC, COLOR DRAWGRID FORMAT GEQ OVERLAY) += fate-filter-overlay-static
+fate-filter-overlay-static: tests/data/filtergraphs/overlay-static
+fate-filter-overlay-static: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/overlay-static
+
+FATE_FILTER-$(call FILTERFRAMECRC, COLOR FORMAT GEQ OVERLAY SCALE) += fate-filter-overlay-repeat
+fate-filter-overlay-repeat: tests/data/filtergraphs/overlay-repeat
+fate-filter-overlay-repeat: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/overlay-repeat
+
 FATE_FILTER_SAMPLES-yes += $(FATE_FILTER_OVERLAY_SAMPLES-yes) $(FATE_FILTER_OVERLAY_ALPHA)
-fate-filter-overlays: $(FATE_FILTER_OVERLAY) $(FATE_FILTER_OVERLAY_ALPHA)
+fate-filter-overlays: $(FATE_FILTER_OVERLAY) $(FATE_FILTER_OVERLAY_ALPHA) fate-filter-overlay-static fate-filter-overlay-repeat
 
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_PHASE_FILTER) += fate-filter-phase
 fate-filter-phase: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf phase
@@ -303,6 +320,23 @@ FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 TPAD) += fate-filter-tpad-add fate-f
 fate-filter-tpad-add:   CMD = framecrc -lavfi testsrc2=d=1:r=2,tpad=start=1:stop=3:color=gray
 fate-filter-tpad-clone: CMD = framecrc -lavfi testsrc2=d=1:r=2,tpad=start=1:stop=2:stop_mode=clone:color=black
 
+FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 REVERSE) += fate-filter-reverse fate-filter-reverse-spill
+fate-filter-reverse:       CMD = framecrc -lavfi testsrc2=d=1:r=7,reverse
+fate-filter-reverse-spill: CMD = framecrc -lavfi testsrc2=d=1:r=7,reverse=max_memory=1
+fate-filter-reverse-spill: REF = $(SRC_PATH)/tests/ref/fate/filter-reverse
+
+tests/data/assets/movie-reverse.nut: TAG = GEN
+tests/data/assets/movie-reverse.nut: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data/assets
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc2=s=64x48:r=10:d=4 -c:v mpeg4 -g 10 -threads 1 \
+        -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MOVIE_REVERSE = fate-filter-movie-reverse fate-filter-movie-reverse-seek
+FATE_FILTER-$(call FILTERFRAMECRC, TESTSRC2 MOVIE, LAVFI_INDEV NUT_MUXER NUT_DEMUXER MPEG4_ENCODER MPEG4_DECODER) += $(FATE_MOVIE_REVERSE)
+$(FATE_MOVIE_REVERSE): tests/data/assets/movie-reverse.nut
+fate-filter-movie-reverse:      CMD = framecrc_assets -lavfi movie=assets/movie-reverse.nut:reverse=1
+fate-filter-movie-reverse-seek: CMD = framecrc_assets -lavfi movie=assets/movie-reverse.nut:reverse=1:seek_point=1.5
+
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_TRANSPOSE_FILTER) += fate-filter-transpose
 fate-filter-transpose: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf transpose
 
@@ -673,6 +707,11 @@ FATE_METADATA_FILTER-$(call ALLYES, $(SIGNALSTATS_DEPS)) += fate-filter-metadata
 fate-filter-metadata-signalstats-yuv420p: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;color=white:duration=1:r=1,signalstats"
 fate-filter-metadata-signalstats-yuv420p10: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;color=white:duration=1:r=1,format=yuv420p10,signalstats"
 
+# scale sends its previous output again for the repeated frames, with their own metadata
+SCALE_REPEAT_DEPS = LAVFI_INDEV TESTSRC2_FILTER FORMAT_FILTER LOOP_FILTER IDET_FILTER SCALE_FILTER
+FATE_FILTER_FFPROBE-$(call ALLYES, $(SCALE_REPEAT_DEPS)) += fate-filter-metadata-scale-repeat
+fate-filter-metadata-scale-repeat: CMD = run $(FILTER_METADATA_COMMAND) "sws_flags=+accurate_rnd+bitexact;testsrc2=s=64x48:d=0.1:r=10,format=yuv420p,loop=loop=5:size=1,idet,scale=32:24"
+
 SILENCEDETECT_DEPS = LAVFI_INDEV FILE_PROTOCOL AMOVIE_FILTER TTA_DEMUXER TTA_DECODER SILENCEDETECT_FILTER
 FATE_METADATA_FILTER-$(call ALLYES, $(SILENCEDETECT_DEPS)) += fate-filter-metadata-silencedetect
 fate-filter-metadata-silencedetect: SRC = $(TARGET_SAMPLES)/lossless-audio/inside.tta
@@ -733,9 +772,10 @@ FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER SPLIT_FILTER AVGBLUR_FILTER        \
                            PIPE_PROTOCOL) += $(FATE_FILTER_REFCMP_METADATA-yes)
 
 FATE_SAMPLES_FFPROBE += $(FATE_METADATA_FILTER-yes)
+FATE_FFPROBE += $(FATE_FILTER_FFPROBE-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_FILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_FILTER-yes)
 
 fate-vfilter: $(FATE_FILTER-yes) $(FATE_FILTER_SAMPLES-yes) $(FATE_FILTER_VSYNTH-yes)
 
-fate-filter: fate-afilter fate-vfilter $(FATE_METADATA_FILTER-yes)
+fate-filter: fate-afilter fate-vfilter $(FATE_METADATA_FILTER-yes) $(FATE_FILTER_FFPROBE-yes)
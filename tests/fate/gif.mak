@@ -26,3 +26,16 @@ fate-gifenc: $(FATE_GIF_ENC-yes)
 
 FATE_SAMPLES_FFMPEG += $(FATE_GIF-yes) $(FATE_GIF_ENC-yes)
 fate-gif: $(FATE_GIF-yes) $(FATE_GIF_ENC-yes)
+
+tests/data/gif-remux.nut: TAG = GEN
+tests/data/gif-remux.nut: tests/data/api-seek.gif ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/ffmpeg$(PROGSSUF)$(EXESUF) -nostdin \
+        -i $(TARGET_PATH)/$< -c copy -flags +bitexact -fflags +bitexact -y $(TARGET_PATH)/$@ 2>/dev/null
+
+# GIF in another container, whose first header is not at position 0
+FATE_GIF_FFPROBE-$(call ALLYES, LAVFI_INDEV TESTSRC_FILTER SCALE_FILTER GIF_ENCODER GIF_MUXER GIF_DEMUXER GIF_DECODER NUT_MUXER NUT_DEMUXER) += fate-gif-remux-nut
+fate-gif-remux-nut: tests/data/gif-remux.nut
+fate-gif-remux-nut: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -bitexact -show_entries frame=pts,key_frame,pict_type -of compact $(TARGET_PATH)/tests/data/gif-remux.nut
+
+FATE_FFMPEG_FFPROBE += $(FATE_GIF_FFPROBE-yes)
+fate-gif: $(FATE_GIF_FFPROBE-yes)
@@ -28,6 +28,11 @@ fate-codec_desc: libavcodec/tests/codec_desc$(EXESUF)
 fate-codec_desc: CMD = run libavcodec/tests/codec_desc$(EXESUF)
 fate-codec_desc: CMP = null
 
+FATE_LIBAVCODEC-$(CONFIG_GIF_ENCODER) += fate-lzwenc
+fate-lzwenc: libavcodec/tests/lzwenc$(EXESUF)
+fate-lzwenc: CMD = run libavcodec/tests/lzwenc$(EXESUF)
+fate-lzwenc: CMP = null
+
 FATE_LIBAVCODEC-$(CONFIG_GOLOMB) += fate-golomb
 fate-golomb: libavcodec/tests/golomb$(EXESUF)
 fate-golomb: CMD = run libavcodec/tests/golomb$(EXESUF)
@@ -0,0 +1,200 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Benchmark the GIF decoder over a set of files.
+ *
+ * All packets of a file are read into memory first, so only decoding is
+ * timed. Run it with builds from before and after a decoder change to
+ * compare them.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "libavformat/avformat.h"
+
+#include "libavcodec/avcodec.h"
+
+typedef struct BenchResult {
+    int64_t time;
+    int64_t in_bytes;
+    int64_t out_pixels;
+    int     nb_frames;
+} BenchResult;
+
+static int decode_packets(AVCodecContext *dec, AVPacket **pkts, int nb_pkts,
+                          AVFrame *frame, BenchResult *res)
+{
+    int ret;
+
+    for (int i = 0; i <= nb_pkts; i++) {
+        ret = avcodec_send_packet(dec, i < nb_pkts ? pkts[i] : NULL);
+        if (ret < 0)
+            return ret;
+
+        while ((ret = avcodec_receive_frame(dec, frame)) >= 0) {
+            res->out_pixels += (int64_t)frame->width * frame->height;
+            res->nb_frames++;
+            av_frame_unref(frame);
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int bench_file(const char *filename, int runs, BenchResult *res)
+{
+    AVFormatContext *fmt = NULL;
+    AVCodecContext  *dec = NULL;
+    AVPacket **pkts = NULL, *pkt = NULL;
+    AVFrame *frame = NULL;
+    const AVCodec *codec;
+    int nb_pkts = 0, stream_idx, ret;
+
+    ret = avformat_open_input(&fmt, filename, NULL, NULL);
+    if (ret < 0)
+        return ret;
+
+    ret = avformat_find_stream_info(fmt, NULL);
+    if (ret < 0)
+        goto end;
+
+    ret = stream_idx = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (ret < 0)
+        goto end;
+
+    pkt   = av_packet_alloc();
+    frame = av_frame_alloc();
+    if (!pkt || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    while ((ret = av_read_frame(fmt, pkt)) >= 0) {
+        AVPacket **tmp;
+
+        if (pkt->stream_index != stream_idx) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        tmp = av_realloc_array(pkts, nb_pkts + 1, sizeof(*pkts));
+        if (!tmp) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        pkts = tmp;
+        pkts[nb_pkts] = av_packet_clone(pkt);
+        if (!pkts[nb_pkts]) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        res->in_bytes += (int64_t)pkt->size * runs;
+        nb_pkts++;
+        av_packet_unref(pkt);
+    }
+    if (ret != AVERROR_EOF)
+        goto end;
+
+    for (int run = 0; run < runs; run++) {
+        int64_t t;
+
+        dec = avcodec_alloc_context3(codec);
+        if (!dec) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = avcodec_parameters_to_context(dec, fmt->streams[stream_idx]->codecpar);
+        if (ret < 0)
+            goto end;
+        ret = avcodec_open2(dec, codec, NULL);
+        if (ret < 0)
+            goto end;
+
+        t = av_gettime_relative();
+        ret = decode_packets(dec, pkts, nb_pkts, frame, res);
+        res->time += av_gettime_relative() - t;
+        if (ret < 0)
+            goto end;
+
+        avcodec_free_context(&dec);
+    }
+
+end:
+    for (int i = 0; i < nb_pkts; i++)
+        av_packet_free(&pkts[i]);
+    av_freep(&pkts);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&dec);
+    avformat_close_input(&fmt);
+    return ret;
+}
+
+static void print_result(const char *name, const BenchResult *res)
+{
+    double secs = FFMAX(res->time, 1) / 1000000.0;
+
+    printf("%-40s %6d frames %9.2f MB/s in %9.2f MPixel/s out\n", name, res->nb_frames,
+           res->in_bytes / secs / 1000000.0, res->out_pixels / secs / 1000000.0);
+}
+
+int main(int argc, char **argv)
+{
+    BenchResult total = { 0 };
+    int runs = 10, first = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        runs  = FFMAX(atoi(argv[2]), 1);
+        first = 3;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [-n <runs>] <file> [<file> ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = first; i < argc; i++) {
+        BenchResult res = { 0 };
+        int ret = bench_file(argv[i], runs, &res);
+
+        if (ret < 0) {
+            fprintf(stderr, "%s: %s\n", argv[i], av_err2str(ret));
+            continue;
+        }
+        print_result(argv[i], &res);
+
+        total.time       += res.time;
+        total.in_bytes   += res.in_bytes;
+        total.out_pixels += res.out_pixels;
+        total.nb_frames  += res.nb_frames;
+    }
+    print_result("total", &total);
+
+    return 0;
+}
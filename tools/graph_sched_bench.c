@@ -0,0 +1,160 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Benchmark the filter graph scheduling overhead.
+ *
+ * A tiny source is split into <width> branches of <depth> null filters each,
+ * which are stacked back together, so that nearly all the time is spent
+ * passing frames around and picking the next filter to activate.
+ *
+ * With -f and -s, the branches are made of another filter working on bigger
+ * frames, to measure how well AVFILTER_THREAD_GRAPH spreads them over -t
+ * threads.
+ *
+ * With -S 1, the graph collects statistics about its filters and links.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/bprint.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/time.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+
+static const char *branch_filter = "null";
+static const char *frame_size = "16x16";
+static int nb_threads = 1;
+static int stats = 0;
+
+static int build_graph(AVFilterGraph *graph, int width, int depth)
+{
+    AVBPrint bp;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "color=s=%s:r=25,split=%d", frame_size, width);
+    for (int i = 0; i < width; i++)
+        av_bprintf(&bp, "[s%d]", i);
+    for (int i = 0; i < width; i++) {
+        av_bprintf(&bp, ";[s%d]%s", i, branch_filter);
+        for (int j = 1; j < depth; j++)
+            av_bprintf(&bp, ",%s", branch_filter);
+        av_bprintf(&bp, "[o%d]", i);
+    }
+    av_bprintf(&bp, ";");
+    for (int i = 0; i < width; i++)
+        av_bprintf(&bp, "[o%d]", i);
+    av_bprintf(&bp, "hstack=inputs=%d,buffersink@out", width);
+    if (!av_bprint_is_complete(&bp)) {
+        av_bprint_finalize(&bp, NULL);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = avfilter_graph_parse_ptr(graph, bp.str, NULL, NULL, NULL);
+    av_bprint_finalize(&bp, NULL);
+    if (ret < 0)
+        return ret;
+
+    return avfilter_graph_config(graph, NULL);
+}
+
+static int bench_graph(int width, int depth, int nb_frames)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVFilterContext *sink;
+    int64_t t;
+    int ret;
+
+    if (!graph || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    graph->nb_threads = nb_threads;
+    if (nb_threads > 1)
+        graph->thread_type = AVFILTER_THREAD_GRAPH;
+    graph->stats = stats;
+
+    ret = build_graph(graph, width, depth);
+    if (ret < 0)
+        goto end;
+    sink = avfilter_graph_get_filter(graph, "buffersink@out");
+
+    t = av_gettime_relative();
+    for (int i = 0; i < nb_frames; i++) {
+        ret = av_buffersink_get_frame(sink, frame);
+        if (ret < 0)
+            goto end;
+        av_frame_unref(frame);
+    }
+    t = av_gettime_relative() - t;
+
+    printf("%4d x %4d (%6d filters): %8.2f us/frame\n", width, depth,
+           graph->nb_filters, (double)t / nb_frames);
+
+end:
+    av_frame_free(&frame);
+    avfilter_graph_free(&graph);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int nb_frames = 1000, first = 1;
+
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (!strcmp(argv[first], "-n"))
+            nb_frames = FFMAX(atoi(argv[first + 1]), 1);
+        else if (!strcmp(argv[first], "-t"))
+            nb_threads = FFMAX(atoi(argv[first + 1]), 1);
+        else if (!strcmp(argv[first], "-f"))
+            branch_filter = argv[first + 1];
+        else if (!strcmp(argv[first], "-s"))
+            frame_size = argv[first + 1];
+        else if (!strcmp(argv[first], "-S"))
+            stats = !!atoi(argv[first + 1]);
+        else
+            break;
+        first += 2;
+    }
+
+    if (first >= argc || (argc - first) % 2) {
+        fprintf(stderr, "Usage: %s [-n <frames>] [-t <threads>] [-f <filter>] [-s <size>] [-S <0|1>] <width> <depth> [<width> <depth> ...]\n"
+                "Width must be at least 2, depth at least 1.\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = first; i < argc; i += 2) {
+        int width = atoi(argv[i]), depth = atoi(argv[i + 1]);
+        int ret = bench_graph(FFMAX(width, 2), FFMAX(depth, 1), nb_frames);
+
+        if (ret < 0) {
+            fprintf(stderr, "%sx%s: %s\n", argv[i], argv[i + 1], av_err2str(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}